@@ -55,6 +55,14 @@ await trial(workerCount);
 
 console.log('starting');
 
+// Array.prototype.sort() compares as strings by default (so 10 < 9); sort a
+// copy numerically, and average the middle pair for even lengths.
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const mid = sorted.length >> 1;
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
 const titles = [
   'workers',
   'median per-thread encoding time', 'median encoding time', 'median wall time',
@@ -75,14 +83,11 @@ for (let numWorkers = 1; numWorkers <= workerCount; ++numWorkers) {
     await trial(numWorkers);
   }
 
-  workerTimes.sort();
-  encodingTimes.sort();
-  trialTimes.sort();
   const values = [
     numWorkers,
-    workerTimes[workerTimes.length / 2],
-    encodingTimes[encodingTimes.length / 2],
-    trialTimes[trialTimes.length / 2],
+    median(workerTimes),
+    median(encodingTimes),
+    median(trialTimes),
     workerTimes.reduce((a, b) => a + b, 0) / workerTimes.length,
     encodingTimes.reduce((a, b) => a + b, 0) / encodingTimes.length,
     trialTimes.reduce((a, b) => a + b, 0) / trialTimes.length,
@@ -0,0 +1,380 @@
+#include "alloc_counter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "cache_line.h"
+
+#if defined(ALLOC_TRACKER) && defined(__GLIBC__)
+#include <dlfcn.h>
+#define INTERPOSE_MALLOC 1
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+#else
+#define INTERPOSE_MALLOC 0
+#endif
+
+namespace {
+
+// Everything here runs inside operator new (and malloc with the tracker), so
+// it must not allocate: fixed-size tables, plain-old-data thread_locals, and
+// atomics.
+thread_local uint64_t tThreadAllocations = 0;
+
+// Counters per thread. Each thread writes only its own slot, on its own cache
+// line, so counting adds no shared writes to the render threads' allocations;
+// TotalAllocationCount() sums the slots.
+constexpr uint32_t kMaxThreads = 128;
+
+struct alignas(kCacheLineSize) ThreadSlot {
+  std::atomic<uint64_t> allocations;
+  // Tracker builds only.
+  std::atomic<uint64_t> bytes;
+  char name[32];
+};
+
+ThreadSlot gThreadSlots[kMaxThreads];
+std::atomic<uint32_t> gThreadSlotCount{0};
+thread_local ThreadSlot* tSlot = nullptr;
+
+ThreadSlot* CurrentThreadSlot() {
+  if (!tSlot) {
+    uint32_t index = gThreadSlotCount.fetch_add(1, std::memory_order_relaxed);
+    // Threads past the table share its last slot.
+    tSlot = &gThreadSlots[std::min(index, kMaxThreads - 1)];
+  }
+  return tSlot;
+}
+
+// Only the owning thread writes a slot, so a relaxed load/store pair is
+// enough for the reports, except in the shared last slot.
+void AddToSlot(ThreadSlot* slot, std::atomic<uint64_t>& counter, uint64_t n) {
+  if (slot == &gThreadSlots[kMaxThreads - 1]) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  } else {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+}
+
+#if defined(ALLOC_TRACKER)
+
+constexpr uint32_t kSiteSampleInterval = 64;
+constexpr uint32_t kSiteCapacity = 4096;  // Power of two.
+
+struct SiteEntry {
+  std::atomic<uintptr_t> address;
+  std::atomic<uint64_t> samples;
+};
+
+SiteEntry gSites[kSiteCapacity];
+
+thread_local uint32_t tSampleCountdown = 0;
+
+void SampleSite(void* returnAddress) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(returnAddress);
+  uint32_t hash = static_cast<uint32_t>((address >> 4) * 2654435761u);
+  for (uint32_t probe = 0; probe < kSiteCapacity; probe++) {
+    SiteEntry& entry = gSites[(hash + probe) & (kSiteCapacity - 1)];
+    uintptr_t current = entry.address.load(std::memory_order_relaxed);
+    if (current == 0 &&
+        entry.address.compare_exchange_strong(current, address,
+                                              std::memory_order_relaxed)) {
+      current = address;
+    }
+    if (current == address) {
+      entry.samples.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  // Table full: drop the sample.
+}
+
+#endif  // ALLOC_TRACKER
+
+inline void RecordAllocation(size_t size, void* returnAddress) {
+  tThreadAllocations++;
+  ThreadSlot* slot = CurrentThreadSlot();
+  AddToSlot(slot, slot->allocations, 1);
+#if defined(ALLOC_TRACKER)
+  AddToSlot(slot, slot->bytes, size);
+  if (tSampleCountdown-- == 0) {
+    tSampleCountdown = kSiteSampleInterval - 1;
+    SampleSite(returnAddress);
+  }
+#else
+  (void)size;
+  (void)returnAddress;
+#endif
+}
+
+#if INTERPOSE_MALLOC
+void* UpstreamMalloc(size_t size) {
+  return __libc_malloc(size);
+}
+void* UpstreamMemalign(size_t alignment, size_t size) {
+  return __libc_memalign(alignment, size);
+}
+void UpstreamFree(void* ptr) {
+  __libc_free(ptr);
+}
+#else
+void* UpstreamMalloc(size_t size) {
+  return malloc(size);
+}
+void* UpstreamMemalign(size_t alignment, size_t size) {
+  void* ptr = nullptr;
+  return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+}
+void UpstreamFree(void* ptr) {
+  free(ptr);
+}
+#endif
+
+void* CountedAllocate(size_t size, void* returnAddress) {
+  RecordAllocation(size, returnAddress);
+  return UpstreamMalloc(size ? size : 1);
+}
+
+void* CountedAllocateAligned(size_t size,
+                             std::align_val_t alignment,
+                             void* returnAddress) {
+  RecordAllocation(size, returnAddress);
+  return UpstreamMemalign(static_cast<size_t>(alignment), size ? size : 1);
+}
+
+}  // namespace
+
+uint64_t ThreadAllocationCount() {
+  return tThreadAllocations;
+}
+
+uint64_t TotalAllocationCount() {
+  uint32_t count = std::min(gThreadSlotCount.load(std::memory_order_relaxed),
+                            kMaxThreads);
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    total += gThreadSlots[i].allocations.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+#if defined(ALLOC_TRACKER)
+
+bool AllocationTrackerEnabled() {
+  return true;
+}
+
+void SetAllocationThreadName(const char* name) {
+  ThreadSlot* slot = CurrentThreadSlot();
+  strncpy(slot->name, name, sizeof(slot->name) - 1);
+  slot->name[sizeof(slot->name) - 1] = '\0';
+}
+
+size_t GetAllocationThreadStats(AllocationThreadStats* stats, size_t maxCount) {
+  size_t count = std::min<size_t>(
+      {gThreadSlotCount.load(std::memory_order_relaxed), kMaxThreads, maxCount});
+  for (size_t i = 0; i < count; i++) {
+    const ThreadSlot& slot = gThreadSlots[i];
+    stats[i].index = static_cast<uint32_t>(i);
+    memcpy(stats[i].name, slot.name, sizeof(stats[i].name));
+    stats[i].name[sizeof(stats[i].name) - 1] = '\0';
+    stats[i].allocations = slot.allocations.load(std::memory_order_relaxed);
+    stats[i].bytes = slot.bytes.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+size_t GetAllocationSites(AllocationSite* sites, size_t maxCount) {
+  // Partial selection over the table without allocating: repeatedly take the
+  // largest entry below the previous one.
+  size_t count = 0;
+  uint64_t bound = UINT64_MAX;
+  uintptr_t boundAddress = 0;
+  while (count < maxCount) {
+    const SiteEntry* best = nullptr;
+    for (const SiteEntry& entry : gSites) {
+      uintptr_t address = entry.address.load(std::memory_order_relaxed);
+      uint64_t samples = entry.samples.load(std::memory_order_relaxed);
+      if (address == 0) {
+        continue;
+      }
+      // Order by (samples desc, address asc) so ties are visited once.
+      bool belowBound = samples < bound ||
+                        (samples == bound && address > boundAddress);
+      if (belowBound &&
+          (!best || samples > best->samples.load(std::memory_order_relaxed) ||
+           (samples == best->samples.load(std::memory_order_relaxed) &&
+            address < best->address.load(std::memory_order_relaxed)))) {
+        best = &entry;
+      }
+    }
+    if (!best) {
+      break;
+    }
+    bound = best->samples.load(std::memory_order_relaxed);
+    boundAddress = best->address.load(std::memory_order_relaxed);
+    sites[count++] = {reinterpret_cast<void*>(boundAddress), bound};
+  }
+  return count;
+}
+
+void PrintAllocationSites(size_t count) {
+  AllocationSite sites[32];
+  count = GetAllocationSites(sites, std::min<size_t>(count, 32));
+  for (size_t i = 0; i < count; i++) {
+    const char* symbol = nullptr;
+#if INTERPOSE_MALLOC
+    Dl_info info;
+    if (dladdr(sites[i].returnAddress, &info) && info.dli_sname) {
+      symbol = info.dli_sname;
+    }
+#endif
+    printf("  %8llu samples  %p %s\n", (unsigned long long)sites[i].samples,
+           sites[i].returnAddress, symbol ? symbol : "");
+  }
+}
+
+#else
+
+bool AllocationTrackerEnabled() {
+  return false;
+}
+
+void SetAllocationThreadName(const char*) {}
+
+size_t GetAllocationThreadStats(AllocationThreadStats*, size_t) {
+  return 0;
+}
+
+size_t GetAllocationSites(AllocationSite*, size_t) {
+  return 0;
+}
+
+void PrintAllocationSites(size_t) {}
+
+#endif  // ALLOC_TRACKER
+
+void* operator new(size_t size) {
+  if (void* ptr = CountedAllocate(size, __builtin_return_address(0))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  if (void* ptr = CountedAllocate(size, __builtin_return_address(0))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, __builtin_return_address(0));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  if (void* ptr = CountedAllocateAligned(size, alignment,
+                                         __builtin_return_address(0))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  if (void* ptr = CountedAllocateAligned(size, alignment,
+                                         __builtin_return_address(0))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  UpstreamFree(ptr);
+}
+
+#if INTERPOSE_MALLOC
+
+// C allocations from Dawn, drivers and libc users. free() needs no counting
+// but must be defined alongside so every pointer goes back to glibc.
+extern "C" {
+
+void* malloc(size_t size) {
+  RecordAllocation(size, __builtin_return_address(0));
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  RecordAllocation(count * size, __builtin_return_address(0));
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  RecordAllocation(size, __builtin_return_address(0));
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  RecordAllocation(size, __builtin_return_address(0));
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  RecordAllocation(size, __builtin_return_address(0));
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  RecordAllocation(size, __builtin_return_address(0));
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) {
+  __libc_free(ptr);
+}
+
+}  // extern "C"
+
+#endif  // INTERPOSE_MALLOC
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counts heap allocations made through the global operator new (which this
+// module replaces), including those made inside Dawn.
+//
+// Building with the ALLOC_TRACKER option adds a tracker on top: on glibc it
+// also interposes malloc/calloc/realloc/aligned allocations (so C code and
+// drivers are counted too), keeps counters per thread, and samples the call
+// sites of every kSiteSampleInterval-th allocation of each thread into a
+// histogram. Without it the tracker queries below report nothing.
+
+// Allocations made by the calling thread so far.
+uint64_t ThreadAllocationCount();
+// Allocations made by all threads so far. Each thread counts into its own
+// cache line, so this sums the threads' counters rather than reading one
+// shared counter that every allocation would contend on.
+uint64_t TotalAllocationCount();
+
+// Adds the allocations the current thread makes during the scope's lifetime to
+// |*total|. Used to check that frame-loop code outside Dawn doesn't allocate.
+class AllocationScope {
+ public:
+  explicit AllocationScope(std::atomic<uint64_t>* total)
+      : total_(total), start_(ThreadAllocationCount()) {}
+  ~AllocationScope() {
+    total_->fetch_add(ThreadAllocationCount() - start_,
+                      std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t>* total_;
+  uint64_t start_;
+};
+
+bool AllocationTrackerEnabled();
+
+// Labels the calling thread in tracker reports. |name| is copied (truncated
+// to 31 characters).
+void SetAllocationThreadName(const char* name);
+
+struct AllocationThreadStats {
+  // Stable for the lifetime of the process; threads are tracked in the order
+  // they first allocated.
+  uint32_t index;
+  char name[32];
+  uint64_t allocations;
+  uint64_t bytes;
+};
+
+// Copies the counters of up to |maxCount| tracked threads. Returns the number
+// copied.
+size_t GetAllocationThreadStats(AllocationThreadStats* stats, size_t maxCount);
+
+struct AllocationSite {
+  void* returnAddress;
+  uint64_t samples;
+};
+
+// Copies up to |maxCount| sampled call sites, most frequent first.
+size_t GetAllocationSites(AllocationSite* sites, size_t maxCount);
+
+// Prints the |count| most sampled call sites, symbolized where possible.
+void PrintAllocationSites(size_t count);
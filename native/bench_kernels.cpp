@@ -0,0 +1,609 @@
+// Microbenchmarks for the CPU-side math and culling kernels used by main.cpp.
+//
+// Needs no WebGPU, so the web build runs it under Node (see web_build_report.js)
+// to compare the debug and optimized/SIMD wasm builds. Prints one JSON object.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cache_line.h"
+#include "camera.h"
+#include "culling.h"
+#include "handle_table.h"
+#include "job_graph.h"
+#include "mat4.h"
+#include "morton.h"
+#include "range_allocator.h"
+#include "simd4.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Volatile sink so the optimizer can't drop the benchmarked work.
+volatile float gSink;
+
+struct KernelResult {
+  const char* name;
+  double ms;
+  double itemsPerSecond;
+};
+
+KernelResult BenchMat4Multiply() {
+  constexpr size_t kMatrices = 64;
+  constexpr size_t kIterations = 2000000;
+
+  std::vector<Mat4> matrices;
+  for (size_t i = 0; i < kMatrices; i++) {
+    matrices.push_back(Mat4::Translation(Vec3((float)i, 1.0f, 2.0f)) *
+                       Mat4::Rotation(0.01f * (float)i, Vec3(0.0f, 0.0f, 1.0f)));
+  }
+
+  auto start = Clock::now();
+  float sum = 0;
+  for (size_t i = 0; i < kIterations; i++) {
+    Mat4 m = matrices[i % kMatrices] * matrices[(i + 1) % kMatrices];
+    sum += m.At(3, 0);
+  }
+  double ms = MsSince(start);
+  gSink = sum;
+  return {"mat4_multiply", ms, kIterations / (ms / 1000.0)};
+}
+
+template <typename CullFunction>
+KernelResult BenchCull(const char* name, CullFunction cull) {
+  constexpr uint32_t kSide = 1024;
+  constexpr uint32_t kObjects = kSide * kSide;
+  constexpr int kFrames = 50;
+
+  std::vector<float> x(kObjects), y(kObjects);
+  for (uint32_t i = 0; i < kObjects; i++) {
+    x[i] = (float)(i % kSide);
+    y[i] = (float)(i / kSide);
+  }
+  std::vector<uint32_t> visible(kObjects);
+
+  auto start = Clock::now();
+  size_t total = 0;
+  for (int frame = 0; frame < kFrames; frame++) {
+    DiamondRegion region{(float)(frame * 7 % kSide), (float)(frame * 13 % kSide),
+                         64.0f + frame};
+    total += cull(region, x.data(), y.data(), 0, kObjects, visible.data());
+  }
+  double ms = MsSince(start);
+  gSink = (float)total;
+  return {name, ms, (double)kObjects * kFrames / (ms / 1000.0)};
+}
+
+// The diamond test over the old array-of-structs layout, where each object's
+// position sits next to its 64-byte matrix: same work as cull_diamond_scalar,
+// but every object pulls in a whole cache line or two.
+KernelResult BenchCullAos() {
+  constexpr uint32_t kSide = 1024;
+  constexpr uint32_t kObjects = kSide * kSide;
+  constexpr int kFrames = 50;
+
+  struct Object {
+    Mat4 transform;
+    float x;
+    float y;
+  };
+  std::vector<Object> objects(kObjects);
+  for (uint32_t i = 0; i < kObjects; i++) {
+    objects[i].x = (float)(i % kSide);
+    objects[i].y = (float)(i / kSide);
+  }
+  std::vector<uint32_t> visible(kObjects);
+
+  auto start = Clock::now();
+  size_t total = 0;
+  for (int frame = 0; frame < kFrames; frame++) {
+    DiamondRegion region{(float)(frame * 7 % kSide), (float)(frame * 13 % kSide),
+                         64.0f + frame};
+    size_t count = 0;
+    for (uint32_t i = 0; i < kObjects; i++) {
+      float distance = std::fabs(objects[i].x - region.focusX) +
+                       std::fabs(objects[i].y - region.focusY);
+      if (distance < region.radius) {
+        visible[count++] = i;
+      }
+    }
+    total += count;
+  }
+  double ms = MsSince(start);
+  gSink = (float)total;
+  return {"cull_diamond_aos", ms, (double)kObjects * kFrames / (ms / 1000.0)};
+}
+
+// Bounding spheres of a side x side grid of unit quads at z = 0, in slot order
+// |order| (or row-major if empty).
+struct SphereGrid {
+  std::vector<float> x, y, z, radius;
+
+  SphereGrid(uint32_t side, const std::vector<uint32_t>& order)
+      : x(side * side), y(side * side), z(side * side, 0.0f),
+        radius(side * side, 0.7072f) {
+    for (uint32_t slot = 0; slot < side * side; slot++) {
+      uint32_t id = order.empty() ? slot : order[slot];
+      x[slot] = (float)(id % side);
+      y[slot] = (float)(id / side);
+    }
+  }
+
+  SphereArrays Arrays() const {
+    return {x.data(), y.data(), z.data(), radius.data()};
+  }
+};
+
+// A pitched perspective camera over the middle of the grid, as main.cpp uses
+// with --cull=frustum, seeing roughly |extent| objects across.
+Frustum GridCameraFrustum(uint32_t side, float extent, float pan) {
+  Camera camera;
+  camera.targetX = side * 0.5f + pan;
+  camera.targetY = side * 0.5f;
+  camera.height = 1.5f * extent;
+  camera.pitch = 0.5f;
+  camera.fovY = 1.0f;
+  camera.zNear = 0.5f;
+  camera.zFar = 10.0f * extent;
+  return Frustum::FromViewProjection(camera.ViewProjection());
+}
+
+template <typename CullFunction>
+KernelResult BenchFrustumCull(const char* name, CullFunction cull) {
+  constexpr uint32_t kSide = 1024;
+  constexpr uint32_t kObjects = kSide * kSide;
+  constexpr int kFrames = 50;
+
+  SphereGrid grid(kSide, {});
+  std::vector<uint32_t> visible(kObjects);
+
+  auto start = Clock::now();
+  size_t total = 0;
+  for (int frame = 0; frame < kFrames; frame++) {
+    Frustum frustum = GridCameraFrustum(kSide, 64.0f + frame, (float)frame);
+    total += cull(frustum, grid.Arrays(), 0, kObjects, visible.data());
+  }
+  double ms = MsSince(start);
+  gSink = (float)total;
+  return {name, ms, (double)kObjects * kFrames / (ms / 1000.0)};
+}
+
+// Culls a grid split into |kPartitions| contiguous blocks, as the render
+// threads do, in row-major or Morton slot order. Reports how many partitions
+// could be skipped whole, the mean length of visible slot runs, and the mean
+// length of the draws main.cpp makes of them: runs also break where the mesh
+// changes, and the app gives each 4x4 block of the grid one mesh.
+struct LayoutResult {
+  const char* name;
+  double partitionsSkipped;
+  double meanRunLength;
+  double meanDrawLength;
+};
+
+LayoutResult MeasureLayout(const char* name, bool morton) {
+  constexpr uint32_t kSide = 256;
+  constexpr uint32_t kObjects = kSide * kSide;
+  constexpr uint32_t kPartitions = 16;
+  constexpr uint32_t kPerPartition = kObjects / kPartitions;
+  constexpr int kFrames = 64;
+  // main.cpp's objectMesh(), over its 8 meshes.
+  constexpr uint32_t kMeshes = 8;
+
+  std::vector<uint32_t> order = BuildMortonOrder(kSide, kSide);
+  std::vector<float> x(kObjects), y(kObjects);
+  std::vector<uint32_t> mesh(kObjects);
+  for (uint32_t slot = 0; slot < kObjects; slot++) {
+    uint32_t id = morton ? order[slot] : slot;
+    x[slot] = (float)(id % kSide);
+    y[slot] = (float)(id / kSide);
+    mesh[slot] = (id % kSide / 4 + id / kSide / 4) % kMeshes;
+  }
+  std::vector<GridBounds> bounds;
+  for (uint32_t p = 0; p < kPartitions; p++) {
+    bounds.push_back(ComputeGridBounds(x.data() + p * kPerPartition,
+                                       y.data() + p * kPerPartition,
+                                       kPerPartition));
+  }
+
+  std::vector<uint32_t> visible(kPerPartition);
+  size_t skipped = 0, runs = 0, draws = 0, visibleTotal = 0;
+  for (int frame = 0; frame < kFrames; frame++) {
+    DiamondRegion region{(float)(frame * 37 % kSide), (float)(frame * 91 % kSide),
+                         40.0f};
+    for (uint32_t p = 0; p < kPartitions; p++) {
+      if (ClassifyDiamond(region, bounds[p]) == Containment::Outside) {
+        skipped++;
+        continue;
+      }
+      uint32_t first = p * kPerPartition;
+      size_t count = CullDiamond(region, x.data() + first, y.data() + first,
+                                 first, kPerPartition, visible.data());
+      for (size_t i = 0; i < count; i++) {
+        if (i == 0 || visible[i] != visible[i - 1] + 1) {
+          runs++;
+          draws++;
+        } else if (mesh[visible[i]] != mesh[visible[i - 1]]) {
+          draws++;
+        }
+      }
+      visibleTotal += count;
+    }
+  }
+  return {name, (double)skipped / (kFrames * kPartitions),
+          runs ? (double)visibleTotal / runs : 0.0,
+          draws ? (double)visibleTotal / draws : 0.0};
+}
+
+// Flat vs hierarchical culling of a Morton-ordered side x side grid with a
+// fixed-size visible region: flat cost grows with the object count, tiled cost
+// with the visible area. Run for the 2D diamond and for a 3D camera frustum.
+struct ScalingResult {
+  const char* region;
+  uint32_t objects;
+  size_t visible;
+  double flatMs;
+  double tiledMs;
+  TileHierarchy::Stats stats;
+};
+
+ScalingResult MeasureCullScaling(uint32_t side, bool frustum) {
+  const uint32_t objects = side * side;
+  SphereGrid grid(side, BuildMortonOrder(side, side));
+  SphereArrays spheres = grid.Arrays();
+  TileHierarchy hierarchy;
+  hierarchy.Build(spheres, objects, 64, 4);
+
+  std::vector<uint32_t> visible(objects);
+  DiamondCullRegion diamond({side * 0.5f, side * 0.5f, 48.0f}, spheres);
+  FrustumCullRegion camera(GridCameraFrustum(side, 48.0f, 0.0f), spheres);
+  const CullRegion& region = frustum ? static_cast<const CullRegion&>(camera)
+                                     : static_cast<const CullRegion&>(diamond);
+
+  auto start = Clock::now();
+  size_t flatCount = region.CullRange(0, objects, visible.data());
+  double flatMs = MsSince(start);
+
+  ScalingResult result{frustum ? "frustum" : "diamond", objects, 0, flatMs, 0,
+                       {}};
+  start = Clock::now();
+  result.visible =
+      hierarchy.Cull(region, 0, objects, visible.data(), &result.stats);
+  result.tiledMs = MsSince(start);
+  if (result.visible != flatCount) {
+    printf("hierarchical cull mismatch: %zu vs %zu\n", result.visible, flatCount);
+  }
+  return result;
+}
+
+// Per-thread render state as the workers use it: an output vector whose end
+// pointer is bumped for every visible object, and a counter. Packed, two
+// threads' states share each cache line; padded, every state has its own.
+struct PackedThreadState {
+  std::vector<uint32_t> visible;
+  size_t frames = 0;
+};
+
+struct alignas(kCacheLineSize) PaddedThreadState {
+  std::vector<uint32_t> visible;
+  size_t frames = 0;
+};
+
+struct FrameTimeStats {
+  double meanMs;
+  double stdevMs;
+  double p50Ms;
+  double p99Ms;
+};
+
+FrameTimeStats ComputeFrameTimeStats(std::vector<double> times) {
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (double t : times) {
+    sum += t;
+  }
+  double mean = sum / times.size();
+  double variance = 0;
+  for (double t : times) {
+    variance += (t - mean) * (t - mean);
+  }
+  variance /= times.size();
+  return {mean, std::sqrt(variance), times[times.size() / 2],
+          times[std::min(times.size() - 1, times.size() * 99 / 100)]};
+}
+
+// Runs a frame graph shaped like main.cpp's (one cull job per pool thread,
+// then a join on the calling thread) over a Morton-ordered grid, and times each
+// frame.
+template <typename State>
+FrameTimeStats MeasureThreadStateLayout(uint32_t threadCount) {
+  constexpr uint32_t kSide = 256;
+  constexpr uint32_t kObjects = kSide * kSide;
+  constexpr int kFrames = 300;
+
+  SphereGrid grid(kSide, BuildMortonOrder(kSide, kSide));
+  std::vector<State> states(threadCount);
+  for (State& state : states) {
+    state.visible.reserve(kObjects / threadCount + 1);
+  }
+
+  vks::ThreadPool pool;
+  pool.setThreadCount(threadCount);
+  JobGraph graph;
+  DiamondRegion region{};
+  std::vector<JobGraph::JobId> culls;
+  for (uint32_t i = 0; i < threadCount; i++) {
+    uint32_t first = i * kObjects / threadCount;
+    uint32_t end = (i + 1) * kObjects / threadCount;
+    State* state = &states[i];
+    culls.push_back(graph.AddJob(
+        "cull",
+        [state, first, end, &grid, &region] {
+          state->visible.clear();
+          for (uint32_t slot = first; slot < end; slot++) {
+            float distance = std::fabs(grid.x[slot] - region.focusX) +
+                             std::fabs(grid.y[slot] - region.focusY);
+            if (distance < region.radius) {
+              state->visible.push_back(slot);
+            }
+          }
+          state->frames++;
+        },
+        {}, static_cast<int>(i)));
+  }
+  graph.AddJob("join", [] {}, culls, JobGraph::kCallingThread);
+
+  std::vector<double> times;
+  for (int frame = 0; frame < kFrames; frame++) {
+    region = {(float)(frame * 37 % kSide), (float)(frame * 91 % kSide), 200.0f};
+    auto start = Clock::now();
+    graph.Run(pool);
+    times.push_back(MsSince(start));
+  }
+  pool.setThreadCount(0);
+  return ComputeFrameTimeStats(times);
+}
+
+void PrintFrameTimeStats(const char* name, const FrameTimeStats& stats) {
+  printf("\"%s\": {\"mean_ms\": %.4f, \"stdev_ms\": %.4f, \"p50_ms\": %.4f, "
+         "\"p99_ms\": %.4f}",
+         name, stats.meanMs, stats.stdevMs, stats.p50Ms, stats.p99Ms);
+}
+
+// Shared object lookups from |threadCount| threads at once, all hitting the
+// same few handles, in millions of lookups per second over all threads. A
+// shared_ptr stands in for a wgpu object: copying either one is an atomic
+// reference count increment.
+using SharedObject = std::shared_ptr<int>;
+constexpr uint32_t kHotHandles = 16;
+
+template <typename Lookup>
+double MeasureLookupThroughput(uint32_t threadCount, Lookup lookup) {
+  constexpr uint32_t kLookupsPerThread = 1000000;
+
+  std::atomic<uint32_t> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t] {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      int sum = 0;
+      for (uint32_t i = 0; i < kLookupsPerThread; i++) {
+        sum += lookup((i * 7 + t) % kHotHandles);
+      }
+      gSink = (float)sum;
+    });
+  }
+  while (ready.load() < threadCount) {
+  }
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double ms = MsSince(start);
+  return (double)kLookupsPerThread * threadCount / (ms * 1e3);
+}
+
+// HandleTable::Get() (a new reference), HandleTable::With() (pinned, no
+// reference) and a mutex-guarded map, the usual alternative.
+struct HandleLookupResult {
+  uint32_t threads;
+  double tableGetMops;
+  double tableWithMops;
+  double mutexMapMops;
+};
+
+HandleLookupResult MeasureHandleLookups(uint32_t threadCount) {
+  HandleTable<SharedObject> table(256);
+  std::mutex mutex;
+  std::unordered_map<uint64_t, SharedObject> map;
+  std::vector<HandleTable<SharedObject>::Handle> handles;
+  for (uint32_t i = 0; i < kHotHandles; i++) {
+    SharedObject object = std::make_shared<int>(i);
+    handles.push_back(table.Register(object));
+    map[handles.back()] = object;
+  }
+
+  HandleLookupResult result{threadCount, 0, 0, 0};
+  result.tableGetMops = MeasureLookupThroughput(threadCount, [&](uint32_t i) {
+    return *table.Get(handles[i]);
+  });
+  result.tableWithMops = MeasureLookupThroughput(threadCount, [&](uint32_t i) {
+    int value = 0;
+    table.With(handles[i], [&value](const SharedObject& object) {
+      value = *object;
+    });
+    return value;
+  });
+  result.mutexMapMops = MeasureLookupThroughput(threadCount, [&](uint32_t i) {
+    SharedObject object;
+    {
+      std::scoped_lock lock(mutex);
+      object = map.find(handles[i])->second;
+    }
+    return *object;
+  });
+  return result;
+}
+
+// Mesh pool churn: fills a RangeAllocator the size of main.cpp's vertex pool
+// to about three quarters with meshes of 3 to 1024 vertices, then repeatedly
+// removes a random mesh and adds one of a random size. Reports how scattered
+// the free space ends up and how many adds failed although the total free
+// space would have held them.
+struct ChurnResult {
+  uint32_t rounds;
+  RangeAllocator::Stats stats;
+  uint32_t failedAdds;
+  uint32_t failedWithRoom;
+};
+
+ChurnResult MeasureMeshChurn() {
+  constexpr uint64_t kCapacity = 16384;
+  constexpr uint32_t kRounds = 20000;
+  uint32_t seed = 12345;
+  auto random = [&seed](uint32_t bound) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % bound;
+  };
+  // Mostly small polygons, with the occasional large mesh.
+  auto meshSize = [&random]() -> uint64_t {
+    return random(8) == 0 ? 256 + random(769) : 3 + random(62);
+  };
+
+  RangeAllocator ranges(kCapacity);
+  std::vector<std::pair<uint64_t, uint64_t>> live;
+  while (ranges.GetStats().used < kCapacity * 3 / 4) {
+    uint64_t size = meshSize();
+    uint64_t offset = ranges.Allocate(size);
+    if (offset == RangeAllocator::kInvalidOffset) {
+      break;
+    }
+    live.push_back({offset, size});
+  }
+
+  ChurnResult result{kRounds, {}, 0, 0};
+  for (uint32_t round = 0; round < kRounds; round++) {
+    if (!live.empty()) {
+      size_t victim = random(static_cast<uint32_t>(live.size()));
+      ranges.Free(live[victim].first, live[victim].second);
+      live[victim] = live.back();
+      live.pop_back();
+    }
+    uint64_t size = meshSize();
+    uint64_t offset = ranges.Allocate(size);
+    if (offset == RangeAllocator::kInvalidOffset) {
+      result.failedAdds++;
+      RangeAllocator::Stats stats = ranges.GetStats();
+      result.failedWithRoom += stats.capacity - stats.used >= size;
+      continue;
+    }
+    live.push_back({offset, size});
+  }
+  result.stats = ranges.GetStats();
+  return result;
+}
+
+}  // namespace
+
+int main() {
+#ifdef __EMSCRIPTEN__
+  // Under Node this is relative to process start, so it covers module
+  // download/compile/instantiate and runtime startup.
+  double startupMs = emscripten_get_now();
+#else
+  double startupMs = -1;
+#endif
+
+  const bool simd = HAVE_SIMD4;
+
+  std::vector<KernelResult> results = {
+      BenchMat4Multiply(),
+      BenchCull("cull_diamond", CullDiamond),
+      BenchCull("cull_diamond_scalar", CullDiamondScalar),
+      BenchCullAos(),
+      BenchFrustumCull("cull_frustum", CullSpheres),
+      BenchFrustumCull("cull_frustum_scalar", CullSpheresScalar),
+  };
+
+  printf("{\"startup_ms\": %.3f, \"simd\": %s, \"kernels\": {", startupMs,
+         simd ? "true" : "false");
+  for (size_t i = 0; i < results.size(); i++) {
+    printf("%s\"%s\": {\"ms\": %.3f, \"items_per_second\": %.0f}",
+           i ? ", " : "", results[i].name, results[i].ms,
+           results[i].itemsPerSecond);
+  }
+  printf("}, \"layouts\": {");
+  LayoutResult layouts[] = {
+      MeasureLayout("row_major", false),
+      MeasureLayout("morton", true),
+  };
+  for (size_t i = 0; i < 2; i++) {
+    printf("%s\"%s\": {\"partitions_skipped\": %.3f, \"mean_run_length\": "
+           "%.2f, \"mean_draw_length\": %.2f}",
+           i ? ", " : "", layouts[i].name, layouts[i].partitionsSkipped,
+           layouts[i].meanRunLength, layouts[i].meanDrawLength);
+  }
+  printf("}, \"cull_scaling\": [");
+  const uint32_t sides[] = {256, 1024, 2048};
+  for (size_t i = 0; i < 6; i++) {
+    ScalingResult r = MeasureCullScaling(sides[i % 3], i >= 3);
+    printf("%s{\"region\": \"%s\", \"objects\": %u, \"visible\": %zu, "
+           "\"flat_ms\": %.3f, \"tiled_ms\": %.3f, \"tiles_visited\": %zu, "
+           "\"objects_tested\": %zu}",
+           i ? ", " : "", r.region, r.objects, r.visible, r.flatMs, r.tiledMs,
+           r.stats.tilesVisited, r.stats.objectsTested);
+  }
+  printf("], \"thread_state_layout\": [");
+#ifndef __EMSCRIPTEN__
+  // The web build can't start threads while main() blocks in JobGraph::Run().
+  const uint32_t threadCounts[] = {4, 8, 16, 32, 64};
+  for (size_t i = 0; i < 5; i++) {
+    uint32_t threads = threadCounts[i];
+    printf("%s{\"threads\": %u, ", i ? ", " : "", threads);
+    PrintFrameTimeStats("packed", MeasureThreadStateLayout<PackedThreadState>(threads));
+    printf(", ");
+    PrintFrameTimeStats("padded", MeasureThreadStateLayout<PaddedThreadState>(threads));
+    printf("}");
+  }
+#endif
+  printf("], \"handle_lookup\": [");
+#ifndef __EMSCRIPTEN__
+  const uint32_t lookupThreadCounts[] = {1, 2, 4, 8, 16};
+  for (size_t i = 0; i < 5; i++) {
+    HandleLookupResult r = MeasureHandleLookups(lookupThreadCounts[i]);
+    printf("%s{\"threads\": %u, \"table_get_mops\": %.2f, "
+           "\"table_with_mops\": %.2f, \"mutex_map_mops\": %.2f}",
+           i ? ", " : "", r.threads, r.tableGetMops, r.tableWithMops,
+           r.mutexMapMops);
+  }
+#endif
+  ChurnResult churn = MeasureMeshChurn();
+  printf("], \"mesh_churn\": {\"rounds\": %u, \"utilization\": %.3f, "
+         "\"free_blocks\": %u, \"fragmentation\": %.3f, \"failed_adds\": %u, "
+         "\"failed_with_room\": %u}",
+         churn.rounds, churn.stats.Utilization(), churn.stats.freeBlocks,
+         churn.stats.Fragmentation(), churn.failedAdds, churn.failedWithRoom);
+  printf(", \"hardware_threads\": %u}\n", std::thread::hardware_concurrency());
+  return 0;
+}
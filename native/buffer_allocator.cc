@@ -0,0 +1,198 @@
+#include "buffer_allocator.h"
+
+#include <cassert>
+#include <cstdio>
+#include <utility>
+
+namespace {
+
+// Offsets handed out by BufferPool blocks are multiples of this, which covers
+// the copy (4) and map (8) offset rules.
+constexpr uint64_t kPoolGranularity = 256;
+
+void PrintAllocatorStats(const char* prefix,
+                         const char* name,
+                         const BufferAllocatorStats& stats) {
+  printf("%s %s: %llu allocations from %u buffers (%llu buffers saved), "
+         "%llu/%llu KiB used by %u live allocations\n",
+         prefix, name, (unsigned long long)stats.allocations,
+         stats.buffersCreated,
+         (unsigned long long)(stats.allocations > stats.buffersCreated
+                                  ? stats.allocations - stats.buffersCreated
+                                  : 0),
+         (unsigned long long)(stats.usedBytes / 1024),
+         (unsigned long long)(stats.bufferBytes / 1024),
+         stats.liveAllocations);
+  if (stats.failedAllocations > 0) {
+    printf("%s %s: %llu failed allocations\n", prefix, name,
+           (unsigned long long)stats.failedAllocations);
+  }
+}
+
+}  // namespace
+
+BufferPool::BufferPool(wgpu::Device device,
+                       std::mutex& deviceMutex,
+                       wgpu::BufferUsage usage,
+                       uint64_t blockSize,
+                       uint64_t alignment)
+    : device_(std::move(device)),
+      deviceMutex_(deviceMutex),
+      usage_(usage),
+      blockSize_(blockSize),
+      alignment_(alignment) {}
+
+wgpu::Buffer BufferPool::CreateBuffer(uint64_t size) {
+  wgpu::BufferDescriptor descriptor{};
+  descriptor.size = size;
+  descriptor.usage = usage_;
+  wgpu::Buffer buffer;
+  {
+    std::scoped_lock lock(deviceMutex_);
+    buffer = device_.CreateBuffer(&descriptor);
+  }
+  return buffer;
+}
+
+void BufferPool::CountBuffer(uint64_t size) {
+  stats_.buffersCreated++;
+  stats_.bufferBytes += size;
+}
+
+BufferSlice BufferPool::Allocate(uint64_t size) {
+  std::scoped_lock lock(mutex_);
+  stats_.allocations++;
+
+  BufferSlice slice;
+  slice.size = size;
+  if (size > blockSize_) {
+    // Dedicated; freeing it just drops the reference.
+    slice.buffer = CreateBuffer(size);
+    CountBuffer(size);
+  } else {
+    for (uint32_t i = 0; i < blocks_.size() && !slice.buffer; i++) {
+      TlsfAllocator::Allocation allocation =
+          blocks_[i]->ranges.Allocate(size, alignment_);
+      if (allocation.node != TlsfAllocator::kInvalidNode) {
+        slice.buffer = blocks_[i]->buffer;
+        slice.offset = allocation.offset;
+        slice.block = i;
+        slice.node = allocation.node;
+      }
+    }
+    if (!slice.buffer) {
+      auto block = std::make_unique<Block>(
+          Block{CreateBuffer(blockSize_),
+                TlsfAllocator(blockSize_, kPoolGranularity)});
+      TlsfAllocator::Allocation allocation =
+          block->ranges.Allocate(size, alignment_);
+      if (allocation.node == TlsfAllocator::kInvalidNode) {
+        // The new block is dropped, so it isn't counted.
+        stats_.failedAllocations++;
+        return {};
+      }
+      CountBuffer(blockSize_);
+      slice.buffer = block->buffer;
+      slice.offset = allocation.offset;
+      slice.block = static_cast<uint32_t>(blocks_.size());
+      slice.node = allocation.node;
+      blocks_.push_back(std::move(block));
+    }
+  }
+
+  stats_.liveAllocations++;
+  stats_.usedBytes += size;
+  return slice;
+}
+
+void BufferPool::Free(const BufferSlice& slice) {
+  if (!slice.buffer) {
+    return;
+  }
+  std::scoped_lock lock(mutex_);
+  if (slice.block != UINT32_MAX) {
+    assert(blocks_[slice.block]->buffer.Get() == slice.buffer.Get());
+    blocks_[slice.block]->ranges.Free(slice.node);
+  }
+  stats_.liveAllocations--;
+  stats_.usedBytes -= slice.size;
+}
+
+BufferAllocatorStats BufferPool::GetStats() const {
+  std::scoped_lock lock(mutex_);
+  return stats_;
+}
+
+void BufferPool::PrintStats(const char* prefix, const char* name) const {
+  PrintAllocatorStats(prefix, name, GetStats());
+  std::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    TlsfAllocator::Stats ranges = blocks_[i]->ranges.GetStats();
+    uint64_t freeBytes = ranges.capacity - ranges.used;
+    printf("%s %s block %zu: %u allocations, %u free blocks, largest %llu "
+           "of %llu free bytes\n",
+           prefix, name, i, ranges.allocations, ranges.freeBlocks,
+           (unsigned long long)ranges.largestFreeBlock,
+           (unsigned long long)freeBytes);
+  }
+}
+
+LinearBufferAllocator::LinearBufferAllocator(wgpu::Device device,
+                                             std::mutex& deviceMutex,
+                                             wgpu::BufferUsage usage,
+                                             uint64_t slotSize,
+                                             uint32_t slotCount)
+    : slotSize_(slotSize), slots_(slotCount) {
+  wgpu::BufferDescriptor descriptor{};
+  descriptor.size = slotSize;
+  descriptor.usage = usage;
+  std::scoped_lock lock(deviceMutex);
+  for (wgpu::Buffer& slot : slots_) {
+    slot = device.CreateBuffer(&descriptor);
+  }
+}
+
+void LinearBufferAllocator::BeginSlot(uint32_t slot) {
+  assert(slot < slots_.size());
+  currentSlot_ = slot;
+  used_.store(0, std::memory_order_relaxed);
+  slotAllocations_.store(0, std::memory_order_relaxed);
+}
+
+BufferSlice LinearBufferAllocator::Allocate(uint64_t size, uint64_t alignment) {
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t used = used_.load(std::memory_order_relaxed);
+  uint64_t offset;
+  do {
+    offset = (used + alignment - 1) & ~(alignment - 1);
+    if (offset + size > slotSize_) {
+      failedAllocations_.fetch_add(1, std::memory_order_relaxed);
+      return {};
+    }
+  } while (!used_.compare_exchange_weak(used, offset + size,
+                                        std::memory_order_relaxed));
+  slotAllocations_.fetch_add(1, std::memory_order_relaxed);
+
+  BufferSlice slice;
+  slice.buffer = slots_[currentSlot_];
+  slice.offset = offset;
+  slice.size = size;
+  return slice;
+}
+
+BufferAllocatorStats LinearBufferAllocator::GetStats() const {
+  BufferAllocatorStats stats;
+  stats.buffersCreated = static_cast<uint32_t>(slots_.size());
+  stats.bufferBytes = slotSize_ * slots_.size();
+  stats.allocations = allocations_.load(std::memory_order_relaxed);
+  stats.failedAllocations = failedAllocations_.load(std::memory_order_relaxed);
+  stats.liveAllocations = slotAllocations_.load(std::memory_order_relaxed);
+  stats.usedBytes = used_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void LinearBufferAllocator::PrintStats(const char* prefix,
+                                       const char* name) const {
+  PrintAllocatorStats(prefix, name, GetStats());
+}
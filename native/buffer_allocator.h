@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <webgpu/webgpu_cpp.h>
+#else
+#include <dawn/webgpu_cpp.h>
+#endif
+
+#include "tlsf_allocator.h"
+
+// A range of a GPU buffer handed out by one of the allocators below. Bind or
+// copy it as (buffer, offset, size). |buffer| is null if the allocation
+// failed.
+struct BufferSlice {
+  wgpu::Buffer buffer;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+
+  // Owner bookkeeping for BufferPool::Free().
+  uint32_t block = UINT32_MAX;
+  uint32_t node = UINT32_MAX;
+};
+
+// Counters shared by both allocators. |allocations| minus |buffersCreated|
+// is the number of wgpu::Buffer objects suballocation saved.
+struct BufferAllocatorStats {
+  uint32_t buffersCreated = 0;
+  uint64_t bufferBytes = 0;
+  uint64_t allocations = 0;
+  uint64_t failedAllocations = 0;
+  // Live (BufferPool) or current slot (LinearBufferAllocator) usage.
+  uint32_t liveAllocations = 0;
+  uint64_t usedBytes = 0;
+};
+
+// Long-lived suballocations of one usage from a few large buffers
+// ("blocks"), each managed by a TlsfAllocator. Allocations larger than a
+// block get a dedicated buffer. Thread-safe.
+class BufferPool {
+ public:
+  // |alignment| applies to every slice, e.g. the device's
+  // minStorageBufferOffsetAlignment for storage bindings. |deviceMutex| is
+  // held around device calls, matching the rest of main.cpp, so it must not
+  // be held when calling Allocate().
+  BufferPool(wgpu::Device device,
+             std::mutex& deviceMutex,
+             wgpu::BufferUsage usage,
+             uint64_t blockSize,
+             uint64_t alignment);
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  BufferSlice Allocate(uint64_t size);
+  // The GPU must be done with |slice|; the range is reused immediately.
+  void Free(const BufferSlice& slice);
+
+  BufferAllocatorStats GetStats() const;
+  // Also prints per-block fragmentation.
+  void PrintStats(const char* prefix, const char* name) const;
+
+ private:
+  struct Block {
+    wgpu::Buffer buffer;
+    TlsfAllocator ranges;
+  };
+
+  wgpu::Buffer CreateBuffer(uint64_t size);
+  // Adds a buffer that is kept (dedicated or a block) to the stats.
+  void CountBuffer(uint64_t size);
+
+  wgpu::Device device_;
+  std::mutex& deviceMutex_;
+  wgpu::BufferUsage usage_;
+  uint64_t blockSize_;
+  uint64_t alignment_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+  BufferAllocatorStats stats_;
+};
+
+// Short-lived suballocations that are all released together: |slotCount|
+// buffers of |slotSize| bytes, one per frame (or batch) in flight, each
+// filled by bumping an offset. BeginSlot() recycles a slot once the GPU is
+// done with everything allocated from it. Allocate() is lock-free, so render
+// workers can share one allocator.
+class LinearBufferAllocator {
+ public:
+  LinearBufferAllocator(wgpu::Device device,
+                        std::mutex& deviceMutex,
+                        wgpu::BufferUsage usage,
+                        uint64_t slotSize,
+                        uint32_t slotCount);
+
+  LinearBufferAllocator(const LinearBufferAllocator&) = delete;
+  LinearBufferAllocator& operator=(const LinearBufferAllocator&) = delete;
+
+  // Makes |slot| current and empties it. Not thread-safe with Allocate().
+  void BeginSlot(uint32_t slot);
+  uint32_t CurrentSlot() const { return currentSlot_; }
+
+  // |alignment| must be a power of two. Returns a null slice if the current
+  // slot is full.
+  BufferSlice Allocate(uint64_t size, uint64_t alignment);
+
+  // The current slot's buffer and the bytes allocated from it so far.
+  const wgpu::Buffer& SlotBuffer() const { return slots_[currentSlot_]; }
+  uint64_t SlotUsed() const { return used_.load(std::memory_order_relaxed); }
+
+  BufferAllocatorStats GetStats() const;
+  void PrintStats(const char* prefix, const char* name) const;
+
+ private:
+  uint64_t slotSize_;
+  std::vector<wgpu::Buffer> slots_;
+  uint32_t currentSlot_ = 0;
+
+  std::atomic<uint64_t> used_{0};
+  std::atomic<uint32_t> slotAllocations_{0};
+  std::atomic<uint64_t> allocations_{0};
+  std::atomic<uint64_t> failedAllocations_{0};
+};
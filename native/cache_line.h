@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Cache line size assumed for padding data written by different threads.
+// std::hardware_destructive_interference_size isn't available on every
+// toolchain we build with, and GCC warns that its value isn't ABI-stable.
+constexpr size_t kCacheLineSize = 64;
+
+// Gives |T| a cache line (or several) to itself, e.g. for per-thread output
+// slots in an array.
+template <typename T>
+struct alignas(kCacheLineSize) CacheLinePadded {
+  T value;
+};
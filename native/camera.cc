@@ -0,0 +1,23 @@
+#include "camera.h"
+
+#include <cmath>
+
+Mat4 Camera::View() const {
+  Vec3 eye(targetX, targetY - height * std::tan(pitch), height);
+  return Mat4::Rotation(-pitch, Vec3(1, 0, 0)) *
+         Mat4::Translation(Vec3(-eye.x(), -eye.y(), -eye.z()));
+}
+
+Mat4 Camera::Projection() const {
+  return Mat4::Perspective(fovY, aspect, zNear, zFar);
+}
+
+Mat4 Camera::ViewProjection() const {
+  return Projection() * View();
+}
+
+Mat4 GridViewProjection(float side) {
+  const float cellSize = 2.0f / side;
+  const float offset = -1.0f + 0.5f * cellSize;
+  return Mat4::Translation(Vec3(offset, offset, 0)) * Mat4::Scale(cellSize);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "mat4.h"
+
+// Perspective camera over the z = 0 object plane. It looks down -z, tilted
+// by |pitch| radians towards +y, and is placed |height| above the plane so its
+// view axis hits (targetX, targetY).
+struct Camera {
+  float targetX = 0;
+  float targetY = 0;
+  float height = 10;
+  float pitch = 0;
+  float fovY = 1.0f;
+  float aspect = 1;
+  float zNear = 0.1f;
+  float zFar = 100;
+
+  Mat4 View() const;
+  Mat4 Projection() const;
+  Mat4 ViewProjection() const;
+};
+
+// Orthographic top-down mapping of a side x side object grid (unit cells
+// centered on integer coordinates) onto clip space. This is what the demo drew
+// before it had a camera.
+Mat4 GridViewProjection(float side);
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// File format shared by capture_webgpu.cc (writer) and replay.cpp (reader).
+//
+// A capture is kCaptureMagic followed by records:
+//   op          u8   CaptureOp
+//   thread      u8   capturing thread, in order of first WebGPU call (the
+//                    thread that ran init() is 0)
+//   size        varint, bytes of payload
+//   payload
+// Payload integers are LEB128 varints (zigzag for signed ones), floats and
+// doubles are raw little-endian, and strings are a varint length followed by
+// the bytes. Objects are referred to by ids assigned in creation order from 1;
+// 0 is a null object and kCaptureUnknownId one the capture didn't see created.
+// Records are in the order the calls were made, across threads.
+
+constexpr char kCaptureMagic[8] = {'W', 'G', 'P', 'U', 'C', 'A', 'P', '1'};
+constexpr uint32_t kCaptureUnknownId = 0xffffffff;
+
+enum class CaptureOp : uint8_t {
+  // Frame boundary from the app: frameTime, focusX, focusY (float),
+  // cullRadius (float).
+  Frame,
+
+  // Object creation. The first payload field is the new object's id.
+  Device,
+  GetQueue,
+  CreateShaderModule,
+  CreateBindGroupLayout,
+  CreatePipelineLayout,
+  CreateRenderPipeline,
+  CreateBuffer,
+  CreateTexture,
+  CreateTextureView,
+  CreateBindGroup,
+  CreateCommandEncoder,
+  CreateRenderBundleEncoder,
+  CreateQuerySet,
+  CreateSwapChain,
+  GetCurrentTextureView,
+  BeginRenderPass,
+  CommandEncoderFinish,
+  RenderBundleEncoderFinish,
+
+  // Lifetime: id.
+  Reference,
+  Release,
+
+  // Queue: queue id first.
+  WriteBuffer,
+  Submit,
+
+  // Encoding: pass or bundle encoder id first.
+  SetPipeline,
+  SetBindGroup,
+  SetVertexBuffer,
+  SetIndexBuffer,
+  Draw,
+  DrawIndexed,
+  ExecuteBundles,
+  BeginOcclusionQuery,
+  EndOcclusionQuery,
+  EndPass,
+
+  Count,
+};
+
+class CaptureWriter {
+ public:
+  explicit CaptureWriter(std::vector<uint8_t>* out) : out_(out) {}
+
+  void U8(uint8_t value) { out_->push_back(value); }
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      out_->push_back(static_cast<uint8_t>(value) | 0x80);
+      value >>= 7;
+    }
+    out_->push_back(static_cast<uint8_t>(value));
+  }
+  void SignedVarint(int64_t value) {
+    Varint((static_cast<uint64_t>(value) << 1) ^
+           static_cast<uint64_t>(value >> 63));
+  }
+  void Float(float value) { Bytes(&value, sizeof(value)); }
+  void Double(double value) { Bytes(&value, sizeof(value)); }
+  void String(const char* value) {
+    size_t size = value ? strlen(value) : 0;
+    Varint(size);
+    Bytes(value, size);
+  }
+  void Bytes(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out_->insert(out_->end(), bytes, bytes + size);
+  }
+
+ private:
+  std::vector<uint8_t>* out_;
+};
+
+// Reads past the end return zeros and set the error flag.
+class CaptureReader {
+ public:
+  CaptureReader(const uint8_t* data, size_t size)
+      : data_(data), end_(data + size) {}
+
+  bool AtEnd() const { return data_ == end_; }
+  bool Failed() const { return failed_; }
+
+  uint8_t U8() {
+    if (data_ == end_) {
+      failed_ = true;
+      return 0;
+    }
+    return *data_++;
+  }
+  uint64_t Varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = U8();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    return value;
+  }
+  uint32_t U32() { return static_cast<uint32_t>(Varint()); }
+  int64_t SignedVarint() {
+    uint64_t value = Varint();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+  float Float() {
+    float value = 0;
+    Bytes(&value, sizeof(value));
+    return value;
+  }
+  double Double() {
+    double value = 0;
+    Bytes(&value, sizeof(value));
+    return value;
+  }
+  std::string String() {
+    size_t size = static_cast<size_t>(Varint());
+    if (size > static_cast<size_t>(end_ - data_)) {
+      failed_ = true;
+      return {};
+    }
+    std::string value(reinterpret_cast<const char*>(data_), size);
+    data_ += size;
+    return value;
+  }
+  // Returns a pointer into the buffer.
+  const uint8_t* Bytes(size_t size) {
+    if (size > static_cast<size_t>(end_ - data_)) {
+      failed_ = true;
+      data_ = end_;
+      return nullptr;
+    }
+    const uint8_t* bytes = data_;
+    data_ += size;
+    return bytes;
+  }
+  void Bytes(void* out, size_t size) {
+    const uint8_t* bytes = Bytes(size);
+    if (bytes) {
+      memcpy(out, bytes, size);
+    }
+  }
+
+ private:
+  const uint8_t* data_;
+  const uint8_t* end_;
+  bool failed_ = false;
+};
@@ -0,0 +1,1079 @@
+#include "capture_webgpu.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "capture_format.h"
+
+namespace {
+
+DawnProcTable gReal;
+FILE* gFile = nullptr;
+const char* gPath = nullptr;
+std::atomic<bool> gActive{false};
+
+std::atomic<uint64_t> gNextSequence{0};
+uint64_t gFrames = 0;
+uint64_t gRecords = 0;
+uint64_t gBytes = 0;
+
+// Live objects by handle, with the references the app holds on them; an entry
+// goes away with the last Release(). Any change to an existing entry bumps
+// gGeneration, which invalidates the threads' lookup caches.
+struct TrackedObject {
+  uint32_t id;
+  uint32_t refs;
+};
+
+std::mutex gObjectsMutex;
+std::unordered_map<const void*, TrackedObject> gObjects;
+uint32_t gNextId = 1;
+std::atomic<uint64_t> gGeneration{0};
+
+// Encoders look up the same few objects over and over (their own handle, the
+// pipeline, the bind group), so each thread keeps its recent hits.
+struct IdCacheEntry {
+  const void* handle = nullptr;
+  uint32_t id = 0;
+  uint64_t generation = 0;
+};
+constexpr size_t kIdCacheSize = 64;
+thread_local IdCacheEntry tIdCache[kIdCacheSize];
+
+// Records made by one thread since the last flush, each as
+//   sequence  u64, raw
+//   op        u8
+//   size      varint
+//   payload
+// |payload| is scratch for the record being built.
+struct ThreadLog {
+  uint8_t index = 0;
+  std::vector<uint8_t> records;
+  std::vector<uint8_t> payload;
+
+  void Append(CaptureOp op, uint64_t sequence) {
+    size_t at = records.size();
+    records.resize(at + sizeof(sequence) + 1);
+    memcpy(&records[at], &sequence, sizeof(sequence));
+    records[at + sizeof(sequence)] = static_cast<uint8_t>(op);
+    CaptureWriter(&records).Varint(payload.size());
+    records.insert(records.end(), payload.begin(), payload.end());
+  }
+};
+
+// Logs outlive their threads, so records of a worker that exits mid-frame
+// still get flushed.
+std::mutex gThreadsMutex;
+std::vector<std::unique_ptr<ThreadLog>> gThreadLogs;
+thread_local ThreadLog* tThreadLog = nullptr;
+
+// Merged records on their way to the file.
+std::vector<uint8_t> gOutput;
+
+ThreadLog& CurrentThreadLog() {
+  if (!tThreadLog) {
+    std::scoped_lock lock(gThreadsMutex);
+    gThreadLogs.push_back(std::make_unique<ThreadLog>());
+    tThreadLog = gThreadLogs.back().get();
+    // Threads past the 256th share the last index.
+    tThreadLog->index =
+        static_cast<uint8_t>(std::min<size_t>(gThreadLogs.size() - 1, 255));
+  }
+  return *tThreadLog;
+}
+
+// Builds one record's payload in the calling thread's log and appends it,
+// numbered, when it goes out of scope.
+struct Record {
+  explicit Record(CaptureOp op)
+      : log(CurrentThreadLog()), op(op), writer(&log.payload) {
+    log.payload.clear();
+  }
+  ~Record() {
+    log.Append(op, gNextSequence.fetch_add(1, std::memory_order_relaxed));
+  }
+
+  ThreadLog& log;
+  CaptureOp op;
+  CaptureWriter writer;
+};
+
+bool Active() {
+  return gActive.load(std::memory_order_relaxed);
+}
+
+uint32_t IdOf(const void* handle) {
+  if (!handle) {
+    return 0;
+  }
+  IdCacheEntry& entry =
+      tIdCache[(reinterpret_cast<uintptr_t>(handle) >> 4) % kIdCacheSize];
+  if (entry.handle == handle &&
+      entry.generation == gGeneration.load(std::memory_order_acquire)) {
+    return entry.id;
+  }
+  std::scoped_lock lock(gObjectsMutex);
+  auto it = gObjects.find(handle);
+  if (it == gObjects.end()) {
+    // Not cached: the object may still be tracked later (a pipeline whose
+    // async creation hasn't completed).
+    return kCaptureUnknownId;
+  }
+  entry = {handle, it->second.id, gGeneration.load(std::memory_order_relaxed)};
+  return it->second.id;
+}
+
+// For a new object. An existing entry for the same handle is stale (its
+// release wasn't seen) and is replaced.
+uint32_t TrackCreated(const void* handle) {
+  std::scoped_lock lock(gObjectsMutex);
+  uint32_t id = gNextId++;
+  auto [it, inserted] = gObjects.insert({handle, {id, 1}});
+  if (!inserted) {
+    it->second = {id, 1};
+    gGeneration.fetch_add(1, std::memory_order_release);
+  }
+  return id;
+}
+
+// For getters that hand out a new reference to an object that may already be
+// tracked (Device::GetQueue, SwapChain::GetCurrentTextureView).
+uint32_t TrackAcquired(const void* handle) {
+  std::scoped_lock lock(gObjectsMutex);
+  auto [it, inserted] = gObjects.insert({handle, {gNextId, 1}});
+  if (inserted) {
+    gNextId++;
+  } else {
+    it->second.refs++;
+  }
+  return it->second.id;
+}
+
+uint32_t ReserveId() {
+  std::scoped_lock lock(gObjectsMutex);
+  return gNextId++;
+}
+
+// Merges the threads' logs into sequence order and writes them out.
+void FlushRecords() {
+  struct Cursor {
+    const ThreadLog* log;
+    size_t position;
+  };
+  static std::vector<Cursor> cursors;
+
+  std::scoped_lock lock(gThreadsMutex);
+  cursors.clear();
+  for (const std::unique_ptr<ThreadLog>& log : gThreadLogs) {
+    if (!log->records.empty()) {
+      cursors.push_back({log.get(), 0});
+    }
+  }
+
+  CaptureWriter out(&gOutput);
+  while (true) {
+    Cursor* next = nullptr;
+    uint64_t nextSequence = 0;
+    for (Cursor& cursor : cursors) {
+      if (cursor.position == cursor.log->records.size()) {
+        continue;
+      }
+      uint64_t sequence;
+      memcpy(&sequence, &cursor.log->records[cursor.position],
+             sizeof(sequence));
+      if (!next || sequence < nextSequence) {
+        next = &cursor;
+        nextSequence = sequence;
+      }
+    }
+    if (!next) {
+      break;
+    }
+
+    const std::vector<uint8_t>& records = next->log->records;
+    size_t position = next->position + sizeof(uint64_t);
+    CaptureReader reader(&records[position], records.size() - position);
+    uint8_t op = reader.U8();
+    uint64_t size = reader.Varint();
+    const uint8_t* payload = reader.Bytes(size);
+    next->position = payload + size - records.data();
+
+    out.U8(op);
+    out.U8(next->log->index);
+    out.Varint(size);
+    out.Bytes(payload, size);
+    gRecords++;
+  }
+
+  for (const std::unique_ptr<ThreadLog>& log : gThreadLogs) {
+    log->records.clear();
+  }
+  fwrite(gOutput.data(), 1, gOutput.size(), gFile);
+  gBytes += gOutput.size();
+  gOutput.clear();
+}
+
+// Descriptors.
+
+void WriteConstants(CaptureWriter& w,
+                    uint32_t count,
+                    const WGPUConstantEntry* constants) {
+  w.Varint(count);
+  for (uint32_t i = 0; i < count; i++) {
+    w.String(constants[i].key);
+    w.Double(constants[i].value);
+  }
+}
+
+void WriteShaderModule(CaptureWriter& w,
+                       const WGPUShaderModuleDescriptor* descriptor) {
+  // Only WGSL is captured; other sources replay as an empty module.
+  const char* source = nullptr;
+  for (const WGPUChainedStruct* chain = descriptor->nextInChain; chain;
+       chain = chain->next) {
+    if (chain->sType == WGPUSType_ShaderModuleWGSLDescriptor) {
+      source = reinterpret_cast<const WGPUShaderModuleWGSLDescriptor*>(chain)
+                   ->source;
+    }
+  }
+  w.String(source);
+}
+
+void WriteBindGroupLayout(CaptureWriter& w,
+                          const WGPUBindGroupLayoutDescriptor* descriptor) {
+  w.Varint(descriptor->entryCount);
+  for (uint32_t i = 0; i < descriptor->entryCount; i++) {
+    const WGPUBindGroupLayoutEntry& entry = descriptor->entries[i];
+    w.Varint(entry.binding);
+    w.Varint(entry.visibility);
+    w.Varint(entry.buffer.type);
+    w.U8(entry.buffer.hasDynamicOffset);
+    w.Varint(entry.buffer.minBindingSize);
+    w.Varint(entry.sampler.type);
+    w.Varint(entry.texture.sampleType);
+    w.Varint(entry.texture.viewDimension);
+    w.U8(entry.texture.multisampled);
+    w.Varint(entry.storageTexture.access);
+    w.Varint(entry.storageTexture.format);
+    w.Varint(entry.storageTexture.viewDimension);
+  }
+}
+
+void WritePipelineLayout(CaptureWriter& w,
+                         const WGPUPipelineLayoutDescriptor* descriptor) {
+  w.Varint(descriptor->bindGroupLayoutCount);
+  for (uint32_t i = 0; i < descriptor->bindGroupLayoutCount; i++) {
+    w.Varint(IdOf(descriptor->bindGroupLayouts[i]));
+  }
+}
+
+void WriteStencilFace(CaptureWriter& w, const WGPUStencilFaceState& face) {
+  w.Varint(face.compare);
+  w.Varint(face.failOp);
+  w.Varint(face.depthFailOp);
+  w.Varint(face.passOp);
+}
+
+void WriteBlendComponent(CaptureWriter& w,
+                         const WGPUBlendComponent& component) {
+  w.Varint(component.operation);
+  w.Varint(component.srcFactor);
+  w.Varint(component.dstFactor);
+}
+
+void WriteRenderPipeline(CaptureWriter& w,
+                         const WGPURenderPipelineDescriptor* descriptor) {
+  w.Varint(IdOf(descriptor->layout));
+
+  const WGPUVertexState& vertex = descriptor->vertex;
+  w.Varint(IdOf(vertex.module));
+  w.String(vertex.entryPoint);
+  WriteConstants(w, vertex.constantCount, vertex.constants);
+  w.Varint(vertex.bufferCount);
+  for (uint32_t i = 0; i < vertex.bufferCount; i++) {
+    const WGPUVertexBufferLayout& buffer = vertex.buffers[i];
+    w.Varint(buffer.arrayStride);
+    w.Varint(buffer.stepMode);
+    w.Varint(buffer.attributeCount);
+    for (uint32_t j = 0; j < buffer.attributeCount; j++) {
+      w.Varint(buffer.attributes[j].format);
+      w.Varint(buffer.attributes[j].offset);
+      w.Varint(buffer.attributes[j].shaderLocation);
+    }
+  }
+
+  const WGPUPrimitiveState& primitive = descriptor->primitive;
+  w.Varint(primitive.topology);
+  w.Varint(primitive.stripIndexFormat);
+  w.Varint(primitive.frontFace);
+  w.Varint(primitive.cullMode);
+
+  const WGPUDepthStencilState* depthStencil = descriptor->depthStencil;
+  w.U8(depthStencil != nullptr);
+  if (depthStencil) {
+    w.Varint(depthStencil->format);
+    w.U8(depthStencil->depthWriteEnabled);
+    w.Varint(depthStencil->depthCompare);
+    WriteStencilFace(w, depthStencil->stencilFront);
+    WriteStencilFace(w, depthStencil->stencilBack);
+    w.Varint(depthStencil->stencilReadMask);
+    w.Varint(depthStencil->stencilWriteMask);
+    w.SignedVarint(depthStencil->depthBias);
+    w.Float(depthStencil->depthBiasSlopeScale);
+    w.Float(depthStencil->depthBiasClamp);
+  }
+
+  const WGPUMultisampleState& multisample = descriptor->multisample;
+  w.Varint(multisample.count);
+  w.Varint(multisample.mask);
+  w.U8(multisample.alphaToCoverageEnabled);
+
+  const WGPUFragmentState* fragment = descriptor->fragment;
+  w.U8(fragment != nullptr);
+  if (fragment) {
+    w.Varint(IdOf(fragment->module));
+    w.String(fragment->entryPoint);
+    WriteConstants(w, fragment->constantCount, fragment->constants);
+    w.Varint(fragment->targetCount);
+    for (uint32_t i = 0; i < fragment->targetCount; i++) {
+      const WGPUColorTargetState& target = fragment->targets[i];
+      w.Varint(target.format);
+      w.U8(target.blend != nullptr);
+      if (target.blend) {
+        WriteBlendComponent(w, target.blend->color);
+        WriteBlendComponent(w, target.blend->alpha);
+      }
+      w.Varint(target.writeMask);
+    }
+  }
+}
+
+void WriteBindGroup(CaptureWriter& w,
+                    const WGPUBindGroupDescriptor* descriptor) {
+  w.Varint(IdOf(descriptor->layout));
+  w.Varint(descriptor->entryCount);
+  for (uint32_t i = 0; i < descriptor->entryCount; i++) {
+    const WGPUBindGroupEntry& entry = descriptor->entries[i];
+    w.Varint(entry.binding);
+    w.Varint(IdOf(entry.buffer));
+    w.Varint(entry.offset);
+    w.Varint(entry.size);
+    w.Varint(IdOf(entry.sampler));
+    w.Varint(IdOf(entry.textureView));
+  }
+}
+
+void WriteRenderPass(CaptureWriter& w,
+                     const WGPURenderPassDescriptor* descriptor) {
+  w.Varint(descriptor->colorAttachmentCount);
+  for (uint32_t i = 0; i < descriptor->colorAttachmentCount; i++) {
+    const WGPURenderPassColorAttachment& color =
+        descriptor->colorAttachments[i];
+    w.Varint(IdOf(color.view));
+    w.Varint(IdOf(color.resolveTarget));
+    w.Varint(color.loadOp);
+    w.Varint(color.storeOp);
+    w.Double(color.clearValue.r);
+    w.Double(color.clearValue.g);
+    w.Double(color.clearValue.b);
+    w.Double(color.clearValue.a);
+  }
+  const WGPURenderPassDepthStencilAttachment* depth =
+      descriptor->depthStencilAttachment;
+  w.U8(depth != nullptr);
+  if (depth) {
+    w.Varint(IdOf(depth->view));
+    w.Varint(depth->depthLoadOp);
+    w.Varint(depth->depthStoreOp);
+    w.Float(depth->depthClearValue);
+    w.U8(depth->depthReadOnly);
+    w.Varint(depth->stencilLoadOp);
+    w.Varint(depth->stencilStoreOp);
+    w.Varint(depth->stencilClearValue);
+    w.U8(depth->stencilReadOnly);
+  }
+  w.Varint(IdOf(descriptor->occlusionQuerySet));
+}
+
+// Device and queue.
+
+WGPUQueue DeviceGetQueue(WGPUDevice device) {
+  WGPUQueue queue = gReal.deviceGetQueue(device);
+  if (Active() && queue) {
+    Record record(CaptureOp::GetQueue);
+    record.writer.Varint(TrackAcquired(queue));
+    record.writer.Varint(IdOf(device));
+  }
+  return queue;
+}
+
+// The creation procs share a shape: forward, then record the new object's id
+// followed by |write|'s serialization of the descriptor.
+template <typename Handle, typename Descriptor, typename Write>
+Handle RecordCreation(CaptureOp op,
+                      Handle handle,
+                      const Descriptor* descriptor,
+                      Write write) {
+  if (Active() && handle) {
+    Record record(op);
+    record.writer.Varint(TrackCreated(handle));
+    write(record.writer, descriptor);
+  }
+  return handle;
+}
+
+WGPUShaderModule DeviceCreateShaderModule(
+    WGPUDevice device,
+    const WGPUShaderModuleDescriptor* descriptor) {
+  return RecordCreation(CaptureOp::CreateShaderModule,
+                        gReal.deviceCreateShaderModule(device, descriptor),
+                        descriptor, WriteShaderModule);
+}
+
+WGPUBindGroupLayout DeviceCreateBindGroupLayout(
+    WGPUDevice device,
+    const WGPUBindGroupLayoutDescriptor* descriptor) {
+  return RecordCreation(CaptureOp::CreateBindGroupLayout,
+                        gReal.deviceCreateBindGroupLayout(device, descriptor),
+                        descriptor, WriteBindGroupLayout);
+}
+
+WGPUPipelineLayout DeviceCreatePipelineLayout(
+    WGPUDevice device,
+    const WGPUPipelineLayoutDescriptor* descriptor) {
+  return RecordCreation(CaptureOp::CreatePipelineLayout,
+                        gReal.deviceCreatePipelineLayout(device, descriptor),
+                        descriptor, WritePipelineLayout);
+}
+
+WGPURenderPipeline DeviceCreateRenderPipeline(
+    WGPUDevice device,
+    const WGPURenderPipelineDescriptor* descriptor) {
+  return RecordCreation(CaptureOp::CreateRenderPipeline,
+                        gReal.deviceCreateRenderPipeline(device, descriptor),
+                        descriptor, WriteRenderPipeline);
+}
+
+struct PendingPipeline {
+  WGPUCreateRenderPipelineAsyncCallback callback;
+  void* userdata;
+  uint32_t id;
+};
+
+void OnRenderPipelineCreated(WGPUCreatePipelineAsyncStatus status,
+                             WGPURenderPipeline pipeline,
+                             const char* message,
+                             void* userdata) {
+  std::unique_ptr<PendingPipeline> pending(
+      static_cast<PendingPipeline*>(userdata));
+  if (pipeline) {
+    std::scoped_lock lock(gObjectsMutex);
+    auto [it, inserted] = gObjects.insert({pipeline, {pending->id, 1}});
+    if (!inserted) {
+      it->second = {pending->id, 1};
+      gGeneration.fetch_add(1, std::memory_order_release);
+    }
+  }
+  pending->callback(status, pipeline, message, pending->userdata);
+}
+
+// Recorded as a plain creation when it's requested: the app can't use the
+// pipeline before the callback, so replay may as well create it right away.
+// The handle is tied to the reserved id once it exists.
+void DeviceCreateRenderPipelineAsync(
+    WGPUDevice device,
+    const WGPURenderPipelineDescriptor* descriptor,
+    WGPUCreateRenderPipelineAsyncCallback callback,
+    void* userdata) {
+  if (!Active()) {
+    gReal.deviceCreateRenderPipelineAsync(device, descriptor, callback,
+                                          userdata);
+    return;
+  }
+  uint32_t id = ReserveId();
+  {
+    Record record(CaptureOp::CreateRenderPipeline);
+    record.writer.Varint(id);
+    WriteRenderPipeline(record.writer, descriptor);
+  }
+  gReal.deviceCreateRenderPipelineAsync(
+      device, descriptor, OnRenderPipelineCreated,
+      new PendingPipeline{callback, userdata, id});
+}
+
+WGPUBuffer DeviceCreateBuffer(WGPUDevice device,
+                              const WGPUBufferDescriptor* descriptor) {
+  return RecordCreation(
+      CaptureOp::CreateBuffer, gReal.deviceCreateBuffer(device, descriptor),
+      descriptor, [](CaptureWriter& w, const WGPUBufferDescriptor* d) {
+        w.Varint(d->usage);
+        w.Varint(d->size);
+        w.U8(d->mappedAtCreation);
+      });
+}
+
+WGPUTexture DeviceCreateTexture(WGPUDevice device,
+                                const WGPUTextureDescriptor* descriptor) {
+  // View formats aren't recorded.
+  return RecordCreation(
+      CaptureOp::CreateTexture, gReal.deviceCreateTexture(device, descriptor),
+      descriptor, [](CaptureWriter& w, const WGPUTextureDescriptor* d) {
+        w.Varint(d->usage);
+        w.Varint(d->dimension);
+        w.Varint(d->size.width);
+        w.Varint(d->size.height);
+        w.Varint(d->size.depthOrArrayLayers);
+        w.Varint(d->format);
+        w.Varint(d->mipLevelCount);
+        w.Varint(d->sampleCount);
+      });
+}
+
+WGPUTextureView TextureCreateView(WGPUTexture texture,
+                                  const WGPUTextureViewDescriptor* descriptor) {
+  WGPUTextureView view = gReal.textureCreateView(texture, descriptor);
+  if (Active() && view) {
+    Record record(CaptureOp::CreateTextureView);
+    CaptureWriter& w = record.writer;
+    w.Varint(TrackCreated(view));
+    w.Varint(IdOf(texture));
+    w.U8(descriptor != nullptr);
+    if (descriptor) {
+      w.Varint(descriptor->format);
+      w.Varint(descriptor->dimension);
+      w.Varint(descriptor->baseMipLevel);
+      w.Varint(descriptor->mipLevelCount);
+      w.Varint(descriptor->baseArrayLayer);
+      w.Varint(descriptor->arrayLayerCount);
+      w.Varint(descriptor->aspect);
+    }
+  }
+  return view;
+}
+
+WGPUBindGroup DeviceCreateBindGroup(WGPUDevice device,
+                                    const WGPUBindGroupDescriptor* descriptor) {
+  return RecordCreation(CaptureOp::CreateBindGroup,
+                        gReal.deviceCreateBindGroup(device, descriptor),
+                        descriptor, WriteBindGroup);
+}
+
+WGPUQuerySet DeviceCreateQuerySet(WGPUDevice device,
+                                  const WGPUQuerySetDescriptor* descriptor) {
+  return RecordCreation(
+      CaptureOp::CreateQuerySet, gReal.deviceCreateQuerySet(device, descriptor),
+      descriptor, [](CaptureWriter& w, const WGPUQuerySetDescriptor* d) {
+        w.Varint(d->type);
+        w.Varint(d->count);
+      });
+}
+
+WGPUSwapChain DeviceCreateSwapChain(WGPUDevice device,
+                                    WGPUSurface surface,
+                                    const WGPUSwapChainDescriptor* descriptor) {
+  return RecordCreation(
+      CaptureOp::CreateSwapChain,
+      gReal.deviceCreateSwapChain(device, surface, descriptor), descriptor,
+      [](CaptureWriter& w, const WGPUSwapChainDescriptor* d) {
+        w.Varint(d->usage);
+        w.Varint(d->format);
+        w.Varint(d->width);
+        w.Varint(d->height);
+        w.Varint(d->presentMode);
+      });
+}
+
+WGPUTextureView SwapChainGetCurrentTextureView(WGPUSwapChain swapChain) {
+  WGPUTextureView view = gReal.swapChainGetCurrentTextureView(swapChain);
+  if (Active() && view) {
+    Record record(CaptureOp::GetCurrentTextureView);
+    record.writer.Varint(TrackAcquired(view));
+    record.writer.Varint(IdOf(swapChain));
+  }
+  return view;
+}
+
+WGPUCommandEncoder DeviceCreateCommandEncoder(
+    WGPUDevice device,
+    const WGPUCommandEncoderDescriptor* descriptor) {
+  return RecordCreation(
+      CaptureOp::CreateCommandEncoder,
+      gReal.deviceCreateCommandEncoder(device, descriptor), descriptor,
+      [](CaptureWriter&, const WGPUCommandEncoderDescriptor*) {});
+}
+
+WGPURenderBundleEncoder DeviceCreateRenderBundleEncoder(
+    WGPUDevice device,
+    const WGPURenderBundleEncoderDescriptor* descriptor) {
+  return RecordCreation(
+      CaptureOp::CreateRenderBundleEncoder,
+      gReal.deviceCreateRenderBundleEncoder(device, descriptor), descriptor,
+      [](CaptureWriter& w, const WGPURenderBundleEncoderDescriptor* d) {
+        w.Varint(d->colorFormatsCount);
+        for (uint32_t i = 0; i < d->colorFormatsCount; i++) {
+          w.Varint(d->colorFormats[i]);
+        }
+        w.Varint(d->depthStencilFormat);
+        w.Varint(d->sampleCount);
+        w.U8(d->depthReadOnly);
+        w.U8(d->stencilReadOnly);
+      });
+}
+
+void QueueWriteBuffer(WGPUQueue queue,
+                      WGPUBuffer buffer,
+                      uint64_t offset,
+                      const void* data,
+                      size_t size) {
+  if (Active()) {
+    Record record(CaptureOp::WriteBuffer);
+    record.writer.Varint(IdOf(queue));
+    record.writer.Varint(IdOf(buffer));
+    record.writer.Varint(offset);
+    record.writer.Varint(size);
+    record.writer.Bytes(data, size);
+  }
+  gReal.queueWriteBuffer(queue, buffer, offset, data, size);
+}
+
+void QueueSubmit(WGPUQueue queue,
+                 uint32_t count,
+                 const WGPUCommandBuffer* commands) {
+  if (Active()) {
+    Record record(CaptureOp::Submit);
+    record.writer.Varint(IdOf(queue));
+    record.writer.Varint(count);
+    for (uint32_t i = 0; i < count; i++) {
+      record.writer.Varint(IdOf(commands[i]));
+    }
+  }
+  gReal.queueSubmit(queue, count, commands);
+}
+
+// Encoders.
+
+WGPURenderPassEncoder CommandEncoderBeginRenderPass(
+    WGPUCommandEncoder encoder,
+    const WGPURenderPassDescriptor* descriptor) {
+  WGPURenderPassEncoder pass =
+      gReal.commandEncoderBeginRenderPass(encoder, descriptor);
+  if (Active() && pass) {
+    Record record(CaptureOp::BeginRenderPass);
+    record.writer.Varint(TrackCreated(pass));
+    record.writer.Varint(IdOf(encoder));
+    WriteRenderPass(record.writer, descriptor);
+  }
+  return pass;
+}
+
+WGPUCommandBuffer CommandEncoderFinish(
+    WGPUCommandEncoder encoder,
+    const WGPUCommandBufferDescriptor* descriptor) {
+  WGPUCommandBuffer commands = gReal.commandEncoderFinish(encoder, descriptor);
+  if (Active() && commands) {
+    Record record(CaptureOp::CommandEncoderFinish);
+    record.writer.Varint(TrackCreated(commands));
+    record.writer.Varint(IdOf(encoder));
+  }
+  return commands;
+}
+
+WGPURenderBundle RenderBundleEncoderFinish(
+    WGPURenderBundleEncoder encoder,
+    const WGPURenderBundleDescriptor* descriptor) {
+  WGPURenderBundle bundle =
+      gReal.renderBundleEncoderFinish(encoder, descriptor);
+  if (Active() && bundle) {
+    Record record(CaptureOp::RenderBundleEncoderFinish);
+    record.writer.Varint(TrackCreated(bundle));
+    record.writer.Varint(IdOf(encoder));
+  }
+  return bundle;
+}
+
+// Pass and bundle encoders record the same ops; replay tells them apart by
+// the kind of object the id was created as.
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder, WGPURenderPipeline)>
+void EncoderSetPipeline(Encoder encoder, WGPURenderPipeline pipeline) {
+  if (Active()) {
+    Record record(CaptureOp::SetPipeline);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(IdOf(pipeline));
+  }
+  (gReal.*Real)(encoder, pipeline);
+}
+
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder,
+                                       uint32_t,
+                                       WGPUBindGroup,
+                                       uint32_t,
+                                       const uint32_t*)>
+void EncoderSetBindGroup(Encoder encoder,
+                         uint32_t index,
+                         WGPUBindGroup group,
+                         uint32_t dynamicOffsetCount,
+                         const uint32_t* dynamicOffsets) {
+  if (Active()) {
+    Record record(CaptureOp::SetBindGroup);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(index);
+    record.writer.Varint(IdOf(group));
+    record.writer.Varint(dynamicOffsetCount);
+    for (uint32_t i = 0; i < dynamicOffsetCount; i++) {
+      record.writer.Varint(dynamicOffsets[i]);
+    }
+  }
+  (gReal.*Real)(encoder, index, group, dynamicOffsetCount, dynamicOffsets);
+}
+
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder,
+                                       uint32_t,
+                                       WGPUBuffer,
+                                       uint64_t,
+                                       uint64_t)>
+void EncoderSetVertexBuffer(Encoder encoder,
+                            uint32_t slot,
+                            WGPUBuffer buffer,
+                            uint64_t offset,
+                            uint64_t size) {
+  if (Active()) {
+    Record record(CaptureOp::SetVertexBuffer);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(slot);
+    record.writer.Varint(IdOf(buffer));
+    record.writer.Varint(offset);
+    record.writer.Varint(size);
+  }
+  (gReal.*Real)(encoder, slot, buffer, offset, size);
+}
+
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder,
+                                       WGPUBuffer,
+                                       WGPUIndexFormat,
+                                       uint64_t,
+                                       uint64_t)>
+void EncoderSetIndexBuffer(Encoder encoder,
+                           WGPUBuffer buffer,
+                           WGPUIndexFormat format,
+                           uint64_t offset,
+                           uint64_t size) {
+  if (Active()) {
+    Record record(CaptureOp::SetIndexBuffer);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(IdOf(buffer));
+    record.writer.Varint(format);
+    record.writer.Varint(offset);
+    record.writer.Varint(size);
+  }
+  (gReal.*Real)(encoder, buffer, format, offset, size);
+}
+
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder,
+                                       uint32_t,
+                                       uint32_t,
+                                       uint32_t,
+                                       uint32_t)>
+void EncoderDraw(Encoder encoder,
+                 uint32_t vertexCount,
+                 uint32_t instanceCount,
+                 uint32_t firstVertex,
+                 uint32_t firstInstance) {
+  if (Active()) {
+    Record record(CaptureOp::Draw);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(vertexCount);
+    record.writer.Varint(instanceCount);
+    record.writer.Varint(firstVertex);
+    record.writer.Varint(firstInstance);
+  }
+  (gReal.*Real)(encoder, vertexCount, instanceCount, firstVertex,
+                firstInstance);
+}
+
+template <typename Encoder,
+          void (*DawnProcTable::*Real)(Encoder,
+                                       uint32_t,
+                                       uint32_t,
+                                       uint32_t,
+                                       int32_t,
+                                       uint32_t)>
+void EncoderDrawIndexed(Encoder encoder,
+                        uint32_t indexCount,
+                        uint32_t instanceCount,
+                        uint32_t firstIndex,
+                        int32_t baseVertex,
+                        uint32_t firstInstance) {
+  if (Active()) {
+    Record record(CaptureOp::DrawIndexed);
+    record.writer.Varint(IdOf(encoder));
+    record.writer.Varint(indexCount);
+    record.writer.Varint(instanceCount);
+    record.writer.Varint(firstIndex);
+    record.writer.SignedVarint(baseVertex);
+    record.writer.Varint(firstInstance);
+  }
+  (gReal.*Real)(encoder, indexCount, instanceCount, firstIndex, baseVertex,
+                firstInstance);
+}
+
+void RenderPassEncoderExecuteBundles(WGPURenderPassEncoder pass,
+                                     uint32_t count,
+                                     const WGPURenderBundle* bundles) {
+  if (Active()) {
+    Record record(CaptureOp::ExecuteBundles);
+    record.writer.Varint(IdOf(pass));
+    record.writer.Varint(count);
+    for (uint32_t i = 0; i < count; i++) {
+      record.writer.Varint(IdOf(bundles[i]));
+    }
+  }
+  gReal.renderPassEncoderExecuteBundles(pass, count, bundles);
+}
+
+void RenderPassEncoderBeginOcclusionQuery(WGPURenderPassEncoder pass,
+                                          uint32_t queryIndex) {
+  if (Active()) {
+    Record record(CaptureOp::BeginOcclusionQuery);
+    record.writer.Varint(IdOf(pass));
+    record.writer.Varint(queryIndex);
+  }
+  gReal.renderPassEncoderBeginOcclusionQuery(pass, queryIndex);
+}
+
+void RenderPassEncoderEndOcclusionQuery(WGPURenderPassEncoder pass) {
+  if (Active()) {
+    Record record(CaptureOp::EndOcclusionQuery);
+    record.writer.Varint(IdOf(pass));
+  }
+  gReal.renderPassEncoderEndOcclusionQuery(pass);
+}
+
+void RenderPassEncoderEnd(WGPURenderPassEncoder pass) {
+  if (Active()) {
+    Record record(CaptureOp::EndPass);
+    record.writer.Varint(IdOf(pass));
+  }
+  gReal.renderPassEncoderEnd(pass);
+}
+
+// Reference counting, mirrored so ids can be dropped with their objects.
+
+template <typename Handle>
+using HandleProc = void (*)(Handle);
+
+template <typename Handle, HandleProc<Handle> DawnProcTable::*Real>
+void Reference(Handle handle) {
+  if (Active()) {
+    uint32_t id = kCaptureUnknownId;
+    {
+      std::scoped_lock lock(gObjectsMutex);
+      auto it = gObjects.find(handle);
+      if (it != gObjects.end()) {
+        it->second.refs++;
+        id = it->second.id;
+      }
+    }
+    Record record(CaptureOp::Reference);
+    record.writer.Varint(id);
+  }
+  (gReal.*Real)(handle);
+}
+
+// Recorded before forwarding: once the object is gone its address can be
+// reused by a creation on another thread, which must come later in the
+// capture.
+template <typename Handle, HandleProc<Handle> DawnProcTable::*Real>
+void Release(Handle handle) {
+  if (Active()) {
+    uint32_t id = kCaptureUnknownId;
+    {
+      std::scoped_lock lock(gObjectsMutex);
+      auto it = gObjects.find(handle);
+      if (it != gObjects.end()) {
+        id = it->second.id;
+        if (--it->second.refs == 0) {
+          gObjects.erase(it);
+          gGeneration.fetch_add(1, std::memory_order_release);
+        }
+      }
+    }
+    Record record(CaptureOp::Release);
+    record.writer.Varint(id);
+  }
+  (gReal.*Real)(handle);
+}
+
+template <typename Handle,
+          HandleProc<Handle> DawnProcTable::*ReferenceProc,
+          HandleProc<Handle> DawnProcTable::*ReleaseProc>
+void CaptureLifetime(DawnProcTable* procs) {
+  procs->*ReferenceProc = Reference<Handle, ReferenceProc>;
+  procs->*ReleaseProc = Release<Handle, ReleaseProc>;
+}
+
+}  // namespace
+
+bool CaptureWebGPUBegin(const char* path,
+                        const DawnProcTable& procs,
+                        WGPUDevice device,
+                        DawnProcTable* captureProcs) {
+  gFile = fopen(path, "wb");
+  if (!gFile) {
+    fprintf(stderr, "[capture] can't open %s\n", path);
+    return false;
+  }
+  gPath = path;
+  fwrite(kCaptureMagic, 1, sizeof(kCaptureMagic), gFile);
+  gBytes = sizeof(kCaptureMagic);
+  gReal = procs;
+
+  DawnProcTable& p = *captureProcs;
+  p = procs;
+  p.deviceGetQueue = DeviceGetQueue;
+  p.deviceCreateShaderModule = DeviceCreateShaderModule;
+  p.deviceCreateBindGroupLayout = DeviceCreateBindGroupLayout;
+  p.deviceCreatePipelineLayout = DeviceCreatePipelineLayout;
+  p.deviceCreateRenderPipeline = DeviceCreateRenderPipeline;
+  p.deviceCreateRenderPipelineAsync = DeviceCreateRenderPipelineAsync;
+  p.deviceCreateBuffer = DeviceCreateBuffer;
+  p.deviceCreateTexture = DeviceCreateTexture;
+  p.deviceCreateBindGroup = DeviceCreateBindGroup;
+  p.deviceCreateQuerySet = DeviceCreateQuerySet;
+  p.deviceCreateSwapChain = DeviceCreateSwapChain;
+  p.deviceCreateCommandEncoder = DeviceCreateCommandEncoder;
+  p.deviceCreateRenderBundleEncoder = DeviceCreateRenderBundleEncoder;
+  p.textureCreateView = TextureCreateView;
+  p.swapChainGetCurrentTextureView = SwapChainGetCurrentTextureView;
+  p.queueWriteBuffer = QueueWriteBuffer;
+  p.queueSubmit = QueueSubmit;
+
+  p.commandEncoderBeginRenderPass = CommandEncoderBeginRenderPass;
+  p.commandEncoderFinish = CommandEncoderFinish;
+  p.renderBundleEncoderFinish = RenderBundleEncoderFinish;
+  p.renderPassEncoderSetPipeline =
+      EncoderSetPipeline<WGPURenderPassEncoder,
+                         &DawnProcTable::renderPassEncoderSetPipeline>;
+  p.renderPassEncoderSetBindGroup =
+      EncoderSetBindGroup<WGPURenderPassEncoder,
+                          &DawnProcTable::renderPassEncoderSetBindGroup>;
+  p.renderPassEncoderSetVertexBuffer =
+      EncoderSetVertexBuffer<WGPURenderPassEncoder,
+                             &DawnProcTable::renderPassEncoderSetVertexBuffer>;
+  p.renderPassEncoderSetIndexBuffer =
+      EncoderSetIndexBuffer<WGPURenderPassEncoder,
+                            &DawnProcTable::renderPassEncoderSetIndexBuffer>;
+  p.renderPassEncoderDraw =
+      EncoderDraw<WGPURenderPassEncoder, &DawnProcTable::renderPassEncoderDraw>;
+  p.renderPassEncoderDrawIndexed =
+      EncoderDrawIndexed<WGPURenderPassEncoder,
+                         &DawnProcTable::renderPassEncoderDrawIndexed>;
+  p.renderPassEncoderExecuteBundles = RenderPassEncoderExecuteBundles;
+  p.renderPassEncoderBeginOcclusionQuery = RenderPassEncoderBeginOcclusionQuery;
+  p.renderPassEncoderEndOcclusionQuery = RenderPassEncoderEndOcclusionQuery;
+  p.renderPassEncoderEnd = RenderPassEncoderEnd;
+  p.renderBundleEncoderSetPipeline =
+      EncoderSetPipeline<WGPURenderBundleEncoder,
+                         &DawnProcTable::renderBundleEncoderSetPipeline>;
+  p.renderBundleEncoderSetBindGroup =
+      EncoderSetBindGroup<WGPURenderBundleEncoder,
+                          &DawnProcTable::renderBundleEncoderSetBindGroup>;
+  p.renderBundleEncoderSetVertexBuffer = EncoderSetVertexBuffer<
+      WGPURenderBundleEncoder,
+      &DawnProcTable::renderBundleEncoderSetVertexBuffer>;
+  p.renderBundleEncoderSetIndexBuffer = EncoderSetIndexBuffer<
+      WGPURenderBundleEncoder,
+      &DawnProcTable::renderBundleEncoderSetIndexBuffer>;
+  p.renderBundleEncoderDraw =
+      EncoderDraw<WGPURenderBundleEncoder,
+                  &DawnProcTable::renderBundleEncoderDraw>;
+  p.renderBundleEncoderDrawIndexed =
+      EncoderDrawIndexed<WGPURenderBundleEncoder,
+                         &DawnProcTable::renderBundleEncoderDrawIndexed>;
+
+  CaptureLifetime<WGPUDevice, &DawnProcTable::deviceReference,
+                  &DawnProcTable::deviceRelease>(&p);
+  CaptureLifetime<WGPUQueue, &DawnProcTable::queueReference,
+                  &DawnProcTable::queueRelease>(&p);
+  CaptureLifetime<WGPUBuffer, &DawnProcTable::bufferReference,
+                  &DawnProcTable::bufferRelease>(&p);
+  CaptureLifetime<WGPUTexture, &DawnProcTable::textureReference,
+                  &DawnProcTable::textureRelease>(&p);
+  CaptureLifetime<WGPUTextureView, &DawnProcTable::textureViewReference,
+                  &DawnProcTable::textureViewRelease>(&p);
+  CaptureLifetime<WGPUShaderModule, &DawnProcTable::shaderModuleReference,
+                  &DawnProcTable::shaderModuleRelease>(&p);
+  CaptureLifetime<WGPUBindGroupLayout,
+                  &DawnProcTable::bindGroupLayoutReference,
+                  &DawnProcTable::bindGroupLayoutRelease>(&p);
+  CaptureLifetime<WGPUPipelineLayout, &DawnProcTable::pipelineLayoutReference,
+                  &DawnProcTable::pipelineLayoutRelease>(&p);
+  CaptureLifetime<WGPURenderPipeline, &DawnProcTable::renderPipelineReference,
+                  &DawnProcTable::renderPipelineRelease>(&p);
+  CaptureLifetime<WGPUBindGroup, &DawnProcTable::bindGroupReference,
+                  &DawnProcTable::bindGroupRelease>(&p);
+  CaptureLifetime<WGPUQuerySet, &DawnProcTable::querySetReference,
+                  &DawnProcTable::querySetRelease>(&p);
+  CaptureLifetime<WGPUSwapChain, &DawnProcTable::swapChainReference,
+                  &DawnProcTable::swapChainRelease>(&p);
+  CaptureLifetime<WGPUCommandEncoder, &DawnProcTable::commandEncoderReference,
+                  &DawnProcTable::commandEncoderRelease>(&p);
+  CaptureLifetime<WGPURenderPassEncoder,
+                  &DawnProcTable::renderPassEncoderReference,
+                  &DawnProcTable::renderPassEncoderRelease>(&p);
+  CaptureLifetime<WGPURenderBundleEncoder,
+                  &DawnProcTable::renderBundleEncoderReference,
+                  &DawnProcTable::renderBundleEncoderRelease>(&p);
+  CaptureLifetime<WGPUCommandBuffer, &DawnProcTable::commandBufferReference,
+                  &DawnProcTable::commandBufferRelease>(&p);
+  CaptureLifetime<WGPURenderBundle, &DawnProcTable::renderBundleReference,
+                  &DawnProcTable::renderBundleRelease>(&p);
+
+  // The calling thread becomes thread 0.
+  CurrentThreadLog();
+  gActive.store(true);
+  Record record(CaptureOp::Device);
+  record.writer.Varint(TrackAcquired(device));
+  return true;
+}
+
+void CaptureWebGPUFrame(uint32_t frameTime,
+                        float focusX,
+                        float focusY,
+                        float cullRadius) {
+  if (!Active()) {
+    return;
+  }
+  {
+    Record record(CaptureOp::Frame);
+    record.writer.Varint(frameTime);
+    record.writer.Float(focusX);
+    record.writer.Float(focusY);
+    record.writer.Float(cullRadius);
+  }
+  FlushRecords();
+  gFrames++;
+}
+
+void CaptureWebGPUEnd() {
+  if (!Active()) {
+    return;
+  }
+  gActive.store(false);
+  FlushRecords();
+  fclose(gFile);
+  gFile = nullptr;
+  printf("[capture] %s: %llu frames, %llu records, %.1f KiB\n", gPath,
+         static_cast<unsigned long long>(gFrames),
+         static_cast<unsigned long long>(gRecords), gBytes / 1024.0);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include <dawn/dawn_proc_table.h>
+#include <dawn/webgpu.h>
+
+// Records the WebGPU calls the app makes to a file that replay.cpp can run
+// again without the app (native builds only; --capture=PATH). It sits between
+// the app and whatever proc table is active, Dawn's or the mock's: every
+// captured proc forwards to the real one and appends a record of the call
+// (creation descriptors, encoder commands, buffer uploads, submits and
+// reference counting) to a buffer owned by the calling thread. Records carry
+// a global sequence number, and CaptureWebGPUFrame() merges the threads'
+// buffers back into call order and writes them out, so recording costs the
+// render threads no lock beyond the one guarding the handle-to-id map.
+//
+// Limitations:
+// - Only the procs the demo calls are captured. Calls through the others are
+//   forwarded but not recorded, and objects they return show up in the
+//   capture as kCaptureUnknownId.
+// - Buffer mapping isn't recorded: contents written through a mapped range
+//   are missing from the replay (the demo only maps in its copy tests).
+// - The swap chain is recorded by its descriptor; replay renders into an
+//   offscreen texture of the same size and format instead.
+
+// Opens |path| and returns in |captureProcs| a copy of |procs| whose captured
+// entries record before (or after, for creation) forwarding to |procs|.
+// |device| is the app's device, created outside the proc table. Returns false
+// if the file can't be opened.
+bool CaptureWebGPUBegin(const char* path,
+                        const DawnProcTable& procs,
+                        WGPUDevice device,
+                        DawnProcTable* captureProcs);
+
+// Marks the start of a frame with the app's per-frame inputs, and writes out
+// everything recorded since the last call. No other thread may be making
+// WebGPU calls.
+void CaptureWebGPUFrame(uint32_t frameTime,
+                        float focusX,
+                        float focusY,
+                        float cullRadius);
+
+// Writes out the remaining records and closes the file. Calls made after
+// this are still forwarded, but not recorded.
+void CaptureWebGPUEnd();
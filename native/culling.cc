@@ -0,0 +1,353 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mat4.h"
+#include "simd4.h"
+
+GridBounds ComputeGridBounds(const float* x, const float* y, size_t count) {
+  GridBounds bounds{INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = 0; i < count; i++) {
+    bounds.minX = std::fmin(bounds.minX, x[i]);
+    bounds.minY = std::fmin(bounds.minY, y[i]);
+    bounds.maxX = std::fmax(bounds.maxX, x[i]);
+    bounds.maxY = std::fmax(bounds.maxY, y[i]);
+  }
+  return bounds;
+}
+
+Aabb ComputeSphereBounds(const SphereArrays& spheres,
+                         size_t begin,
+                         size_t end) {
+  Aabb bounds{INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = begin; i < end; i++) {
+    float r = spheres.radius[i];
+    bounds.minX = std::fmin(bounds.minX, spheres.x[i] - r);
+    bounds.minY = std::fmin(bounds.minY, spheres.y[i] - r);
+    bounds.minZ = std::fmin(bounds.minZ, spheres.z[i] - r);
+    bounds.maxX = std::fmax(bounds.maxX, spheres.x[i] + r);
+    bounds.maxY = std::fmax(bounds.maxY, spheres.y[i] + r);
+    bounds.maxZ = std::fmax(bounds.maxZ, spheres.z[i] + r);
+  }
+  return bounds;
+}
+
+// static
+Frustum Frustum::FromViewProjection(const Mat4& m) {
+  // Gribb/Hartmann: with clip = M * p, each plane is a sum or difference of
+  // rows of M. Depth is 0 <= z <= w, so the near plane is row 2 alone.
+  // Returns row 3 + sign * row r.
+  auto combine = [&m](size_t r, float sign) {
+    return Plane{m.At(0, 3) + sign * m.At(0, r), m.At(1, 3) + sign * m.At(1, r),
+                 m.At(2, 3) + sign * m.At(2, r), m.At(3, 3) + sign * m.At(3, r)};
+  };
+  Frustum frustum;
+  frustum.planes[kLeft] = combine(0, 1.0f);
+  frustum.planes[kRight] = combine(0, -1.0f);
+  frustum.planes[kBottom] = combine(1, 1.0f);
+  frustum.planes[kTop] = combine(1, -1.0f);
+  frustum.planes[kNear] = {m.At(0, 2), m.At(1, 2), m.At(2, 2), m.At(3, 2)};
+  frustum.planes[kFar] = combine(2, -1.0f);
+
+  for (Plane& plane : frustum.planes) {
+    float length = std::sqrt(plane.nx * plane.nx + plane.ny * plane.ny +
+                             plane.nz * plane.nz);
+    plane.nx /= length;
+    plane.ny /= length;
+    plane.nz /= length;
+    plane.d /= length;
+  }
+  return frustum;
+}
+
+Containment ClassifyDiamond(const DiamondRegion& region,
+                            const GridBounds& bounds) {
+  // The L1 distance to the nearest point of the box decides "outside"; the
+  // diamond is convex, so the box is inside if its farthest corner is.
+  float nearX = std::fmax(0.0f, std::fmax(bounds.minX - region.focusX,
+                                          region.focusX - bounds.maxX));
+  float nearY = std::fmax(0.0f, std::fmax(bounds.minY - region.focusY,
+                                          region.focusY - bounds.maxY));
+  if (nearX + nearY >= region.radius) {
+    return Containment::Outside;
+  }
+
+  float farX = std::fmax(std::fabs(bounds.minX - region.focusX),
+                         std::fabs(bounds.maxX - region.focusX));
+  float farY = std::fmax(std::fabs(bounds.minY - region.focusY),
+                         std::fabs(bounds.maxY - region.focusY));
+  if (farX + farY < region.radius) {
+    return Containment::Inside;
+  }
+  return Containment::Intersecting;
+}
+
+Containment ClassifyFrustum(const Frustum& frustum, const Aabb& bounds) {
+  Containment result = Containment::Inside;
+  for (const Plane& plane : frustum.planes) {
+    // Distances of the corners farthest along and against the normal.
+    float farthest = plane.d, nearest = plane.d;
+    auto axis = [&](float n, float lo, float hi) {
+      farthest += n * (n >= 0 ? hi : lo);
+      nearest += n * (n >= 0 ? lo : hi);
+    };
+    axis(plane.nx, bounds.minX, bounds.maxX);
+    axis(plane.ny, bounds.minY, bounds.maxY);
+    axis(plane.nz, bounds.minZ, bounds.maxZ);
+    if (farthest < 0) {
+      return Containment::Outside;
+    }
+    if (nearest < 0) {
+      result = Containment::Intersecting;
+    }
+  }
+  return result;
+}
+
+size_t CullDiamondScalar(const DiamondRegion& region,
+                         const float* x,
+                         const float* y,
+                         uint32_t firstId,
+                         size_t count,
+                         uint32_t* visibleIds) {
+  size_t visible = 0;
+  for (size_t i = 0; i < count; i++) {
+    float distance =
+        std::fabs(x[i] - region.focusX) + std::fabs(y[i] - region.focusY);
+    if (distance < region.radius) {
+      visibleIds[visible++] = firstId + static_cast<uint32_t>(i);
+    }
+  }
+  return visible;
+}
+
+size_t CullDiamond(const DiamondRegion& region,
+                   const float* x,
+                   const float* y,
+                   uint32_t firstId,
+                   size_t count,
+                   uint32_t* visibleIds) {
+#if HAVE_SIMD4
+  const F4 focusX = F4Splat(region.focusX);
+  const F4 focusY = F4Splat(region.focusY);
+  const F4 radius = F4Splat(region.radius);
+
+  size_t visible = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    F4 dx = F4Abs(F4Sub(F4Load(x + i), focusX));
+    F4 dy = F4Abs(F4Sub(F4Load(y + i), focusY));
+    unsigned mask = F4LessMask(F4Add(dx, dy), radius);
+    // Compact the set lanes; most 4-wide groups are all-in or all-out.
+    while (mask) {
+      uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+      visibleIds[visible++] = firstId + static_cast<uint32_t>(i) + lane;
+      mask &= mask - 1;
+    }
+  }
+  return visible + CullDiamondScalar(region, x + i, y + i,
+                                     firstId + static_cast<uint32_t>(i),
+                                     count - i, visibleIds + visible);
+#else
+  return CullDiamondScalar(region, x, y, firstId, count, visibleIds);
+#endif
+}
+
+size_t CullSpheresScalar(const Frustum& frustum,
+                         const SphereArrays& spheres,
+                         uint32_t firstId,
+                         size_t count,
+                         uint32_t* visibleIds) {
+  size_t visible = 0;
+  for (size_t i = 0; i < count; i++) {
+    bool inside = true;
+    for (const Plane& plane : frustum.planes) {
+      float distance = plane.nx * spheres.x[i] + plane.ny * spheres.y[i] +
+                       plane.nz * spheres.z[i] + plane.d;
+      inside &= distance >= -spheres.radius[i];
+    }
+    if (inside) {
+      visibleIds[visible++] = firstId + static_cast<uint32_t>(i);
+    }
+  }
+  return visible;
+}
+
+size_t CullSpheres(const Frustum& frustum,
+                   const SphereArrays& spheres,
+                   uint32_t firstId,
+                   size_t count,
+                   uint32_t* visibleIds) {
+#if HAVE_SIMD4
+  F4 nx[Frustum::kPlaneCount], ny[Frustum::kPlaneCount],
+      nz[Frustum::kPlaneCount], d[Frustum::kPlaneCount];
+  for (int p = 0; p < Frustum::kPlaneCount; p++) {
+    nx[p] = F4Splat(frustum.planes[p].nx);
+    ny[p] = F4Splat(frustum.planes[p].ny);
+    nz[p] = F4Splat(frustum.planes[p].nz);
+    d[p] = F4Splat(frustum.planes[p].d);
+  }
+  const F4 zero = F4Splat(0.0f);
+
+  size_t visible = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    F4 x = F4Load(spheres.x + i);
+    F4 y = F4Load(spheres.y + i);
+    F4 z = F4Load(spheres.z + i);
+    F4 negRadius = F4Sub(zero, F4Load(spheres.radius + i));
+    unsigned outside = 0;
+    for (int p = 0; p < Frustum::kPlaneCount; p++) {
+      F4 distance = F4Add(
+          F4Add(F4Mul(nx[p], x), F4Mul(ny[p], y)),
+          F4Add(F4Mul(nz[p], z), d[p]));
+      outside |= F4LessMask(distance, negRadius);
+    }
+    unsigned mask = ~outside & 0xf;
+    while (mask) {
+      uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+      visibleIds[visible++] = firstId + static_cast<uint32_t>(i) + lane;
+      mask &= mask - 1;
+    }
+  }
+  SphereArrays rest{spheres.x + i, spheres.y + i, spheres.z + i,
+                    spheres.radius + i};
+  return visible +
+         CullSpheresScalar(frustum, rest, firstId + static_cast<uint32_t>(i),
+                           count - i, visibleIds + visible);
+#else
+  return CullSpheresScalar(frustum, spheres, firstId, count, visibleIds);
+#endif
+}
+
+Containment DiamondCullRegion::Classify(const GridBounds& centers,
+                                        const Aabb& /*bounds*/) const {
+  return ClassifyDiamond(region_, centers);
+}
+
+size_t DiamondCullRegion::CullRange(uint32_t begin,
+                                    uint32_t end,
+                                    uint32_t* visibleIds) const {
+  return CullDiamond(region_, spheres_.x + begin, spheres_.y + begin, begin,
+                     end - begin, visibleIds);
+}
+
+Containment FrustumCullRegion::Classify(const GridBounds& /*centers*/,
+                                        const Aabb& bounds) const {
+  return ClassifyFrustum(frustum_, bounds);
+}
+
+size_t FrustumCullRegion::CullRange(uint32_t begin,
+                                    uint32_t end,
+                                    uint32_t* visibleIds) const {
+  SphereArrays range{spheres_.x + begin, spheres_.y + begin,
+                     spheres_.z + begin, spheres_.radius + begin};
+  return CullSpheres(frustum_, range, begin, end - begin, visibleIds);
+}
+
+void TileHierarchy::Build(const SphereArrays& spheres,
+                          uint32_t count,
+                          uint32_t leafSize,
+                          uint32_t branching) {
+  branching_ = branching;
+  levels_.clear();
+
+  std::vector<Tile> leaves;
+  for (uint32_t begin = 0; begin < count; begin += leafSize) {
+    uint32_t end = std::min(begin + leafSize, count);
+    leaves.push_back(
+        {begin, end,
+         ComputeGridBounds(spheres.x + begin, spheres.y + begin, end - begin),
+         ComputeSphereBounds(spheres, begin, end)});
+  }
+  levels_.push_back(std::move(leaves));
+
+  while (levels_.back().size() > 1) {
+    const std::vector<Tile>& children = levels_.back();
+    std::vector<Tile> parents;
+    for (size_t first = 0; first < children.size(); first += branching) {
+      size_t last = std::min(first + branching, children.size());
+      Tile parent = children[first];
+      for (size_t i = first + 1; i < last; i++) {
+        const Tile& child = children[i];
+        parent.end = child.end;
+        parent.centers.minX = std::fmin(parent.centers.minX, child.centers.minX);
+        parent.centers.minY = std::fmin(parent.centers.minY, child.centers.minY);
+        parent.centers.maxX = std::fmax(parent.centers.maxX, child.centers.maxX);
+        parent.centers.maxY = std::fmax(parent.centers.maxY, child.centers.maxY);
+        parent.bounds.minX = std::fmin(parent.bounds.minX, child.bounds.minX);
+        parent.bounds.minY = std::fmin(parent.bounds.minY, child.bounds.minY);
+        parent.bounds.minZ = std::fmin(parent.bounds.minZ, child.bounds.minZ);
+        parent.bounds.maxX = std::fmax(parent.bounds.maxX, child.bounds.maxX);
+        parent.bounds.maxY = std::fmax(parent.bounds.maxY, child.bounds.maxY);
+        parent.bounds.maxZ = std::fmax(parent.bounds.maxZ, child.bounds.maxZ);
+      }
+      parents.push_back(parent);
+    }
+    levels_.push_back(std::move(parents));
+  }
+}
+
+size_t TileHierarchy::Cull(const CullRegion& region,
+                           uint32_t firstSlot,
+                           uint32_t count,
+                           uint32_t* visibleIds,
+                           Stats* stats) const {
+  size_t visible = 0;
+  if (levels_.empty()) {
+    return visible;
+  }
+  size_t top = levels_.size() - 1;
+  for (size_t i = 0; i < levels_[top].size(); i++) {
+    CullTile(top, i, region, firstSlot, firstSlot + count, visibleIds, &visible,
+             stats);
+  }
+  return visible;
+}
+
+void TileHierarchy::CullTile(size_t level,
+                             size_t index,
+                             const CullRegion& region,
+                             uint32_t queryBegin,
+                             uint32_t queryEnd,
+                             uint32_t* visibleIds,
+                             size_t* visible,
+                             Stats* stats) const {
+  const Tile& tile = levels_[level][index];
+  uint32_t begin = std::max(tile.begin, queryBegin);
+  uint32_t end = std::min(tile.end, queryEnd);
+  if (begin >= end) {
+    return;
+  }
+  if (stats) {
+    stats->tilesVisited++;
+  }
+
+  switch (region.Classify(tile.centers, tile.bounds)) {
+    case Containment::Outside:
+      return;
+    case Containment::Inside:
+      for (uint32_t slot = begin; slot < end; slot++) {
+        visibleIds[(*visible)++] = slot;
+      }
+      return;
+    case Containment::Intersecting:
+      break;
+  }
+
+  if (level == 0) {
+    if (stats) {
+      stats->objectsTested += end - begin;
+    }
+    *visible += region.CullRange(begin, end, visibleIds + *visible);
+    return;
+  }
+
+  size_t firstChild = index * branching_;
+  size_t lastChild = std::min(firstChild + branching_, levels_[level - 1].size());
+  for (size_t child = firstChild; child < lastChild; child++) {
+    CullTile(level - 1, child, region, queryBegin, queryEnd, visibleIds, visible,
+             stats);
+  }
+}
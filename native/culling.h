@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Mat4;
+
+// Visibility region used by the demo: a diamond (L1 ball) of |radius| around
+// the focus point, in object grid units.
+struct DiamondRegion {
+  float focusX;
+  float focusY;
+  float radius;
+};
+
+// Axis-aligned bounds of a set of object grid positions (inclusive).
+struct GridBounds {
+  float minX;
+  float minY;
+  float maxX;
+  float maxY;
+};
+
+GridBounds ComputeGridBounds(const float* x, const float* y, size_t count);
+
+// World-space axis-aligned box.
+struct Aabb {
+  float minX;
+  float minY;
+  float minZ;
+  float maxX;
+  float maxY;
+  float maxZ;
+};
+
+// Per-object bounding spheres as structure-of-arrays streams, all indexed the
+// same way (by slot in main.cpp). The demo's grid units are its world units, so
+// x/y double as the grid positions tested by the diamond region.
+struct SphereArrays {
+  const float* x;
+  const float* y;
+  const float* z;
+  const float* radius;
+};
+
+Aabb ComputeSphereBounds(const SphereArrays& spheres,
+                         size_t begin,
+                         size_t end);
+
+// Plane with unit normal: points p with Dot(normal, p) + d >= 0 are inside.
+struct Plane {
+  float nx;
+  float ny;
+  float nz;
+  float d;
+};
+
+// The six clip planes of a view-projection matrix using WebGPU's [0, 1] clip
+// depth, in world space.
+struct Frustum {
+  enum { kLeft, kRight, kBottom, kTop, kNear, kFar, kPlaneCount };
+
+  static Frustum FromViewProjection(const Mat4& viewProjection);
+
+  Plane planes[kPlaneCount];
+};
+
+enum class Containment { Outside, Inside, Intersecting };
+
+// Whether every object within |bounds| is outside, inside, or possibly either
+// side of |region|, so callers can skip or accept whole groups of objects.
+Containment ClassifyDiamond(const DiamondRegion& region,
+                            const GridBounds& bounds);
+
+// Same for a box against a frustum. Conservative: boxes near a frustum corner
+// can be reported as Intersecting although they are outside.
+Containment ClassifyFrustum(const Frustum& frustum, const Aabb& bounds);
+
+// Tests objects [firstId, firstId + count), whose grid positions are x[i] and
+// y[i] (i relative to firstId), against |region| and appends the ids of the
+// visible ones to |visibleIds|. Returns the number appended.
+//
+// Uses 4-wide SIMD when the target has it (SSE2, or wasm with -msimd128),
+// otherwise the scalar loop below.
+size_t CullDiamond(const DiamondRegion& region,
+                   const float* x,
+                   const float* y,
+                   uint32_t firstId,
+                   size_t count,
+                   uint32_t* visibleIds);
+
+// Always-scalar version of CullDiamond(), kept as a reference for benchmarks.
+size_t CullDiamondScalar(const DiamondRegion& region,
+                         const float* x,
+                         const float* y,
+                         uint32_t firstId,
+                         size_t count,
+                         uint32_t* visibleIds);
+
+// Frustum counterpart of CullDiamond(): an object is visible unless its sphere
+// lies entirely behind one of the planes. |spheres| is indexed relative to
+// firstId, as x/y are above.
+size_t CullSpheres(const Frustum& frustum,
+                   const SphereArrays& spheres,
+                   uint32_t firstId,
+                   size_t count,
+                   uint32_t* visibleIds);
+
+size_t CullSpheresScalar(const Frustum& frustum,
+                         const SphereArrays& spheres,
+                         uint32_t firstId,
+                         size_t count,
+                         uint32_t* visibleIds);
+
+// A visibility query TileHierarchy can run: classifies tiles and tests the
+// objects of the tiles it can't decide on. Object streams are indexed by slot.
+class CullRegion {
+ public:
+  virtual ~CullRegion() = default;
+
+  virtual Containment Classify(const GridBounds& centers,
+                               const Aabb& bounds) const = 0;
+  // Appends the visible slots of [begin, end) to |visibleIds|.
+  virtual size_t CullRange(uint32_t begin,
+                           uint32_t end,
+                           uint32_t* visibleIds) const = 0;
+};
+
+class DiamondCullRegion : public CullRegion {
+ public:
+  DiamondCullRegion(const DiamondRegion& region, const SphereArrays& spheres)
+      : region_(region), spheres_(spheres) {}
+
+  Containment Classify(const GridBounds& centers,
+                       const Aabb& bounds) const override;
+  size_t CullRange(uint32_t begin,
+                   uint32_t end,
+                   uint32_t* visibleIds) const override;
+
+ private:
+  DiamondRegion region_;
+  SphereArrays spheres_;
+};
+
+class FrustumCullRegion : public CullRegion {
+ public:
+  FrustumCullRegion(const Frustum& frustum, const SphereArrays& spheres)
+      : frustum_(frustum), spheres_(spheres) {}
+
+  Containment Classify(const GridBounds& centers,
+                       const Aabb& bounds) const override;
+  size_t CullRange(uint32_t begin,
+                   uint32_t end,
+                   uint32_t* visibleIds) const override;
+
+ private:
+  Frustum frustum_;
+  SphereArrays spheres_;
+};
+
+// Hierarchy of tiles over contiguous slot ranges with per-tile bounds. Leaves
+// cover |leafSize| slots and each parent covers |branching| tiles of the level
+// below; with a Morton slot layout every tile is a compact block of the grid.
+//
+// Cull() accepts or rejects whole tiles against the region and only tests
+// individual objects in leaves that straddle its boundary, so its cost follows
+// the visible area (and its perimeter) rather than the total object count.
+class TileHierarchy {
+ public:
+  struct Stats {
+    size_t tilesVisited = 0;
+    size_t objectsTested = 0;
+  };
+
+  void Build(const SphereArrays& spheres,
+             uint32_t count,
+             uint32_t leafSize = 16,
+             uint32_t branching = 4);
+
+  // Same contract as CullDiamond() for slots [firstSlot, firstSlot + count),
+  // which need not be tile aligned.
+  size_t Cull(const CullRegion& region,
+              uint32_t firstSlot,
+              uint32_t count,
+              uint32_t* visibleIds,
+              Stats* stats = nullptr) const;
+
+  size_t LevelCount() const { return levels_.size(); }
+
+ private:
+  struct Tile {
+    uint32_t begin;
+    uint32_t end;
+    // Bounds of the object centers, for the diamond test, and of the whole
+    // spheres.
+    GridBounds centers;
+    Aabb bounds;
+  };
+
+  void CullTile(size_t level,
+                size_t index,
+                const CullRegion& region,
+                uint32_t queryBegin,
+                uint32_t queryEnd,
+                uint32_t* visibleIds,
+                size_t* visible,
+                Stats* stats) const;
+
+  uint32_t branching_ = 4;
+  // levels_[0] are the leaves, levels_.back() the roots.
+  std::vector<std::vector<Tile>> levels_;
+};
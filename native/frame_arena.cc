@@ -0,0 +1,48 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+
+namespace {
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+FrameArena::FrameArena(size_t capacity) : capacity_(capacity) {
+  if (capacity_ > 0) {
+    block_.reset(new uint8_t[capacity_]);
+  }
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+  // Aligns the address rather than the offset; new[] only guarantees
+  // alignof(std::max_align_t).
+  uintptr_t base = reinterpret_cast<uintptr_t>(block_.get());
+  size_t offset = AlignUp(base + used_, alignment) - base;
+  if (block_ && offset + size <= capacity_) {
+    used_ = offset + size;
+    return block_.get() + offset;
+  }
+  return AllocateOverflow(size, alignment);
+}
+
+void* FrameArena::AllocateOverflow(size_t size, size_t alignment) {
+  overflow_.emplace_back(new uint8_t[size + alignment]);
+  overflowUsed_ += size + alignment;
+  uintptr_t address = reinterpret_cast<uintptr_t>(overflow_.back().get());
+  return reinterpret_cast<void*>(AlignUp(address, alignment));
+}
+
+void FrameArena::Reset() {
+  highWater_ = std::max(highWater_, Used());
+  if (!overflow_.empty()) {
+    // Grow to what this frame needed (plus headroom) so the next one fits.
+    overflow_.clear();
+    capacity_ = AlignUp(highWater_ + highWater_ / 2, 4096);
+    block_.reset(new uint8_t[capacity_]);
+  }
+  used_ = 0;
+  overflowUsed_ = 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator for per-frame scratch data owned by one thread. Everything
+// allocated during a frame is released at once by Reset() at the end of it.
+//
+// If a frame needs more than the capacity, the excess comes from extra heap
+// blocks and the next Reset() replaces everything with a single block large
+// enough for that frame, so steady-state frames never touch the heap.
+class FrameArena {
+ public:
+  explicit FrameArena(size_t capacity = 0);
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  void* Allocate(size_t size, size_t alignment);
+  void Reset();
+
+  size_t Capacity() const { return capacity_; }
+  // Bytes handed out since the last Reset(), including alignment padding.
+  size_t Used() const { return used_ + overflowUsed_; }
+  // Largest Used() seen at a Reset().
+  size_t HighWater() const { return highWater_; }
+
+ private:
+  void* AllocateOverflow(size_t size, size_t alignment);
+
+  std::unique_ptr<uint8_t[]> block_;
+  size_t capacity_ = 0;
+  size_t used_ = 0;
+  size_t highWater_ = 0;
+
+  std::vector<std::unique_ptr<uint8_t[]>> overflow_;
+  size_t overflowUsed_ = 0;
+};
+
+// Standard allocator interface over a FrameArena, for containers that live no
+// longer than the frame. deallocate() is a no-op; memory comes back on Reset().
+template <typename T>
+class FrameAllocator {
+ public:
+  using value_type = T;
+
+  explicit FrameAllocator(FrameArena* arena) : arena_(arena) {}
+  template <typename U>
+  FrameAllocator(const FrameAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  FrameArena* arena() const { return arena_; }
+
+ private:
+  FrameArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return !(a == b);
+}
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
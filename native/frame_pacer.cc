@@ -0,0 +1,92 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+double ToMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+FramePacer::FramePacer(double targetHz, double spinMs)
+    : targetHz_(targetHz),
+      period_(targetHz > 0
+                  ? std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(1.0 / targetHz))
+                  : Clock::duration::zero()),
+      spin_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(spinMs))) {}
+
+void FramePacer::Wait() {
+  if (!Enabled()) {
+    return;
+  }
+  Clock::time_point now = Clock::now();
+  pending_ = true;
+  if (!started_) {
+    started_ = true;
+    next_ = now;
+    start_ = now;
+    startLateMs_ = 0;
+    return;
+  }
+
+  next_ += period_;
+  if (now > next_ + period_) {
+    // Measured before resyncing, which would make the start look on time.
+    startLateMs_ = ToMs(now - next_);
+    resyncs_++;
+    next_ = now;
+    start_ = now;
+    return;
+  }
+  if (now < next_ - spin_) {
+    std::this_thread::sleep_until(next_ - spin_);
+  }
+  while (Clock::now() < next_) {
+  }
+  start_ = Clock::now();
+  startLateMs_ = ToMs(start_ - next_);
+}
+
+void FramePacer::FrameBegan() {
+  if (!pending_) {
+    return;
+  }
+  pending_ = false;
+  if (!begun_) {
+    begun_ = true;
+    lastStart_ = start_;
+    return;
+  }
+  lateness_.Record(startLateMs_);
+  double interval = ToMs(start_ - lastStart_);
+  interval_.Record(interval);
+  intervalSum_ += interval;
+  intervalSquareSum_ += interval * interval;
+  lastStart_ = start_;
+}
+
+void FramePacer::Print(const char* prefix) const {
+  if (!Enabled() || interval_.Count() == 0) {
+    return;
+  }
+  LatencyHistogram::Summary interval = interval_.Summarize();
+  LatencyHistogram::Summary late = lateness_.Summarize();
+  double mean = intervalSum_ / interval.count;
+  double variance =
+      std::max(0.0, intervalSquareSum_ / interval.count - mean * mean);
+  printf("%s target %.1f Hz (%.3f ms): interval mean %.3f  stdev %.3f  "
+         "min %.3f  p99 %.3f  max %.3f ms\n",
+         prefix, targetHz_, ToMs(period_), mean, std::sqrt(variance),
+         interval.min, interval.p99, interval.max);
+  printf("%s started late by p50 %.3f  p99 %.3f  max %.3f ms, %llu resyncs "
+         "over %llu frames\n",
+         prefix, late.p50, late.p99, late.max, (unsigned long long)resyncs_,
+         (unsigned long long)interval.count);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "frame_stats.h"
+
+// Paces the render loop to a target frame rate, independently of the present
+// mode. Wait() holds each frame back until its scheduled start: it sleeps
+// until |spinMs| before the start, since sleeps can overshoot by about a
+// scheduler tick, and spins for the rest. The schedule advances by one period
+// per frame. A frame that starts more than a whole period late resyncs the
+// schedule to now rather than bunching the following frames up to catch up.
+//
+// Jitter is reported two ways: how late each frame started against its
+// schedule, and the spread of the intervals between frame starts. Both only
+// count frames the caller goes on to begin (see FrameBegan()), so a frame the
+// frames-in-flight throttle drops isn't reported as paced.
+class FramePacer {
+ public:
+  // |targetHz| 0 turns pacing off: Wait() returns at once and nothing is
+  // recorded.
+  explicit FramePacer(double targetHz, double spinMs = 1.0);
+
+  bool Enabled() const { return period_.count() > 0; }
+  void Wait();
+  // Records the start the last Wait() released; call it once the frame
+  // actually begins.
+  void FrameBegan();
+
+  // "<prefix> target N Hz: interval ..., late ..., N resyncs".
+  void Print(const char* prefix) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  double targetHz_;
+  Clock::duration period_;
+  Clock::duration spin_;
+
+  bool started_ = false;
+  Clock::time_point next_;
+
+  // Left by Wait() for FrameBegan().
+  bool pending_ = false;
+  Clock::time_point start_;
+  double startLateMs_ = 0;
+
+  bool begun_ = false;
+  Clock::time_point lastStart_;
+
+  LatencyHistogram lateness_;
+  LatencyHistogram interval_;
+  double intervalSum_ = 0;
+  double intervalSquareSum_ = 0;
+  uint64_t resyncs_ = 0;
+};
@@ -0,0 +1,159 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+int HighestBit(uint64_t value) {
+  int bit = 0;
+  while (value >>= 1) {
+    bit++;
+  }
+  return bit;
+}
+
+}  // namespace
+
+void LatencyHistogram::Record(double ms) {
+  double us = std::max(0.0, ms * 1000.0);
+  counts_[BucketOf(static_cast<uint64_t>(std::llround(us)))]++;
+  if (count_ == 0 || ms < min_) {
+    min_ = ms;
+  }
+  if (count_ == 0 || ms > max_) {
+    max_ = ms;
+  }
+  count_++;
+}
+
+void LatencyHistogram::Reset() {
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+// Values below 2 * kSubBuckets us get a bucket each. Above that, |us| is
+// split into an exponent and a kSubBucketBits + 1 bit mantissa whose top bit
+// is always set; the remaining bits pick one of kSubBuckets buckets.
+size_t LatencyHistogram::BucketOf(uint64_t us) {
+  if (us < static_cast<uint64_t>(2 * kSubBuckets)) {
+    return static_cast<size_t>(us);
+  }
+  int exponent = HighestBit(us) - kSubBucketBits;
+  if (exponent + 1 >= kOctaves) {
+    return kBucketCount - 1;
+  }
+  uint64_t mantissa = us >> exponent;
+  return static_cast<size_t>((exponent + 1) * kSubBuckets +
+                             (mantissa - kSubBuckets));
+}
+
+double LatencyHistogram::BucketValue(size_t bucket) {
+  if (bucket < static_cast<size_t>(2 * kSubBuckets)) {
+    return bucket / 1000.0;
+  }
+  int exponent = static_cast<int>(bucket / kSubBuckets) - 1;
+  uint64_t mantissa = bucket % kSubBuckets + kSubBuckets;
+  double low = static_cast<double>(mantissa << exponent);
+  double width = static_cast<double>(uint64_t(1) << exponent);
+  return (low + (width - 1) / 2) / 1000.0;
+}
+
+double LatencyHistogram::Percentile(double fraction) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  fraction = std::min(1.0, std::max(0.0, fraction));
+  uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * count_));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::min(max_, std::max(min_, BucketValue(i)));
+    }
+  }
+  return max_;
+}
+
+LatencyHistogram::Summary LatencyHistogram::Summarize() const {
+  Summary summary;
+  summary.count = count_;
+  summary.min = min_;
+  summary.p50 = Percentile(0.5);
+  summary.p90 = Percentile(0.9);
+  summary.p99 = Percentile(0.99);
+  summary.max = max_;
+  return summary;
+}
+
+const char* FrameStats::MetricName(Metric metric) {
+  switch (metric) {
+    case kFrame:
+      return "frame";
+    case kEncode:
+      return "encode";
+    case kDone:
+      return "done";
+    default:
+      return "?";
+  }
+}
+
+void FrameStats::Reset() {
+  for (LatencyHistogram& histogram : histograms_) {
+    histogram.Reset();
+  }
+}
+
+void FrameStats::Print(const char* prefix) const {
+  for (int i = 0; i < kMetricCount; i++) {
+    LatencyHistogram::Summary s = histograms_[i].Summarize();
+    if (s.count == 0) {
+      continue;
+    }
+    printf("%s %-6s min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f ms "
+           "(%llu samples)\n",
+           prefix, MetricName(static_cast<Metric>(i)), s.min, s.p50, s.p90,
+           s.p99, s.max, static_cast<unsigned long long>(s.count));
+  }
+}
+
+void FrameStats::PrintJson() const {
+  printf("{");
+  for (int i = 0; i < kMetricCount; i++) {
+    LatencyHistogram::Summary s = histograms_[i].Summarize();
+    printf("%s\"%s\":{\"count\":%llu,\"min\":%.4f,\"p50\":%.4f,\"p90\":%.4f,"
+           "\"p99\":%.4f,\"max\":%.4f}",
+           i ? "," : "", MetricName(static_cast<Metric>(i)),
+           static_cast<unsigned long long>(s.count), s.min, s.p50, s.p90, s.p99,
+           s.max);
+  }
+  printf("}");
+}
+
+void FrameStats::FormatTitle(char* buffer, size_t size) const {
+  if (size == 0) {
+    return;
+  }
+  buffer[0] = '\0';
+  size_t used = 0;
+  for (int i = 0; i < kMetricCount && used < size; i++) {
+    const LatencyHistogram& histogram = histograms_[i];
+    if (histogram.Count() == 0) {
+      continue;
+    }
+    int written = snprintf(buffer + used, size - used, "%s%s %.2f/%.2f ms",
+                           used ? "  " : "", MetricName(static_cast<Metric>(i)),
+                           histogram.Percentile(0.5),
+                           histogram.Percentile(0.99));
+    if (written < 0) {
+      break;
+    }
+    used += static_cast<size_t>(written);
+  }
+}
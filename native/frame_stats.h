@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size log-linear histogram of durations in milliseconds. Samples are
+// kept at microsecond resolution in 32 buckets per power of two, so Record()
+// is O(1), never allocates, and percentiles are within ~3% of the exact value
+// (exact below 64 us). Min and max are tracked exactly.
+class LatencyHistogram {
+ public:
+  struct Summary {
+    uint64_t count = 0;
+    double min = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+  };
+
+  LatencyHistogram() { Reset(); }
+
+  void Record(double ms);
+  void Reset();
+
+  uint64_t Count() const { return count_; }
+  // Value that |fraction| (in [0, 1]) of the samples are at or below: the
+  // midpoint of its bucket, clamped to [min, max]. 0 if nothing was recorded.
+  double Percentile(double fraction) const;
+  Summary Summarize() const;
+
+ private:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  // Covers up to 2^31 us (about 35 minutes); longer samples land in the last
+  // bucket.
+  static constexpr int kOctaves = 27;
+  static constexpr int kBucketCount = kSubBuckets * kOctaves;
+
+  static size_t BucketOf(uint64_t us);
+  // Midpoint of |bucket|, in milliseconds.
+  static double BucketValue(size_t bucket);
+
+  uint64_t counts_[kBucketCount];
+  uint64_t count_;
+  double min_;
+  double max_;
+};
+
+// Timings of the render loop, one sample per frame for each metric:
+//   frame   wall time between the starts of consecutive frames
+//   encode  CPU time from the start of a frame until its commands are
+//           submitted (update, cull, encode and pass assembly)
+//   done    submit until the app observes the Queue::OnSubmittedWorkDone
+//           callback. Not GPU time: on native the callback is only delivered
+//           by the next device.Tick(), normally at the start of the next
+//           frame, so this includes presenting, pacing and throttling.
+// Not thread safe; the demo records everything on the main thread.
+class FrameStats {
+ public:
+  enum Metric { kFrame, kEncode, kDone, kMetricCount };
+
+  static const char* MetricName(Metric metric);
+
+  void Record(Metric metric, double ms) { histograms_[metric].Record(ms); }
+  void Reset();
+
+  const LatencyHistogram& Histogram(Metric metric) const {
+    return histograms_[metric];
+  }
+
+  // One line per metric: "<prefix> <metric>: min .. p50 .. p90 .. p99 ..
+  // max .. ms (N samples)".
+  void Print(const char* prefix) const;
+  // The same as one JSON object, without a trailing newline:
+  // {"frame":{"count":N,"min":..,"p50":..,"p90":..,"p99":..,"max":..},...}
+  void PrintJson() const;
+  // Compact one-line form ("frame 16.7/17.2 ms encode ..", p50/p99) for the
+  // window title. Writes nothing if no frames were recorded.
+  void FormatTitle(char* buffer, size_t size) const;
+
+ private:
+  LatencyHistogram histograms_[kMetricCount];
+};
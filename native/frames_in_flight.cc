@@ -0,0 +1,60 @@
+#include "frames_in_flight.h"
+
+#include <cassert>
+#include <cstdio>
+
+FramesInFlight::FramesInFlight(uint32_t maxFrames, Policy policy)
+    : maxFrames_(maxFrames),
+      policy_(policy),
+      submitMs_(maxFrames, 0.0),
+      depthCounts_(maxFrames, 0) {
+  assert(maxFrames > 0);
+}
+
+uint32_t FramesInFlight::Begin(uint32_t frame) {
+  assert(CanBegin());
+  depthCounts_[InFlight()]++;
+  return Slot(frame);
+}
+
+void FramesInFlight::Submitted(uint32_t frame, double nowMs) {
+  submitMs_[Slot(frame)] = nowMs;
+  submitted_++;
+}
+
+double FramesInFlight::Completed(uint32_t frame, double nowMs) {
+  assert(InFlight() > 0);
+  completed_++;
+  double ms = nowMs - submitMs_[Slot(frame)];
+  latency_.Record(ms);
+  return ms;
+}
+
+void FramesInFlight::Print(const char* prefix) const {
+  uint64_t frames = 0;
+  uint64_t depthSum = 0;
+  uint32_t maxDepth = 0;
+  for (uint32_t depth = 0; depth < maxFrames_; depth++) {
+    frames += depthCounts_[depth];
+    depthSum += depthCounts_[depth] * depth;
+    if (depthCounts_[depth] > 0) {
+      maxDepth = depth;
+    }
+  }
+  printf("%s max %u (%s): CPU ahead by %.2f frames on average, at most %u; "
+         "frames begun per depth",
+         prefix, maxFrames_, policy_ == Policy::kBlock ? "block" : "skip",
+         frames ? (double)depthSum / frames : 0.0, maxDepth);
+  for (uint32_t depth = 0; depth < maxFrames_; depth++) {
+    printf(" %u:%llu", depth, (unsigned long long)depthCounts_[depth]);
+  }
+  printf("\n");
+
+  LatencyHistogram::Summary blocked = blocked_.Summarize();
+  LatencyHistogram::Summary latency = latency_.Summarize();
+  printf("%s blocked %llu times (p50 %.3f  p99 %.3f  max %.3f ms), skipped "
+         "%llu frames; submit to done p50 %.3f  p99 %.3f  max %.3f ms\n",
+         prefix, (unsigned long long)blocked.count, blocked.p50, blocked.p99,
+         blocked.max, (unsigned long long)skipped_, latency.p50, latency.p99,
+         latency.max);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "frame_stats.h"
+
+// Bounds how far the CPU runs ahead of the GPU. Every submitted frame is
+// fenced (the app calls Completed() from its Queue::OnSubmittedWorkDone
+// callback), and a frame may only begin while fewer than MaxFrames() are in
+// flight; otherwise the app either blocks until the oldest one completes or
+// skips the frame.
+//
+// Queue work completes in submission order, so with frame numbers counted up
+// by one per begun frame, Slot(frame) = frame % MaxFrames() is free whenever
+// a frame may begin. Per-frame resources indexed by it can be rewritten
+// without racing the GPU.
+//
+// Not thread safe; Begin(), Submitted() and the completion callback all run on
+// the main thread.
+class FramesInFlight {
+ public:
+  enum class Policy { kBlock, kSkip };
+
+  FramesInFlight(uint32_t maxFrames, Policy policy);
+
+  uint32_t MaxFrames() const { return maxFrames_; }
+  Policy GetPolicy() const { return policy_; }
+  uint32_t Slot(uint32_t frame) const { return frame % maxFrames_; }
+
+  // Frames submitted whose work hasn't completed yet.
+  uint32_t InFlight() const { return submitted_ - completed_; }
+  bool CanBegin() const { return InFlight() < maxFrames_; }
+
+  // Starts |frame| (CanBegin() must be true) and records the CPU-ahead
+  // depth, the frames still in flight. Returns its slot.
+  uint32_t Begin(uint32_t frame);
+  void Submitted(uint32_t frame, double nowMs);
+  // Returns the frame's submit-to-completion time, which includes the time it
+  // spent queued behind earlier frames.
+  double Completed(uint32_t frame, double nowMs);
+
+  // Time the main thread blocked before a Begin(), or a frame skipped.
+  void RecordBlocked(double ms) { blocked_.Record(ms); }
+  void RecordSkipped() { skipped_++; }
+
+  // "<prefix> max N (block): depth ..., blocked ..., latency ...".
+  void Print(const char* prefix) const;
+
+ private:
+  const uint32_t maxFrames_;
+  const Policy policy_;
+  uint32_t submitted_ = 0;
+  uint32_t completed_ = 0;
+  // Submit time by slot.
+  std::vector<double> submitMs_;
+
+  // Frames begun at each CPU-ahead depth, 0 to maxFrames_ - 1.
+  std::vector<uint64_t> depthCounts_;
+  LatencyHistogram blocked_;
+  LatencyHistogram latency_;
+  uint64_t skipped_ = 0;
+};
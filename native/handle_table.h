@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "cache_line.h"
+
+// A fixed-capacity table of shared objects addressed by integer handles, for
+// passing wgpu objects (pipelines, bind groups, bundles) between threads
+// without a global mutex. Like the GPUSharedTable prototype in
+// 2-sharedtable/, a thread Register()s an object and hands the handle to
+// another thread, which looks it up.
+//
+// Every operation is lock-free. A handle is a slot index plus the slot's
+// generation: Remove() bumps the generation, so a stale handle fails its
+// lookup instead of reaching whatever object reuses the slot. Lookups pin the
+// slot while they read it, and a removed object is only released once the
+// last pin is gone, so a concurrent Remove() never drops an object out from
+// under a reader.
+//
+// |T| is a reference-counted handle type such as wgpu::RenderPipeline: Get()
+// returns a copy, which adds a reference that stays valid after the object is
+// removed from the table. With() reads the object in place while pinned,
+// without touching its reference count.
+template <typename T>
+class HandleTable {
+ public:
+  using Handle = uint64_t;
+  static constexpr Handle kInvalidHandle = 0;
+
+  explicit HandleTable(uint32_t capacity)
+      : capacity_(capacity), slots_(new Slot[capacity]) {
+    assert(capacity > 0 && capacity < kNoSlot);
+    for (uint32_t i = 0; i < capacity; i++) {
+      slots_[i].nextFree.store(i + 1 < capacity ? i + 1 : kNoSlot,
+                               std::memory_order_relaxed);
+    }
+    freeHead_.store(0, std::memory_order_relaxed);
+  }
+
+  HandleTable(const HandleTable&) = delete;
+  HandleTable& operator=(const HandleTable&) = delete;
+
+  // Returns kInvalidHandle if the table is full.
+  Handle Register(T value) {
+    uint32_t index = PopFree();
+    if (index == kNoSlot) {
+      return kInvalidHandle;
+    }
+    Slot& slot = slots_[index];
+    slot.value = std::move(value);
+    uint32_t generation =
+        GenerationOf(slot.state.load(std::memory_order_relaxed));
+    // Publishes the value to lookups, which acquire the state.
+    slot.state.store(MakeState(generation, true, 0), std::memory_order_release);
+    live_.fetch_add(1, std::memory_order_relaxed);
+    return (Handle(generation) << 32) | index;
+  }
+
+  // Returns a new reference to the object, or a null T if |handle| is stale.
+  T Get(Handle handle) const {
+    T result{};
+    With(handle, [&result](const T& value) { result = value; });
+    return result;
+  }
+
+  // Calls |function| with the object while it is pinned. Returns false,
+  // without calling it, if |handle| is stale.
+  template <typename Function>
+  bool With(Handle handle, Function&& function) const {
+    Slot* slot = Pin(handle);
+    if (!slot) {
+      return false;
+    }
+    const T& value = slot->value;
+    function(value);
+    Unpin(slot);
+    return true;
+  }
+
+  // Invalidates |handle|. The table's reference is released now, or by the
+  // last lookup still pinning it. Returns false if |handle| was stale.
+  bool Remove(Handle handle) {
+    uint32_t index = IndexOf(handle);
+    if (index >= capacity_) {
+      return false;
+    }
+    Slot& slot = slots_[index];
+    uint64_t state = slot.state.load(std::memory_order_relaxed);
+    do {
+      if (!Matches(state, handle)) {
+        return false;
+      }
+    } while (!slot.state.compare_exchange_weak(state, state & ~kLiveBit,
+                                               std::memory_order_acq_rel));
+    live_.fetch_sub(1, std::memory_order_relaxed);
+    if ((state & kPinMask) == 0) {
+      Recycle(index);
+    }
+    return true;
+  }
+
+  // Get() and Remove() in one step: hands the table's object over to the
+  // caller.
+  T Take(Handle handle) {
+    T result = Get(handle);
+    if (!Remove(handle)) {
+      // Someone else removed it between the two.
+      return T{};
+    }
+    return result;
+  }
+
+  uint32_t Capacity() const { return capacity_; }
+  uint32_t LiveCount() const { return live_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr uint32_t kNoSlot = UINT32_MAX;
+  // Slot state: generation in the high 32 bits, then a live bit and a pin
+  // count.
+  static constexpr uint64_t kLiveBit = uint64_t(1) << 31;
+  static constexpr uint64_t kPinMask = kLiveBit - 1;
+
+  // Slots are written by whichever threads use their handles, so each gets
+  // its own cache line.
+  struct alignas(kCacheLineSize) Slot {
+    // Generations start at 1, so no handle is kInvalidHandle.
+    std::atomic<uint64_t> state{MakeState(1, false, 0)};
+    std::atomic<uint32_t> nextFree{kNoSlot};
+    T value{};
+  };
+
+  static constexpr uint64_t MakeState(uint32_t generation,
+                                      bool live,
+                                      uint32_t pins) {
+    return (uint64_t(generation) << 32) | (live ? kLiveBit : 0) | pins;
+  }
+  static uint32_t GenerationOf(uint64_t state) {
+    return static_cast<uint32_t>(state >> 32);
+  }
+  static uint32_t IndexOf(Handle handle) {
+    return static_cast<uint32_t>(handle);
+  }
+  static bool Matches(uint64_t state, Handle handle) {
+    return (state & kLiveBit) != 0 &&
+           GenerationOf(state) == static_cast<uint32_t>(handle >> 32);
+  }
+
+  Slot* Pin(Handle handle) const {
+    uint32_t index = IndexOf(handle);
+    if (index >= capacity_) {
+      return nullptr;
+    }
+    Slot& slot = slots_[index];
+    uint64_t state = slot.state.load(std::memory_order_relaxed);
+    do {
+      if (!Matches(state, handle)) {
+        return nullptr;
+      }
+      assert((state & kPinMask) != kPinMask);
+    } while (!slot.state.compare_exchange_weak(state, state + 1,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+    return &slot;
+  }
+
+  void Unpin(Slot* slot) const {
+    uint64_t state = slot->state.fetch_sub(1, std::memory_order_acq_rel);
+    if ((state & kPinMask) == 1 && (state & kLiveBit) == 0) {
+      // Removed while pinned, and this was the last pin.
+      const_cast<HandleTable*>(this)->Recycle(
+          static_cast<uint32_t>(slot - slots_.get()));
+    }
+  }
+
+  // Called exactly once per removal, when the slot is neither live nor
+  // pinned: releases the object and makes the slot reusable under the next
+  // generation.
+  void Recycle(uint32_t index) {
+    Slot& slot = slots_[index];
+    slot.value = T{};
+    uint32_t generation =
+        GenerationOf(slot.state.load(std::memory_order_relaxed)) + 1;
+    if (generation == 0) {
+      generation = 1;
+    }
+    slot.state.store(MakeState(generation, false, 0),
+                     std::memory_order_release);
+    PushFree(index);
+  }
+
+  // Free slots form a Treiber stack. The head carries a tag in its high 32
+  // bits that changes on every pop, so a head that was popped and pushed
+  // back in between doesn't fool the compare-exchange (ABA).
+  uint32_t PopFree() {
+    uint64_t head = freeHead_.load(std::memory_order_acquire);
+    uint64_t next;
+    do {
+      uint32_t index = static_cast<uint32_t>(head);
+      if (index == kNoSlot) {
+        return kNoSlot;
+      }
+      uint64_t tag = (head >> 32) + 1;
+      next = (tag << 32) |
+             slots_[index].nextFree.load(std::memory_order_relaxed);
+    } while (!freeHead_.compare_exchange_weak(head, next,
+                                              std::memory_order_acquire));
+    return static_cast<uint32_t>(head);
+  }
+
+  void PushFree(uint32_t index) {
+    uint64_t head = freeHead_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+      slots_[index].nextFree.store(static_cast<uint32_t>(head),
+                                   std::memory_order_relaxed);
+      next = (head & ~uint64_t(UINT32_MAX)) | index;
+    } while (!freeHead_.compare_exchange_weak(head, next,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+  }
+
+  const uint32_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(kCacheLineSize) std::atomic<uint64_t> freeHead_{kNoSlot};
+  std::atomic<uint32_t> live_{0};
+};
@@ -0,0 +1,96 @@
+#include "job_graph.h"
+
+#include <cassert>
+
+JobGraph::JobId JobGraph::AddJob(const char* name,
+                                 std::function<void()> function,
+                                 const std::vector<JobId>& dependencies,
+                                 int thread) {
+  JobId id = static_cast<JobId>(jobs_.size());
+
+  auto job = std::make_unique<Job>();
+  job->name = name;
+  job->function = std::move(function);
+  job->dependencyCount = static_cast<uint32_t>(dependencies.size());
+  job->thread = thread;
+  for (JobId dependency : dependencies) {
+    assert(dependency < id);
+    jobs_[dependency]->dependents.push_back(id);
+  }
+  jobs_.push_back(std::move(job));
+
+  // Every job will sit in the calling thread's queue at most once per Run().
+  callingThreadQueue_.reserve(jobs_.size());
+  return id;
+}
+
+void JobGraph::Run(vks::ThreadPool& pool) {
+  if (jobs_.empty()) {
+    return;
+  }
+  assert(!pool.threads.empty());
+  pool_ = &pool;
+
+  for (auto& job : jobs_) {
+    job->pendingDependencies.store(job->dependencyCount,
+                                   std::memory_order_relaxed);
+  }
+  remaining_.store(static_cast<uint32_t>(jobs_.size()),
+                   std::memory_order_release);
+
+  for (JobId id = 0; id < jobs_.size(); id++) {
+    if (jobs_[id]->dependencyCount == 0) {
+      Dispatch(id);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this] {
+      return !callingThreadQueue_.empty() ||
+             remaining_.load(std::memory_order_acquire) == 0;
+    });
+    if (callingThreadQueue_.empty()) {
+      break;
+    }
+    JobId id = callingThreadQueue_.back();
+    callingThreadQueue_.pop_back();
+    lock.unlock();
+    Execute(id);
+    lock.lock();
+  }
+}
+
+void JobGraph::Dispatch(JobId id) {
+  Job& job = *jobs_[id];
+  if (job.thread == kCallingThread) {
+    std::scoped_lock lock(mutex_);
+    callingThreadQueue_.push_back(id);
+    condition_.notify_all();
+    return;
+  }
+
+  size_t threadCount = pool_->threads.size();
+  size_t thread = job.thread >= 0
+                      ? static_cast<size_t>(job.thread) % threadCount
+                      : nextThread_.fetch_add(1, std::memory_order_relaxed) %
+                            threadCount;
+  pool_->threads[thread]->addJob([this, id] { Execute(id); });
+}
+
+void JobGraph::Execute(JobId id) {
+  Job& job = *jobs_[id];
+  job.function();
+
+  for (JobId dependent : job.dependents) {
+    if (jobs_[dependent]->pendingDependencies.fetch_sub(
+            1, std::memory_order_acq_rel) == 1) {
+      Dispatch(dependent);
+    }
+  }
+
+  if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    std::scoped_lock lock(mutex_);
+    condition_.notify_all();
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cache_line.h"
+#include "threadpool.hpp"
+
+// A static graph of jobs executed on a vks::ThreadPool, once per Run().
+//
+// Jobs are declared up front with the jobs they depend on. Run() starts every
+// job without dependencies and, as each job finishes, dispatches the dependents
+// whose last dependency it was, so independent jobs overlap without any
+// per-stage synchronization. Jobs that must stay on the calling thread (e.g.
+// queue submission) are executed by Run() itself while it waits.
+class JobGraph {
+ public:
+  using JobId = uint32_t;
+
+  // Thread placement for AddJob(). Non-negative values pick a pool thread
+  // (modulo the pool size), which keeps a chain of jobs on one core.
+  static constexpr int kAnyThread = -1;
+  static constexpr int kCallingThread = -2;
+
+  JobId AddJob(const char* name,
+               std::function<void()> function,
+               const std::vector<JobId>& dependencies = {},
+               int thread = kAnyThread);
+
+  // Runs every job exactly once and returns when all have finished. The
+  // graph must not be modified while this runs.
+  void Run(vks::ThreadPool& pool);
+
+  size_t JobCount() const { return jobs_.size(); }
+
+ private:
+  // Aligned so that workers updating the pending counts of different jobs
+  // don't contend for one cache line.
+  struct alignas(kCacheLineSize) Job {
+    const char* name;
+    std::function<void()> function;
+    std::vector<JobId> dependents;
+    uint32_t dependencyCount = 0;
+    std::atomic<uint32_t> pendingDependencies{0};
+    int thread;
+  };
+
+  void Dispatch(JobId id);
+  void Execute(JobId id);
+
+  std::vector<std::unique_ptr<Job>> jobs_;
+  vks::ThreadPool* pool_ = nullptr;
+  std::atomic<uint32_t> nextThread_{0};
+  std::atomic<uint32_t> remaining_{0};
+
+  // Guards callingThreadQueue_ and signals both it and completion.
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::vector<JobId> callingThreadQueue_;
+};
@@ -15,11 +15,13 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
 #include <vector>
 #include <array>
+#include <string>
 
 #include <unistd.h>  //Header file for sleep(). man 3 sleep for details.
 // #include <pthread.h>
@@ -27,8 +29,33 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 
+#include "camera.h"
+#include "alloc_counter.h"
+#include "buffer_allocator.h"
+#include "cache_line.h"
+#ifndef __EMSCRIPTEN__
+#include "capture_webgpu.h"
+#endif
+#include "culling.h"
+#include "frame_arena.h"
+#include "frame_pacer.h"
+#include "frame_stats.h"
+#include "frames_in_flight.h"
+#include "handle_table.h"
+#include "job_graph.h"
 #include "mat4.h"
+#include "mesh_pool.h"
+#if defined(MOCK_WEBGPU)
+#include "mock_webgpu.h"
+#endif
+#include "morton.h"
+#include "object_store.h"
+#include "options.h"
+#include "pipeline_cache.h"
+#include "simulation.h"
+#include "thread_affinity.h"
 
 #ifdef __EMSCRIPTEN__
 #include <webgpu/webgpu_cpp.h>
@@ -64,13 +91,122 @@
 static wgpu::Device device;
 static wgpu::Queue queue;
 static wgpu::Buffer readbackBuffer;
-static wgpu::RenderPipeline pipeline;
-
-static wgpu::BindGroup uniformBindGroup;
-static wgpu::Buffer uniformBuffer;
+// Key of the pipeline the current frame renders with; null until it finishes compiling.
+// Render threads resolve it through pipelineCache.
+static const PipelineKey* framePipelineKey = nullptr;
+
+// Format of the swap chain, and so of every pipeline and bundle that renders into it.
+static wgpu::TextureFormat swapChainFormat = wgpu::TextureFormat::BGRA8Unorm;
+
+static wgpu::ShaderModule shaderModule;
+static wgpu::BindGroupLayout uniformBindGroupLayout;
+static wgpu::PipelineLayout pipelineLayout;
+
+// --frames-in-flight: at most this many frames are submitted and not yet done on the
+// GPU. Resources the CPU rewrites every frame come in one set per frame slot, which is
+// free again whenever a frame may begin.
+static std::unique_ptr<FramesInFlight> framesInFlight;
+static uint32_t frameSlot = 0;
+static constexpr uint32_t kMaxFramesInFlight = 8;
+
+// --present-mode picks the swap chain's mode (the web only has fifo), and --target-fps
+// paces frame starts independently of it: immediate or mailbox without a target gives
+// uncapped throughput runs, and a target just above the display rate keeps queues short
+// for latency runs.
+static const struct {
+    const char* name;
+    wgpu::PresentMode mode;
+} kPresentModes[] = {
+    {"immediate", wgpu::PresentMode::Immediate},
+    {"mailbox", wgpu::PresentMode::Mailbox},
+    {"fifo", wgpu::PresentMode::Fifo},
+};
+static wgpu::PresentMode presentMode = wgpu::PresentMode::Fifo;
+static std::unique_ptr<FramePacer> framePacer;
+
+// --sim-rate: the animation steps on its own thread at this many Hz, and each frame
+// renders the newest snapshot, so a slow frame doesn't slow the animation down. Without
+// it (null), the animation steps once per rendered frame on the main thread, which keeps
+// headless and regression runs deterministic.
+static std::unique_ptr<SimulationThread> simulationThread;
+// How the frames lined up with the simulation's steps: frames that rendered the same
+// step as the frame before, and steps that no frame rendered.
+static uint32_t lastRenderedTick = 0;
+static uint64_t repeatedTickFrames = 0;
+static uint64_t unrenderedTicks = 0;
+
+// The camera uniform has a 256-byte region per frame slot (the largest
+// minUniformBufferOffsetAlignment allowed), bound with a dynamic offset.
+// queue.WriteBuffer is ordered with earlier submits, so one region would also
+// be correct; per-slot regions are the pattern for data the CPU writes outside
+// the queue (mapped or staging memory), which a queued frame may still read.
+struct FrameResources {
+    uint32_t cameraOffset;
+};
+static std::vector<FrameResources> frameResources;
+static wgpu::Buffer cameraBuffer;
+static constexpr uint64_t kCameraSlotStride = 256;
+
+// Long-lived storage buffers (transforms and grid ids) are slices of a few large
+// buffers. Bindings need offsets aligned to minStorageBufferOffsetAlignment; 256 is the
+// largest value the spec allows, so it is valid on every device.
+static std::unique_ptr<BufferPool> storagePool;
+static constexpr uint64_t kStoragePoolBlockSize = 4 << 20;
+static constexpr uint64_t kStorageOffsetAlignment = 256;
+// Staging for the copy tests: sources are mapped for writing in upload slices, and
+// copies land in readback slices, whose checks flushContentsChecks() maps in batches.
+// Each flush moves on to the next readback slot, so new copies don't target the buffer
+// that is being mapped. A slot is only reused once every map of it has called back
+// (readbackSlotMaps counts those still outstanding); until then flushes are deferred.
+static std::unique_ptr<LinearBufferAllocator> uploadAllocator;
+static std::unique_ptr<LinearBufferAllocator> readbackAllocator;
+static constexpr uint64_t kStagingSlotSize = 4096;
+static constexpr uint32_t kReadbackSlots = 2;
+static std::array<uint32_t, kReadbackSlots> readbackSlotMaps = {};
+
+// --bind-chunk: objects per chunk of the transform and grid-id buffers. With 0, one
+// chunk holds every object and is bound whole, without offsets. Otherwise each chunk is
+// its own pair of storage slices, bound with dynamic offsets through a chunk-sized
+// binding, so no binding grows with the scene. Chunks whose slices share buffers share a
+// bind group; all of them are created in init() and reused every frame. Every slice
+// comes from storagePool, whose offsets are aligned for storage bindings, so any chunk
+// size gives valid dynamic offsets.
+struct ObjectChunk {
+    BufferSlice transforms;
+    BufferSlice gridIds;
+    wgpu::BindGroup bindGroup;
+    // Transforms and grid ids; the camera offset follows at bind time.
+    uint32_t dynamicOffsetCount = 0;
+    std::array<uint32_t, 3> dynamicOffsets = {};
+};
+static std::vector<ObjectChunk> objectChunks;
+static uint32_t bindChunkObjects = 0;
+static uint32_t chunkObjects = 0;
+static constexpr uint32_t kNoChunk = UINT32_MAX;
+
+// Also selects the current frame slot's camera.
+template <typename Encoder>
+void bindObjectChunk(Encoder& encoder, uint32_t chunk) {
+    const ObjectChunk& objectChunk = objectChunks[chunk];
+    std::array<uint32_t, 3> offsets = objectChunk.dynamicOffsets;
+    offsets[objectChunk.dynamicOffsetCount] = frameResources[frameSlot].cameraOffset;
+    encoder.SetBindGroup(0, objectChunk.bindGroup, objectChunk.dynamicOffsetCount + 1,
+        offsets.data());
+}
 
 static int testsCompleted = 0;
 
+static std::mutex deviceMutex;
+
+static Options options;
+
+// Approximates process start; startup metrics are reported relative to this.
+static const auto startupTime = std::chrono::steady_clock::now();
+
+static double MsSinceStartup() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count();
+}
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #include <emscripten/html5.h>
@@ -80,7 +216,21 @@ void GetDevice(void (*callback)(wgpu::Device)) {
     // Left as null (until supported in Emscripten)
     static const WGPUInstance instance = nullptr;
 
-    wgpuInstanceRequestAdapter(instance, nullptr, [](WGPURequestAdapterStatus status, WGPUAdapter adapter, const char* message, void* userdata) {
+    // The browser picks the backend; only the adapter type maps onto request options.
+    if (!options.backend.empty() || !options.adapterName.empty()) {
+        printf("--backend and --adapter-name are ignored on the web\n");
+    }
+    WGPURequestAdapterOptions adapterOptions{};
+    const std::string& adapterType = options.adapterType;
+    if (adapterType == "discrete") {
+        adapterOptions.powerPreference = WGPUPowerPreference_HighPerformance;
+    } else if (adapterType == "integrated") {
+        adapterOptions.powerPreference = WGPUPowerPreference_LowPower;
+    } else if (adapterType == "cpu") {
+        adapterOptions.forceFallbackAdapter = true;
+    }
+
+    wgpuInstanceRequestAdapter(instance, &adapterOptions, [](WGPURequestAdapterStatus status, WGPUAdapter adapter, const char* message, void* userdata) {
         if (message) {
             printf("wgpuInstanceRequestAdapter: %s\n", message);
         }
@@ -424,19 +574,81 @@ const char* AdapterTypeName(wgpu::AdapterType t)
   return "?";
 }
 
+struct AdapterInfo {
+    dawn::native::Adapter adapter;
+    // Queried once at discovery; sorting and filtering only look at this copy.
+    wgpu::AdapterProperties properties;
+};
+
+// Whether the adapter satisfies --backend, --adapter-type and --adapter-name.
+static bool AdapterMatchesOptions(const wgpu::AdapterProperties& p) {
+    const std::string& backend = options.backend;
+    if (backend == "swiftshader") {
+        // SwiftShader is Dawn's CPU Vulkan implementation.
+        if (p.backendType != wgpu::BackendType::Vulkan || p.adapterType != wgpu::AdapterType::CPU) {
+            return false;
+        }
+    } else if (!backend.empty() && BackendOptionName(p.backendType) != backend) {
+        return false;
+    }
+
+    const std::string& adapterType = options.adapterType;
+    if ((adapterType == "discrete" && p.adapterType != wgpu::AdapterType::DiscreteGPU) ||
+        (adapterType == "integrated" && p.adapterType != wgpu::AdapterType::IntegratedGPU) ||
+        (adapterType == "cpu" && p.adapterType != wgpu::AdapterType::CPU)) {
+        return false;
+    }
+
+    if (!options.adapterName.empty() &&
+        ToLower(p.name ? p.name : "").find(ToLower(options.adapterName)) == std::string::npos) {
+        return false;
+    }
+    return true;
+}
+
+// Routes the wgpu:: calls to |procs|, through the call capture with --capture.
+static void installProcs(const DawnProcTable& procs) {
+    if (options.capture.empty()) {
+        dawnProcSetProcs(&procs);
+        return;
+    }
+    DawnProcTable captureProcs;
+    if (!CaptureWebGPUBegin(options.capture.c_str(), procs, device.Get(), &captureProcs)) {
+        exit(1);
+    }
+    dawnProcSetProcs(&captureProcs);
+}
+
 // void GetDevice(void (*callback)(wgpu::Device)) {
 void GetDevice() {
+#if defined(MOCK_WEBGPU)
+    // No adapter or backend: every WebGPU call goes to the recording mock.
+    device = wgpu::Device::Acquire(MockWebGPUCreateDevice());
+    installProcs(MockWebGPUProcs());
+    printf("[startup] mock WebGPU device ready: %.2f ms\n", MsSinceStartup());
+    return;
+#endif
+
+    double discoveryStartMs = MsSinceStartup();
+
     instance = std::make_unique<dawn::native::Instance>();
     instance->DiscoverDefaultAdapters();
 
-    auto adapters = instance->GetAdapters();
+    std::vector<AdapterInfo> adapters;
+    for (dawn::native::Adapter& adapter : instance->GetAdapters()) {
+        AdapterInfo info{adapter, {}};
+        adapter.GetProperties(&info.properties);
+        adapters.push_back(info);
+    }
+
+    double discoveryMs = MsSinceStartup() - discoveryStartMs;
+    printf("[startup] adapter discovery: %.2f ms (%zu adapters)\n", discoveryMs, adapters.size());
 
     // Sort adapters by adapterType, 
-    std::sort(adapters.begin(), adapters.end(), [](const dawn::native::Adapter& a, const dawn::native::Adapter& b){
-        wgpu::AdapterProperties pa, pb;
-        a.GetProperties(&pa);
-        b.GetProperties(&pb);
-        
+    std::sort(adapters.begin(), adapters.end(), [](const AdapterInfo& a, const AdapterInfo& b){
+        const wgpu::AdapterProperties& pa = a.properties;
+        const wgpu::AdapterProperties& pb = b.properties;
+
         if (pa.adapterType != pb.adapterType) {
             // Put GPU adapter (D3D, Vulkan, Metal) at front and CPU adapter at back.
             return pa.adapterType < pb.adapterType;
@@ -444,70 +656,241 @@ void GetDevice() {
 
         return GetBackendPriority(pa.backendType) < GetBackendPriority(pb.backendType);
     });
-    // Simply pick the first adapter in the sorted list.
-    dawn::native::Adapter backendAdapter = adapters[0];
+
+    // Pick the first adapter in the sorted list that matches the selection options.
+    const AdapterInfo* selected = nullptr;
+    for (const AdapterInfo& a : adapters) {
+        if (AdapterMatchesOptions(a.properties)) {
+            selected = &a;
+            break;
+        }
+    }
 
     printf("Available adapters sorted by their Adapter type, with GPU adapters listed at front and preferred:\n\n");
-    printf(" [Selected] -> ");
-    for (auto&& a : adapters) {
-        wgpu::AdapterProperties p;
-        a.GetProperties(&p);
+    for (const AdapterInfo& a : adapters) {
+        const wgpu::AdapterProperties& p = a.properties;
         printf(
-            "* %s (%s)\n"
+            "%s* %s (%s)\n"
             "    deviceID=%u, vendorID=0x%x, BackendType::%s, AdapterType::%s\n",
+        &a == selected ? " [Selected] -> " : "",
         p.name, p.driverDescription, p.deviceID, p.vendorID,
         BackendTypeName(p.backendType), AdapterTypeName(p.adapterType));
     }
     printf("\n\n");
 
-    device = wgpu::Device::Acquire(backendAdapter.CreateDevice());
-    DawnProcTable procs = dawn::native::GetProcs();
+    if (!selected) {
+        printf("No adapter matches backend='%s' adapter-type='%s' adapter-name='%s'\n",
+            options.backend.c_str(), options.adapterType.c_str(), options.adapterName.c_str());
+        exit(1);
+    }
 
-    dawnProcSetProcs(&procs);
+    dawn::native::Adapter backendAdapter = selected->adapter;
+    device = wgpu::Device::Acquire(backendAdapter.CreateDevice());
+    installProcs(dawn::native::GetProcs());
+    printf("[startup] device ready: %.2f ms\n", MsSinceStartup());
     // callback(device);
 }
 #endif  // __EMSCRIPTEN__
 
-// const uint32_t kDrawVertexCount = 3;
-static constexpr uint32_t kDrawVertexCount = 6;
-
-static constexpr uint32_t kQuadPerRow = 16;
-static constexpr uint32_t kNumInstances = kQuadPerRow * kQuadPerRow;
-
-// static constexpr uint32_t numThreads = 1;
-// static constexpr uint32_t numThreads = 2;
-static constexpr uint32_t numThreads = 4;
-// static constexpr size_t numObjectsPerThread = (kNumInstances + numThreads - 1) / numThreads;
-static constexpr size_t numObjectsPerThread = kNumInstances / numThreads;
-
+// Objects per grid row, from --grid (set in main()); the scene is quadPerRow^2 objects.
+static uint32_t quadPerRow = 16;
+static uint32_t numInstances = quadPerRow * quadPerRow;
+static constexpr uint32_t kMaxQuadPerRow = 1024;
+
+// Render worker count, from --threads (set in main()).
+static uint32_t numThreads = 4;
+// Worker CPU placement, from --affinity (set in main()).
+static AffinityPolicy workerAffinity;
+
+// How visible objects become commands, from --encoding (set in main()):
+//   bundles  each worker records a render bundle; the calling thread executes them all
+//            in one render pass
+//   passes   each worker records a command buffer with its own render pass, loading what
+//            the previous ones drew; they are submitted after a clearing pass
+//   single   workers only cull; the calling thread encodes every draw into one pass
+// Builds without MULTITHREADED_RENDERING only support single, and don't cull.
+enum class EncodingStrategy { Bundles, Passes, Single };
+static const char* const kEncodingStrategyNames[] = {"bundles", "passes", "single"};
+#if defined(MULTITHREADED_RENDERING)
+static EncodingStrategy encodingStrategy = EncodingStrategy::Bundles;
+#else
+static EncodingStrategy encodingStrategy = EncodingStrategy::Single;
+#endif
+static constexpr uint32_t kMaxThreads = 64;
 
-struct DrawObjectData {
-    Mat4 mat4;
-    // Vec3 color;
-    // uint32_t idx;
-    // vertex buffer
-    // size_t offset;
-    // matrix
-};
 
 // static constexpr uint32_t matrixElementCount = 4 * 4;  // 4x4 matrix
 // static constexpr uint32_t matrixByteSize = sizeof(float) * matrixElementCount;
-// static constexpr uint64_t uniformBufferSize = matrixByteSize * kNumInstances;
-static constexpr uint64_t uniformBufferSize = sizeof(DrawObjectData) * kNumInstances;
-
-static std::array<DrawObjectData, kNumInstances> objectData;
+// Per-object bindings are sized for one chunk of objects in init().
+static uint64_t uniformBufferSize = 0;
+static uint64_t gridIdBufferSize = 0;
+static constexpr uint64_t cameraBufferSize = sizeof(float) * 16;
+
+// All scene objects, one stream per attribute. Objects are added in Morton order of
+// their grid position so that contiguous slot ranges (and so each thread's partition)
+// are spatially compact. An object's material key is its row-major grid id
+// (x + y * quadPerRow), which the fragment shader derives its colour from.
+//
+// The scene is static, so the tile hierarchy and GPU copies are built once in init();
+// adding or removing objects later would require rebuilding both.
+static ObjectStore objects(0);
 
 
+// The frame's animation state, copied from a simulation snapshot at the start of the
+// frame; the render workers only read it.
 static float focusPointX = 0.0;
 static float focusPointY = 0.0;
+static float cullRadius = 0.0;
+
+// --cull=diamond (default) keeps the original flat view and culls to the animated
+// diamond; --cull=frustum views the grid through a perspective camera following the
+// focus point and culls bounding spheres against its frustum.
+static bool frustumCulling = false;
+static Mat4 frameViewProjection;
+static Frustum frameFrustum;
+
+// --depth (set in main()):
+//   off     no depth attachment; overlapping objects all shade every fragment
+//   on      a depth attachment, tested (less) and written by the pipelines
+//   sorted  on, and each render worker draws its visible objects front to back, so
+//           hidden fragments fail the depth test before they are shaded
+// Workers' draws are sorted among themselves only; bundles and passes still run in
+// worker order.
+enum class DepthMode { Off, On, Sorted };
+static const char* const kDepthModeNames[] = {"off", "on", "sorted"};
+static DepthMode depthMode = DepthMode::Off;
+static constexpr wgpu::TextureFormat kDepthFormat = wgpu::TextureFormat::Depth24Plus;
+// Same size as the color target; created in run() unless --depth=off.
+static wgpu::TextureView depthTargetView;
+
+// Object size in grid cells, from --overlap (set in main()). Above 1, neighbouring objects
+// overlap, each pixel being covered by about overlap^2 of them.
+static uint32_t quadOverlap = 1;
+
+static wgpu::TextureFormat depthFormat() {
+    return depthMode == DepthMode::Off ? wgpu::TextureFormat::Undefined : kDepthFormat;
+}
+
+// Height of an object above the z = 0 plane: 0 without --overlap, otherwise a fixed
+// pseudo-random value in [0, 0.5) so that no two overlapping objects are coplanar.
+static float objectHeight(uint32_t gridId) {
+    if (quadOverlap == 1) {
+        return 0.0f;
+    }
+    return (float)((gridId * 2654435761u) >> 24) / 512.0f;
+}
+
+// Tiles over the object store's slot order; built once the bounds are known.
+// 4x4-object leaves. Thread partitions are leaf aligned only when numThreads divides
+// numInstances / 16 (see setupThreads()); TileHierarchy::Cull handles a range that
+// starts or ends inside a leaf.
+static constexpr uint32_t kLeafSlots = 16;
+static TileHierarchy tileHierarchy;
 
 static uint32_t frameTime = 0;
 
+// Heap allocations made by the frame-loop code that runs outside Dawn (update and cull
+// stages, end-of-frame reset), counted through the alloc_counter hook. Expected to stay
+// zero once the frame arenas have grown to their working size.
+static std::atomic<uint64_t> frameLoopAllocations{0};
+// Total capacity of the frame arenas after the last reset.
+static size_t frameArenaBytes = 0;
+
+// The animation scales with the grid, so the visible fraction of the scene doesn't
+// depend on --grid.
+static float animationScale() {
+    return (float)quadPerRow / 16.0f;
+}
+
+// One simulation step: the focus point and cull radius at |tick|. Runs on the
+// simulation thread with --sim-rate, so it only reads state fixed before the first frame.
+SimulationSnapshot simulateAnimation(uint32_t tick) {
+    float t = (float)tick * 0.01;
+    SimulationSnapshot snapshot;
+    snapshot.tick = tick;
+    snapshot.focusX = (cosf(t) + 1.0) * 0.5 * (float)quadPerRow;
+    snapshot.focusY = (sinf(2.7 * t) + 1.0) * 0.5 * (float)quadPerRow;
+    snapshot.cullRadius = (6.0 + 3.0 * cosf((float)tick * 0.04)) * animationScale();
+    return snapshot;
+}
+
+// Takes the frame's animation state: the simulation thread's newest snapshot, or the
+// step for frameTime without one. Called at the start of frame(), before any worker
+// runs, so a capture can record it with the frame.
+void advanceAnimation() {
+    if (!simulationThread) {
+        SimulationSnapshot snapshot = simulateAnimation(frameTime);
+        focusPointX = snapshot.focusX;
+        focusPointY = snapshot.focusY;
+        cullRadius = snapshot.cullRadius;
+        return;
+    }
+    const SimulationSnapshot& snapshot = simulationThread->Latest();
+    if (frameTime > 0) {
+        if (snapshot.tick == lastRenderedTick) {
+            repeatedTickFrames++;
+        } else {
+            unrenderedTicks += snapshot.tick - lastRenderedTick - 1;
+        }
+    }
+    lastRenderedTick = snapshot.tick;
+    focusPointX = snapshot.focusX;
+    focusPointY = snapshot.focusY;
+    cullRadius = snapshot.cullRadius;
+}
+
+// Starts --sim-rate's thread just before the first frame, so simulated time starts with
+// rendering.
+void startSimulation() {
+    if (options.simRate > 0) {
+        simulationThread = std::make_unique<SimulationThread>((double)options.simRate,
+            simulateAnimation);
+    }
+}
+
+void printSimulationStats() {
+    if (!simulationThread) {
+        return;
+    }
+    simulationThread->Print("[simulation]");
+    printf("[simulation] %u frames rendered: %llu repeated the previous step, %llu steps "
+           "never rendered\n",
+        frameTime, (unsigned long long)repeatedTickFrames, (unsigned long long)unrenderedTicks);
+}
+
+// Builds this frame's view from the animation state and uploads the camera.
+void updateFrameState() {
+    {
+        AllocationScope allocationScope(&frameLoopAllocations);
+        if (frustumCulling) {
+            // Tilted towards +y and zooming with cullRadius, so the visible footprint is a
+            // trapezoid of changing size.
+            Camera camera;
+            camera.targetX = focusPointX;
+            camera.targetY = focusPointY;
+            camera.height = 1.5f * cullRadius;
+            camera.pitch = 0.5f;
+            camera.fovY = 1.0f;
+            camera.zNear = 0.5f;
+            camera.zFar = 100.0f * animationScale();
+            frameViewProjection = camera.ViewProjection();
+        } else {
+            frameViewProjection = GridViewProjection((float)quadPerRow);
+        }
+        frameFrustum = Frustum::FromViewProjection(frameViewProjection);
+    }
+
+    std::scoped_lock lock(deviceMutex);
+    queue.WriteBuffer(cameraBuffer, frameResources[frameSlot].cameraOffset,
+        frameViewProjection.Data(), cameraBufferSize);
+}
+
+// Reference predicate, by row-major grid id; the cull stage uses CullDiamond().
 bool ifObjectShouldDraw(size_t objectId) {
-    size_t x = objectId % kQuadPerRow;
-    size_t y = objectId / kQuadPerRow;
+    size_t x = objectId % quadPerRow;
+    size_t y = objectId / quadPerRow;
 
-    return abs((float)x - focusPointX) + abs((float)y - focusPointY) < 6.0 + 3.0 * cosf((float)frameTime * 0.04);
+    return abs((float)x - focusPointX) + abs((float)y - focusPointY) < cullRadius;
 }
 
 
@@ -524,19 +907,26 @@ static const char shaderCodeTriangle[] = R"(
     }
 )";
 
-// For multithreading, draw a animated quad for each draw command
+// For multithreading, draw a animated mesh for each draw command. Positions come from
+// the mesh pool's vertex buffer.
 static const char shaderCode[] = R"(
-    const pos = array<vec2<f32>, 6>(
-            vec2<f32>(-0.5, -0.5), vec2<f32>(0.5, -0.5), vec2<f32>(-0.5, 0.5),
-            vec2<f32>(-0.5, 0.5), vec2<f32>(0.5, -0.5), vec2<f32>(0.5, 0.5)
-        );
-
+    // Sized at runtime by --grid, hence storage rather than uniform buffers.
     struct Uniforms {
-        matrix : array<mat4x4<f32>, 256>,   // temp
+        matrix : array<mat4x4<f32>>,
         // matrix : mat4x4<f32>,
     }
 
-    @binding(0) @group(0) var<uniform> uniforms : Uniforms;
+    @binding(0) @group(0) var<storage, read> uniforms : Uniforms;
+
+    // Objects are stored (and instanced) in Morton order; this maps an instance back to
+    // its row-major grid id, which the fragment colouring is based on.
+    struct GridIds {
+        ids : array<u32>,
+    }
+
+    @binding(1) @group(0) var<storage, read> gridIds : GridIds;
+
+    @binding(2) @group(0) var<uniform> viewProjection : mat4x4<f32>;
 
     struct VertexOutput {
         @builtin(position) Position: vec4<f32>,
@@ -549,14 +939,14 @@ static const char shaderCode[] = R"(
 
     @vertex
     fn main_v(
-        @builtin(vertex_index) vid: u32,
+        @location(0) position: vec2<f32>,
         @builtin(instance_index) iid: u32
     ) -> VertexOutput {
         var shader_io: VertexOutput;
         // Basic matrix transform animation
-        shader_io.Position = uniforms.matrix[iid] * vec4<f32>(pos[vid], 0.0, 1.0);
+        shader_io.Position = viewProjection * uniforms.matrix[iid] * vec4<f32>(position, 0.0, 1.0);
         // shader_io.Position = vec4<f32>(pos[vid], 0.0, 1.0);
-        shader_io.instance_idx = iid;
+        shader_io.instance_idx = gridIds.ids[iid];
         return shader_io;
     }
 
@@ -571,6 +961,51 @@ static const char shaderCode[] = R"(
     }
 )";
 
+// The scene pipeline is requested at startup and compiles while the frame loop runs.
+// Until it is ready, frames only clear: a variant with any other kQuadPerSide would
+// colour the grid wrongly, so there is no fallback to draw with. The variants other
+// runs use (the perf matrix's --grid sizes, with and without depth) are requested at
+// the same time and compile concurrently, warming the driver's pipeline cache.
+static constexpr std::array<uint32_t, 3> kPrewarmQuadPerRow = {16, 64, 256};
+static PipelineKey scenePipelineKey;
+static std::unique_ptr<PipelineCache> pipelineCache;
+
+// Geometry of every mesh, in one vertex and one index buffer. The scene uses regular
+// polygons with 3 to 10 sides; each 4x4 leaf of objects shares one, so runs of slots
+// drawn by one instanced draw stay long.
+static std::unique_ptr<MeshPool> meshPool;
+static std::vector<MeshPool::MeshId> sceneMeshes;
+static constexpr uint32_t kMinMeshSides = 3;
+static constexpr uint32_t kMaxMeshSides = 10;
+static constexpr uint32_t kMeshPoolVertices = 16384;
+static constexpr uint32_t kMeshPoolIndices = 65536;
+
+void setupMeshes() {
+    meshPool = std::make_unique<MeshPool>(device, queue, deviceMutex,
+        kMeshPoolVertices, kMeshPoolIndices);
+    std::vector<float> positions;
+    std::vector<uint16_t> indices;
+    for (uint32_t sides = kMinMeshSides; sides <= kMaxMeshSides; sides++) {
+        // On the unit quad's circumcircle, so the objects' bounding spheres still hold;
+        // the 4-sided one is the unit quad itself.
+        BuildPolygonMesh(sides, 0.7071f, &positions, &indices);
+        MeshPool::MeshId mesh = meshPool->AddMesh(positions.data(),
+            (uint32_t)positions.size() / 2, indices.data(), (uint32_t)indices.size());
+        assert(mesh != MeshPool::kInvalidMesh);
+        sceneMeshes.push_back(mesh);
+    }
+}
+
+// Mesh of the object at grid position (x, y).
+static MeshPool::MeshId objectMesh(uint32_t x, uint32_t y) {
+    return sceneMeshes[(x / 4 + y / 4) % sceneMeshes.size()];
+}
+
+// The scene pipeline's key if it has compiled, otherwise null.
+const PipelineKey* pickReadyPipelineKey() {
+    return pipelineCache->Find(scenePipelineKey) ? &scenePipelineKey : nullptr;
+}
+
 void init() {
     device.SetUncapturedErrorCallback(
         [](WGPUErrorType errorType, const char* message, void*) {
@@ -578,8 +1013,12 @@ void init() {
         }, nullptr);
 
     queue = device.GetQueue();
+    setupMeshes();
+
+    chunkObjects = bindChunkObjects > 0 ? bindChunkObjects : numInstances;
+    uniformBufferSize = sizeof(Mat4) * chunkObjects;
+    gridIdBufferSize = sizeof(uint32_t) * chunkObjects;
 
-    wgpu::ShaderModule shaderModule{};
     {
         wgpu::ShaderModuleWGSLDescriptor wgslDesc{};
         // wgslDesc.source = shaderCodeTriangle;
@@ -590,43 +1029,70 @@ void init() {
         shaderModule = device.CreateShaderModule(&descriptor);
     }
 
+    // Explicit layouts so the bind group can be created without waiting for a pipeline.
     {
-        wgpu::ColorTargetState colorTargetState{};
-        colorTargetState.format = wgpu::TextureFormat::BGRA8Unorm;
-
-        wgpu::FragmentState fragmentState{};
-        fragmentState.module = shaderModule;
-        fragmentState.entryPoint = "main_f";
-        fragmentState.targetCount = 1;
-        fragmentState.targets = &colorTargetState;
-        std::vector<wgpu::ConstantEntry> constants{
-            {nullptr, "kQuadPerSide", kQuadPerRow},
-            // {nullptr, "kNumInstances", kNumInstances},
-        };
-        fragmentState.constants = constants.data();
-        fragmentState.constantCount = constants.size();
-
-        wgpu::RenderPipelineDescriptor descriptor{};
-        descriptor.layout = nullptr;
-        descriptor.vertex.module = shaderModule;
-        descriptor.vertex.entryPoint = "main_v";
-        descriptor.fragment = &fragmentState;
-        descriptor.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
-        pipeline = device.CreateRenderPipeline(&descriptor);
+        wgpu::BindGroupLayoutEntry entries[3] = {};
+        entries[0].binding = 0;
+        entries[0].visibility = wgpu::ShaderStage::Vertex;
+        entries[0].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+        entries[0].buffer.hasDynamicOffset = bindChunkObjects > 0;
+        entries[0].buffer.minBindingSize = uniformBufferSize;
+        entries[1].binding = 1;
+        entries[1].visibility = wgpu::ShaderStage::Vertex;
+        entries[1].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+        entries[1].buffer.hasDynamicOffset = bindChunkObjects > 0;
+        entries[1].buffer.minBindingSize = gridIdBufferSize;
+        entries[2].binding = 2;
+        entries[2].visibility = wgpu::ShaderStage::Vertex;
+        entries[2].buffer.type = wgpu::BufferBindingType::Uniform;
+        entries[2].buffer.hasDynamicOffset = true;
+        entries[2].buffer.minBindingSize = cameraBufferSize;
+
+        wgpu::BindGroupLayoutDescriptor desc{};
+        desc.entryCount = 3;
+        desc.entries = entries;
+        uniformBindGroupLayout = device.CreateBindGroupLayout(&desc);
     }
-
     {
-        // TODO: Replace with storage buffer
+        wgpu::PipelineLayoutDescriptor desc{};
+        desc.bindGroupLayoutCount = 1;
+        desc.bindGroupLayouts = &uniformBindGroupLayout;
+        pipelineLayout = device.CreatePipelineLayout(&desc);
+    }
 
-        wgpu::BufferDescriptor descriptor{};
-        descriptor.size = uniformBufferSize;
-        descriptor.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
-        // descriptor.mappedAtCreation = true;
-        uniformBuffer = device.CreateBuffer(&descriptor);
+    pipelineCache = std::make_unique<PipelineCache>(device, pipelineLayout,
+        MeshPool::VertexLayout(), deviceMutex);
+    auto sceneVariant = [](uint32_t quadPerSide, wgpu::TextureFormat depth) {
+        return PipelineKey(shaderModule, "main_v", "main_f",
+            std::vector<std::pair<std::string, double>>{
+                {"kQuadPerSide", (float)quadPerSide},
+                // {"kNumInstances", kNumInstances},
+            },
+            std::vector<wgpu::TextureFormat>{swapChainFormat}, depth);
+    };
+    scenePipelineKey = sceneVariant(quadPerRow, depthFormat());
+    pipelineCache->GetOrCreateAsync(scenePipelineKey);
+    for (wgpu::TextureFormat depth : {wgpu::TextureFormat::Undefined, kDepthFormat}) {
+        pipelineCache->GetOrCreateAsync(sceneVariant(quadPerRow, depth));
+        for (uint32_t quadPerSide : kPrewarmQuadPerRow) {
+            pipelineCache->GetOrCreateAsync(sceneVariant(quadPerSide, depth));
+        }
+    }
+    printf("[pipeline-cache] requested %zu variants\n", pipelineCache->Size());
+
+    storagePool = std::make_unique<BufferPool>(device, deviceMutex,
+        wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst, kStoragePoolBlockSize,
+        kStorageOffsetAlignment);
+    uploadAllocator = std::make_unique<LinearBufferAllocator>(device, deviceMutex,
+        wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc, kStagingSlotSize, 1);
+    readbackAllocator = std::make_unique<LinearBufferAllocator>(device, deviceMutex,
+        wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst, kStagingSlotSize,
+        kReadbackSlots);
 
+    {
         // float* ptr = static_cast<float*>(uniformBuffer.GetMappedRange());
         // assert(ptr != nullptr);
-        // for (uint32_t i = 0; i < kNumInstances; i++) {
+        // for (uint32_t i = 0; i < numInstances; i++) {
         //     float* o = ptr + i * matrixByteSize;
         //     for (uint32_t j = 0; j < matrixElementCount; j++) {
         //         o[j] = 0.0;
@@ -638,198 +1104,522 @@ void init() {
         // }
         // uniformBuffer.Unmap();
 
-        const float quadSize = 2.0 / (float) kQuadPerRow;
-        const float quadOffsetBase = -1.0 + 0.5 * quadSize;
+        objects = ObjectStore(numInstances);
+        std::vector<uint32_t> mortonOrder = BuildMortonOrder(quadPerRow, quadPerRow);
+        for (uint32_t gridId : mortonOrder) {
+            uint32_t x = gridId % quadPerRow;
+            uint32_t y = gridId / quadPerRow;
+
+            // World units are grid units: object (x, y) is a mesh inscribed in the
+            // circumcircle of the unit quad centered on (x, y, 0), which bounds it. The
+            // transform is placement only; the view-projection maps it to the screen.
+            // With --overlap, objects grow and are lifted to staggered heights so that
+            // the depth test has an order to resolve.
+            float z = objectHeight(gridId);
+            float size = (float)quadOverlap;
+            objects.Add((float)x, (float)y, z, 0.7072f * size,
+                Mat4::Translation(Vec3((float)x, (float)y, z)) * Mat4::Scale(size), gridId,
+                objectMesh(x, y));
+            // d.color = Vec3((float)x / quadPerRow, (float)y / quadPerRow, 0.5);
+        }
 
-        for (uint32_t x = 0; x < kQuadPerRow; x++) {
-            for (uint32_t y = 0; y < kQuadPerRow; y++) {
-                DrawObjectData& d = objectData[x + y * kQuadPerRow];
+        tileHierarchy.Build(objects.Bounds(), objects.Size(), kLeafSlots, 4);
+    }
+    // The last chunk may be partly filled; its binding still covers a whole chunk.
+    objectChunks.resize((numInstances + chunkObjects - 1) / chunkObjects);
+    for (uint32_t i = 0; i < objectChunks.size(); i++) {
+        ObjectChunk& chunk = objectChunks[i];
+        uint32_t firstSlot = i * chunkObjects;
+        uint32_t count = std::min(chunkObjects, numInstances - firstSlot);
+        chunk.transforms = storagePool->Allocate(uniformBufferSize);
+        chunk.gridIds = storagePool->Allocate(gridIdBufferSize);
+        queue.WriteBuffer(chunk.transforms.buffer, chunk.transforms.offset,
+            objects.Transforms() + firstSlot, sizeof(Mat4) * count);
+        queue.WriteBuffer(chunk.gridIds.buffer, chunk.gridIds.offset,
+            objects.MaterialKeys() + firstSlot, sizeof(uint32_t) * count);
+    }
+    {
+        // Written by updateFrameState() every frame, in the frame slot's region.
+        frameResources.resize(framesInFlight->MaxFrames());
+        for (uint32_t i = 0; i < frameResources.size(); i++) {
+            frameResources[i].cameraOffset = (uint32_t)(i * kCameraSlotStride);
+        }
+        wgpu::BufferDescriptor descriptor{};
+        descriptor.size = kCameraSlotStride * frameResources.size();
+        descriptor.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+        cameraBuffer = device.CreateBuffer(&descriptor);
+    }
 
-                d.mat4 = Mat4::Translation(
-                    Vec3(
-                        (float)x * quadSize + quadOffsetBase,
-                        (float)y * quadSize + quadOffsetBase,
-                        0.0f)
-                ) * Mat4::Scale(quadSize);
-                // d.color = Vec3((float)x / kQuadPerRow, (float)y / kQuadPerRow, 0.5);
+    uint32_t bindGroupCount = 0;
+    for (uint32_t i = 0; i < objectChunks.size(); i++) {
+        ObjectChunk& chunk = objectChunks[i];
+        const bool dynamic = bindChunkObjects > 0;
+        if (dynamic) {
+            chunk.dynamicOffsetCount = 2;
+            chunk.dynamicOffsets = {(uint32_t)chunk.transforms.offset,
+                (uint32_t)chunk.gridIds.offset};
+            // Slices are allocated in order, so chunks sharing buffers are neighbours.
+            if (i > 0 && objectChunks[i - 1].transforms.buffer.Get() ==
+                    chunk.transforms.buffer.Get() &&
+                    objectChunks[i - 1].gridIds.buffer.Get() == chunk.gridIds.buffer.Get()) {
+                chunk.bindGroup = objectChunks[i - 1].bindGroup;
+                continue;
             }
         }
 
-        queue.WriteBuffer(uniformBuffer, 0, objectData.data(), uniformBufferSize);
-    }
-
-    wgpu::BindGroupEntry bindEntries[] = {
-        { nullptr, 0, uniformBuffer },
-    };
-    // Try to be safe with default size initialized.
-    bindEntries[0].offset = 0;
-    bindEntries[0].size = uniformBufferSize;
+        wgpu::BindGroupEntry bindEntries[] = {
+            { nullptr, 0, chunk.transforms.buffer },
+            { nullptr, 1, chunk.gridIds.buffer },
+            { nullptr, 2, cameraBuffer },
+        };
+        // Try to be safe with default size initialized.
+        bindEntries[0].offset = dynamic ? 0 : chunk.transforms.offset;
+        bindEntries[0].size = uniformBufferSize;
+        bindEntries[1].offset = dynamic ? 0 : chunk.gridIds.offset;
+        bindEntries[1].size = gridIdBufferSize;
+        bindEntries[2].offset = 0;
+        bindEntries[2].size = cameraBufferSize;
 
-    {
         wgpu::BindGroupDescriptor desc{};
-        // desc.layout = bgl;
-        desc.layout = pipeline.GetBindGroupLayout(0);
-        desc.entryCount = 1;
+        desc.layout = uniformBindGroupLayout;
+        desc.entryCount = 3;
         desc.entries = bindEntries;
-        uniformBindGroup = device.CreateBindGroup(&desc);
+        chunk.bindGroup = device.CreateBindGroup(&desc);
+        bindGroupCount++;
     }
+
+    storagePool->PrintStats("[buffers]", "storage");
+    printf("[buffers] %zu chunks of %u objects, %u bind groups\n", objectChunks.size(),
+        chunkObjects, bindGroupCount);
 }
 
 static bool program_running = true;
-static std::mutex deviceMutex;
+
+// --overdraw-report: every N frames, each render pass of the frame runs inside an
+// occlusion query, and the samples that passed are read back and printed per pixel.
+// Without a depth attachment every rasterized fragment passes, so that is the overdraw;
+// with one, only fragments that pass the depth test count, which are the ones shaded
+// when the GPU tests depth early. SwiftShader counts samples exactly; some GPUs only
+// report zero or non-zero.
+static wgpu::QuerySet overdrawQuerySet;
+// Query 0 is the frame's pass, 1 + i render worker i's own pass (--encoding=passes).
+static uint32_t overdrawQueryCount = 0;
+static wgpu::Buffer overdrawResolveBuffer;
+static wgpu::Buffer overdrawReadbackBuffer;
+// Whether the current frame is measured. A frame is only measured once the previous
+// measurement has been read back.
+static bool overdrawFrame = false;
+static bool overdrawReadbackPending = false;
+
+void beginOverdrawQuery(const wgpu::RenderPassEncoder& pass, uint32_t queryIndex) {
+    if (overdrawFrame) {
+        pass.BeginOcclusionQuery(queryIndex);
+    }
+}
+
+void endOverdrawQuery(const wgpu::RenderPassEncoder& pass) {
+    if (overdrawFrame) {
+        pass.EndOcclusionQuery();
+    }
+}
+
+// Copies the frame's query results to the readback buffer; encoded after its passes.
+void encodeOverdrawResolve(const wgpu::CommandEncoder& encoder) {
+    encoder.ResolveQuerySet(overdrawQuerySet, 0, overdrawQueryCount, overdrawResolveBuffer, 0);
+    encoder.CopyBufferToBuffer(overdrawResolveBuffer, 0, overdrawReadbackBuffer, 0,
+        sizeof(uint64_t) * overdrawQueryCount);
+}
 
 #if defined(MULTITHREADED_RENDERING)
 
-// ready to build command buffer
-static std::mutex frameMutex;
-static std::condition_variable frame_cv;
-static std::mutex renderMutex;
-static std::condition_variable render_cv;
-static bool frameStartRendering = false;
-static uint32_t renderthreadsFinished = 0;
-
-struct ThreadRenderData {
-    // wgpu::CommandBuffer commands;
-    // wgpu::CommandBuffer& commands;
-    wgpu::RenderPassDescriptor renderpass;
-    // // Per object information (position, rotation, etc.)
-    // std::vector<DrawObjectData> objectData;
+// Visible slots [firstSlot, firstSlot + count) sharing a mesh and an object chunk, drawn
+// as one instanced draw.
+struct DrawRun {
+    uint32_t firstSlot;
+    uint32_t count;
+    MeshPool::MeshId mesh;
+    uint32_t chunk;
+    // Nearest view depth of the run's objects; only computed with --depth=sorted.
+    float depth;
+};
 
+// Every worker writes its own entry each frame (arena bump pointer, visibleIds growth,
+// visibleCount), so entries are cache-line aligned: neighbours in threadData never share
+// a line, and the workers don't invalidate each other's caches.
+struct alignas(kCacheLineSize) ThreadRenderData {
     // std::vector<DrawObjectData&> objectDataRefs;
-    std::vector<size_t> objectIds;
+    // This thread draws slots [firstObjectId, firstObjectId + objectCount), a
+    // spatially compact block thanks to the Morton layout.
+    uint32_t firstObjectId;
+    uint32_t objectCount;
+    // Per-frame scratch of the stages running on this thread; reset at frame end.
+    FrameArena arena;
+    // Output of the cull stage, consumed by the encode stage. Lives in |arena|.
+    FrameVector<uint32_t> visibleIds{FrameAllocator<uint32_t>(&arena)};
+    size_t visibleCount = 0;
+    FrameVector<DrawRun> drawRuns{FrameAllocator<DrawRun>(&arena)};
 
-    // bool commandsBufferDone = false;
     uint32_t threadIdx;
-
-    std::mutex m;
-    std::condition_variable condition;
-
-    bool rendering = false;
 };
 
-static std::array<ThreadRenderData, numThreads> threadData;
-static std::array<wgpu::RenderBundle, numThreads> renderBundles;
-static std::vector<std::thread> renderThreads;
-
-void threadRenderFunc(ThreadRenderData& data) {
-    while (program_running) {
-// #ifdef __EMSCRIPTEN__
-//         emscripten_sleep(1000);
-// #endif
+static std::unique_ptr<ThreadRenderData[]> threadData;
+// Encode stage outputs, indexed by thread; padded for the same reason. Which one is
+// used depends on encodingStrategy. Workers register their bundles in bundleTable and
+// publish the handle; pass assembly takes them out again, so the table only holds the
+// current frame's bundles.
+using BundleHandle = HandleTable<wgpu::RenderBundle>::Handle;
+static HandleTable<wgpu::RenderBundle> bundleTable(kMaxThreads);
+static std::vector<CacheLinePadded<BundleHandle>> renderBundles;
+static std::vector<CacheLinePadded<wgpu::CommandBuffer>> workerCommands;
+// Pass assembly scratch, reserved for numThreads bundles at setup.
+static std::vector<wgpu::RenderBundle> frameBundles;
+
+// Frame stages run as a job graph on the pool; see setupThreads() for the stage wiring.
+static vks::ThreadPool threadPool;
+static JobGraph frameGraph;
+
+// Per-frame inputs and outputs of the graph, only valid while frameGraph.Run() executes.
+static const wgpu::RenderPassDescriptor* frameRenderPass = nullptr;
+// Submitted in order; reserved for numThreads + 1 command buffers at setup.
+static std::vector<wgpu::CommandBuffer> frameCommands;
+
+// Depth buffer value of the center of the object in |slot| for this frame's view.
+static float viewDepth(const SphereArrays& bounds, uint32_t slot) {
+    const Mat4& m = frameViewProjection;
+    float x = bounds.x[slot], y = bounds.y[slot], z = bounds.z[slot];
+    float clipZ = m.At(0, 2) * x + m.At(1, 2) * y + m.At(2, 2) * z + m.At(3, 2);
+    float clipW = m.At(0, 3) * x + m.At(1, 3) * y + m.At(2, 3) * z + m.At(3, 3);
+    return clipZ / clipW;
+}
 
-        {
-            std::unique_lock lock(data.m);
-            data.condition.wait(lock, [&]{ return data.rendering == true || !program_running; });
-            if (!program_running) {
-                break;
+// Groups the visible slots of |data| into runs of consecutive slots with the same mesh
+// (long ones, thanks to the Morton layout and meshes shared per leaf). With
+// --depth=sorted, runs are also cut at leaf boundaries and ordered nearest first. Leaves
+// are compact 4x4 blocks, so this sorts the objects coarsely while keeping the draws
+// instanced.
+void buildDrawRuns(ThreadRenderData& data) {
+    const bool sorted = depthMode == DepthMode::Sorted;
+    const SphereArrays bounds = objects.Bounds();
+    const uint32_t* meshIds = objects.MeshIds();
+    data.drawRuns.clear();
+    data.drawRuns.reserve(data.visibleCount);
+    for (size_t i = 0; i < data.visibleCount; i++) {
+        uint32_t slot = data.visibleIds[i];
+        uint32_t chunk = slot / chunkObjects;
+        float depth = sorted ? viewDepth(bounds, slot) : 0.0f;
+        if (!data.drawRuns.empty()) {
+            DrawRun& run = data.drawRuns.back();
+            bool sameLeaf = !sorted || slot / kLeafSlots == run.firstSlot / kLeafSlots;
+            if (slot == run.firstSlot + run.count && meshIds[slot] == run.mesh &&
+                    chunk == run.chunk && sameLeaf) {
+                run.count++;
+                run.depth = std::min(run.depth, depth);
+                continue;
             }
         }
-        
-        wgpu::RenderBundleEncoder encoder;
-        {
-            wgpu::TextureFormat format = wgpu::TextureFormat::BGRA8Unorm;
-            wgpu::RenderBundleEncoderDescriptor desc{};
-            desc.colorFormatsCount = 1;
-            desc.colorFormats = &format;
+        data.drawRuns.push_back({slot, 1, meshIds[slot], chunk, depth});
+    }
+    if (sorted) {
+        std::sort(data.drawRuns.begin(), data.drawRuns.end(),
+            [](const DrawRun& a, const DrawRun& b) { return a.depth < b.depth; });
+    }
+}
 
-            std::scoped_lock lock(deviceMutex);
-            encoder = device.CreateRenderBundleEncoder(&desc);
+void cullStage(ThreadRenderData& data) {
+    AllocationScope allocationScope(&frameLoopAllocations);
+    data.visibleIds.resize(data.objectCount);
+
+    // Decide if should draw object
+    // Mimic culling, LOD, etc. Equivalent to ifObjectShouldDraw() on each object.
+    // Whole tiles are accepted or rejected before any per-object test.
+    // Only the bounds streams (and visibility bits) of the object store are read.
+    if (frustumCulling) {
+        FrustumCullRegion region(frameFrustum, objects.Bounds());
+        data.visibleCount = tileHierarchy.Cull(region, data.firstObjectId,
+            data.objectCount, data.visibleIds.data());
+    } else {
+        DiamondCullRegion region({focusPointX, focusPointY, cullRadius}, objects.Bounds());
+        data.visibleCount = tileHierarchy.Cull(region, data.firstObjectId,
+            data.objectCount, data.visibleIds.data());
+    }
+    data.visibleCount = objects.FilterVisible(data.visibleIds.data(), data.visibleCount);
+    buildDrawRuns(data);
+}
+
+// Draws the visible runs of |data|, in order, with the current pipeline and mesh pool
+// buffers. Binds each run's object chunk unless it is |*boundChunk| (kNoChunk when
+// nothing is bound yet), which it updates. Instance indices are relative to the chunk.
+template <typename Encoder>
+void encodeVisibleDraws(Encoder& encoder, const ThreadRenderData& data,
+        uint32_t* boundChunk) {
+    for (const DrawRun& run : data.drawRuns) {
+        if (run.chunk != *boundChunk) {
+            bindObjectChunk(encoder, run.chunk);
+            *boundChunk = run.chunk;
         }
+        const MeshPool::Mesh& mesh = meshPool->Get(run.mesh);
+        encoder.DrawIndexed(mesh.indexCount, run.count, mesh.firstIndex, mesh.baseVertex,
+            run.firstSlot - run.chunk * chunkObjects);
+    }
+}
 
-        encoder.SetPipeline(pipeline);
-        encoder.SetBindGroup(0, uniformBindGroup);
+// --encoding=bundles
+void encodeBundleStage(ThreadRenderData& data) {
+    if (data.visibleCount == 0) {
+        // Whole partition culled; pass assembly skips invalid handles.
+        renderBundles[data.threadIdx].value = bundleTable.kInvalidHandle;
+        return;
+    }
 
-        for (size_t id : data.objectIds) {
-            // Decide if should draw object
-            // Mimic culling, LOD, etc.
-            if (ifObjectShouldDraw(id)) {
-                encoder.Draw(kDrawVertexCount, 1, 0, id);
-            }
-        }
-        renderBundles[data.threadIdx] = encoder.Finish();
+    wgpu::RenderBundleEncoder encoder;
+    {
+        wgpu::RenderBundleEncoderDescriptor desc{};
+        desc.colorFormatsCount = 1;
+        desc.colorFormats = &swapChainFormat;
+        desc.depthStencilFormat = depthFormat();
 
+        std::scoped_lock lock(deviceMutex);
+        encoder = device.CreateRenderBundleEncoder(&desc);
+    }
+
+    // Lock-free cache hit; the main thread only picks keys that are already compiled.
+    encoder.SetPipeline(*pipelineCache->Find(*framePipelineKey));
+    meshPool->Bind(encoder);
+    uint32_t boundChunk = kNoChunk;
+    encodeVisibleDraws(encoder, data, &boundChunk);
+    renderBundles[data.threadIdx].value = bundleTable.Register(encoder.Finish());
+}
+
+// --encoding=passes
+void encodePassStage(ThreadRenderData& data) {
+    if (data.visibleCount == 0) {
+        workerCommands[data.threadIdx].value = nullptr;
+        return;
+    }
+
+    wgpu::CommandEncoder encoder;
+    {
+        std::scoped_lock lock(deviceMutex);
+        encoder = device.CreateCommandEncoder();
+    }
+
+    // Same targets as the frame's pass, but keeping what was drawn before.
+    wgpu::RenderPassColorAttachment attachment = frameRenderPass->colorAttachments[0];
+    attachment.loadOp = wgpu::LoadOp::Load;
+    wgpu::RenderPassDescriptor renderPass = *frameRenderPass;
+    renderPass.colorAttachments = &attachment;
+    wgpu::RenderPassDepthStencilAttachment depthAttachment;
+    if (frameRenderPass->depthStencilAttachment) {
+        depthAttachment = *frameRenderPass->depthStencilAttachment;
+        depthAttachment.depthLoadOp = wgpu::LoadOp::Load;
+        renderPass.depthStencilAttachment = &depthAttachment;
+    }
+
+    wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
+    beginOverdrawQuery(pass, 1 + data.threadIdx);
+    pass.SetPipeline(*pipelineCache->Find(*framePipelineKey));
+    meshPool->Bind(pass);
+    uint32_t boundChunk = kNoChunk;
+    encodeVisibleDraws(pass, data, &boundChunk);
+    endOverdrawQuery(pass);
+    pass.End();
+    workerCommands[data.threadIdx].value = encoder.Finish();
+}
+
+// Records the frame's render pass: executes the workers' bundles, encodes every draw
+// itself, or only clears, depending on encodingStrategy. With passes, the workers'
+// command buffers are queued after it.
+void passAssemblyStage() {
+    std::scoped_lock lock(deviceMutex);
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(frameRenderPass);
+    beginOverdrawQuery(pass, 0);
+    switch (encodingStrategy) {
+        case EncodingStrategy::Bundles:
+            for (const CacheLinePadded<BundleHandle>& slot : renderBundles) {
+                if (wgpu::RenderBundle bundle = bundleTable.Take(slot.value)) {
+                    frameBundles.push_back(std::move(bundle));
+                }
+            }
+            pass.ExecuteBundles(frameBundles.size(), frameBundles.data());
+            frameBundles.clear();
+            break;
+        case EncodingStrategy::Single:
         {
-            std::scoped_lock lock(data.m);
-            data.rendering = false;
-            // printf("Thread %u notify\n", data.threadIdx);
-            // renderthreadsFinished++;
-            data.condition.notify_one();
+            pass.SetPipeline(*pipelineCache->Find(*framePipelineKey));
+            meshPool->Bind(pass);
+            uint32_t boundChunk = kNoChunk;
+            for (uint32_t i = 0; i < numThreads; i++) {
+                encodeVisibleDraws(pass, threadData[i], &boundChunk);
+            }
+            break;
+        }
+        case EncodingStrategy::Passes:
+            break;
+    }
+    endOverdrawQuery(pass);
+    pass.End();
+    frameCommands.push_back(encoder.Finish());
+
+    if (encodingStrategy == EncodingStrategy::Passes) {
+        for (CacheLinePadded<wgpu::CommandBuffer>& slot : workerCommands) {
+            if (slot.value) {
+                frameCommands.push_back(std::move(slot.value));
+                slot.value = nullptr;
+            }
         }
+    }
+}
 
+void submitStage() {
+    std::scoped_lock lock(deviceMutex);
+    if (overdrawFrame) {
+        wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+        encodeOverdrawResolve(encoder);
+        frameCommands.push_back(encoder.Finish());
     }
+    queue.Submit(frameCommands.size(), frameCommands.data());
+    frameCommands.clear();
 }
 
-void setupThreads() {
-    size_t objectId = 0;
+// Pins (or unpins) every pool thread according to |policy|, from the threads themselves.
+void applyWorkerAffinity(const AffinityPolicy& policy) {
+    std::vector<int> cpus = policy.CpuOrder();
+    for (uint32_t i = 0; i < numThreads; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        threadPool.threads[i]->addJob([i, cpu] {
+            if (!PinCurrentThread(cpu) && cpu >= 0) {
+                printf("[threads] could not pin render worker %u to CPU %d\n", i, cpu);
+            }
+        });
+    }
+    threadPool.wait();
+}
 
+void setupThreads() {
+    threadData.reset(new ThreadRenderData[numThreads]);
+    renderBundles.resize(numThreads);
+    workerCommands.resize(numThreads);
+    frameBundles.reserve(numThreads);
+    // The frame's pass, the workers' and the overdraw query resolve.
+    frameCommands.reserve(numThreads + 2);
     for (uint32_t i = 0; i < numThreads; i++) {
+        // Even split; partitions are leaf aligned (16 slots) when numThreads divides
+        // numInstances / 16, and otherwise may start or end inside a leaf.
+        uint32_t first = (uint64_t)i * numInstances / numThreads;
+        uint32_t end = (uint64_t)(i + 1) * numInstances / numThreads;
         threadData[i].threadIdx = i;
-        for (size_t j = 0; j < numObjectsPerThread; j++) {
-            threadData[i].objectIds.push_back(objectId++);
-        }
+        threadData[i].firstObjectId = first;
+        threadData[i].objectCount = end - first;
     }
 
+    threadPool.setThreadCount(numThreads);
     for (uint32_t i = 0; i < numThreads; i++) {
-        renderThreads.emplace_back(threadRenderFunc, std::ref(threadData[i]));
+        threadPool.threads[i]->addJob([i] {
+            // Short enough for Linux's 15-character thread names at any thread count.
+            char name[16];
+            snprintf(name, sizeof(name), "render %u", i);
+            SetCurrentThreadName(name);
+            SetAllocationThreadName(name);
+        });
     }
-}
-
-void multiThreadedRender(wgpu::TextureView view, wgpu::RenderPassDescriptor renderpass) {
-    for (ThreadRenderData& d : threadData) {
-        // d.renderpass = threadRenderpass;
-        if (d.rendering == false) {
-            d.rendering = true;
-            d.condition.notify_one();
+    applyWorkerAffinity(workerAffinity);
+
+    // update -> cull[i] -> encode[i] -> pass assembly -> submit
+    // Each cull/encode chain stays on pool thread i; assembly and submit run on the
+    // thread that called frameGraph.Run(), which owns the queue. --encoding=single has
+    // no encode jobs: pass assembly waits for the culls and encodes the draws itself.
+    JobGraph::JobId update = frameGraph.AddJob("update", updateFrameState);
+    void (*encodeStage)(ThreadRenderData&) = encodingStrategy == EncodingStrategy::Passes
+        ? encodePassStage : encodeBundleStage;
+    std::vector<JobGraph::JobId> workerJobs;
+    for (uint32_t i = 0; i < numThreads; i++) {
+        ThreadRenderData* data = &threadData[i];
+        JobGraph::JobId cull = frameGraph.AddJob("cull", [data] { cullStage(*data); }, {update}, i);
+        if (encodingStrategy == EncodingStrategy::Single) {
+            workerJobs.push_back(cull);
+        } else {
+            workerJobs.push_back(frameGraph.AddJob("encode",
+                [data, encodeStage] { encodeStage(*data); }, {cull}, i));
         }
     }
+    JobGraph::JobId assembly = frameGraph.AddJob("pass assembly", passAssemblyStage, workerJobs, JobGraph::kCallingThread);
+    frameGraph.AddJob("submit", submitStage, {assembly}, JobGraph::kCallingThread);
+}
 
-    // Blocking on main thread (bad for web)
+// Recycles the per-thread arenas once every stage of the frame has finished. The first
+// frames grow them to their working size; after that, frames don't touch the heap.
+void resetFrameScratch() {
+    AllocationScope allocationScope(&frameLoopAllocations);
+    frameArenaBytes = 0;
     for (uint32_t i = 0; i < numThreads; i++) {
-        std::unique_lock<std::mutex> lock(threadData[i].m);
-        threadData[i].condition.wait(lock, [=]{ return threadData[i].rendering == false;});
+        ThreadRenderData& data = threadData[i];
+        // Drop the last pointer into the arena before recycling it.
+        data.visibleIds = FrameVector<uint32_t>(FrameAllocator<uint32_t>(&data.arena));
+        data.drawRuns = FrameVector<DrawRun>(FrameAllocator<DrawRun>(&data.arena));
+        data.arena.Reset();
+        frameArenaBytes += data.arena.Capacity();
     }
+}
 
-    {
-        std::scoped_lock lock(deviceMutex);       
-
-#ifdef __EMSCRIPTEN__
-        bool threadStillRendering = false;
-        for (uint32_t i = 0; i < numThreads; i++) {
-            threadStillRendering |= threadData[i].rendering;
-        }
-        if (!threadStillRendering) {
-            wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
-            wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderpass);
-            pass.ExecuteBundles(renderBundles.size(), renderBundles.data());
-            pass.End();
-            wgpu::CommandBuffer commands = encoder.Finish();
-            queue.Submit(1, &commands);
-        }
-#else
+void multiThreadedRender(wgpu::TextureView view, wgpu::RenderPassDescriptor renderpass) {
+    if (!framePipelineKey) {
+        // Nothing has compiled yet; still clear and submit so the frame loop keeps running.
+        updateFrameState();
+        std::scoped_lock lock(deviceMutex);
         wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
         wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderpass);
-        pass.ExecuteBundles(renderBundles.size(), renderBundles.data());
         pass.End();
         wgpu::CommandBuffer commands = encoder.Finish();
         queue.Submit(1, &commands);
-#endif
+        return;
     }
+
+    // Blocking on main thread (bad for web)
+    frameRenderPass = &renderpass;
+    frameGraph.Run(threadPool);
+    frameRenderPass = nullptr;
+
+    resetFrameScratch();
 }
 
 #else
 
 void render(wgpu::TextureView view, wgpu::RenderPassDescriptor renderpass) {
+    updateFrameState();
+
     wgpu::CommandBuffer commands;
     {
         wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
         {
             wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderpass);
-            pass.SetPipeline(pipeline);
-            pass.SetBindGroup(0, uniformBindGroup);
-            // pass.Draw(kDrawVertexCount);
-            pass.Draw(kDrawVertexCount, kNumInstances, 0, 0);
+            beginOverdrawQuery(pass, 0);
+            if (framePipelineKey) {
+                pass.SetPipeline(*pipelineCache->Find(*framePipelineKey));
+                meshPool->Bind(pass);
+                // One instanced draw per run of slots sharing a mesh and a chunk.
+                const uint32_t* meshIds = objects.MeshIds();
+                uint32_t runStart = 0;
+                for (uint32_t i = 1; i <= numInstances; i++) {
+                    if (i == numInstances || meshIds[i] != meshIds[runStart] ||
+                            i % chunkObjects == 0) {
+                        uint32_t chunk = runStart / chunkObjects;
+                        if (runStart % chunkObjects == 0) {
+                            bindObjectChunk(pass, chunk);
+                        }
+                        const MeshPool::Mesh& mesh = meshPool->Get(meshIds[runStart]);
+                        pass.DrawIndexed(mesh.indexCount, i - runStart, mesh.firstIndex,
+                            mesh.baseVertex, runStart - chunk * chunkObjects);
+                        runStart = i;
+                    }
+                }
+            }
+            endOverdrawQuery(pass);
             pass.End();
         }
+        if (overdrawFrame) {
+            encodeOverdrawResolve(encoder);
+        }
         commands = encoder.Finish();
     }
     queue.Submit(1, &commands);
@@ -837,43 +1627,95 @@ void render(wgpu::TextureView view, wgpu::RenderPassDescriptor renderpass) {
 
 #endif  // MULTITHREADED_RENDERING
 
-void issueContentsCheck(const char* functionName,
-        wgpu::Buffer readbackBuffer, uint32_t expectData) {
-    struct UserData {
-        const char* functionName;
-        wgpu::Buffer readbackBuffer;
-        uint32_t expectData;
-    };
+// A readback of 4 bytes at |readback| that should hold |expectData|.
+struct ContentsCheck {
+    const char* functionName;
+    BufferSlice readback;
+    uint32_t expectData;
+};
+static std::vector<ContentsCheck> pendingContentsChecks;
 
-    UserData* userdata = new UserData;
-    userdata->functionName = functionName;
-    userdata->readbackBuffer = readbackBuffer;
-    userdata->expectData = expectData;
+// Queues a check; flushContentsChecks() maps the readback buffers.
+void issueContentsCheck(const char* functionName,
+        const BufferSlice& readback, uint32_t expectData) {
+    pendingContentsChecks.push_back({functionName, readback, expectData});
+}
 
-    readbackBuffer.MapAsync(
-        wgpu::MapMode::Read, 0, 4,
-        [](WGPUBufferMapAsyncStatus status, void* vp_userdata) {
-            assert(status == WGPUBufferMapAsyncStatus_Success);
-            std::unique_ptr<UserData> userdata(reinterpret_cast<UserData*>(vp_userdata));
+// Maps each buffer with pending checks once, over the range that covers all of them,
+// instead of once per check. Then moves the readback allocator on to its next slot.
+// Does nothing while that slot's earlier maps are outstanding: the checks stay pending,
+// and their slot keeps taking copies, which is valid as long as it isn't mapped.
+void flushContentsChecks() {
+    const uint32_t slot = readbackAllocator->CurrentSlot();
+    const uint32_t nextSlot = (slot + 1) % kReadbackSlots;
+    if (pendingContentsChecks.empty() || readbackSlotMaps[nextSlot] > 0) {
+        return;
+    }
 
-            const void* ptr = userdata->readbackBuffer.GetConstMappedRange();
+    struct UserData {
+        wgpu::Buffer buffer;
+        uint32_t slot;
+        std::vector<ContentsCheck> checks;
+    };
 
-            printf("%s: readback -> %p%s\n", userdata->functionName,
-                    ptr, ptr ? "" : " <------- FAILED");
-            assert(ptr != nullptr);
-            uint32_t readback = static_cast<const uint32_t*>(ptr)[0];
-            printf("  got %08x, expected %08x%s\n",
-                readback, userdata->expectData,
-                readback == userdata->expectData ? "" : " <------- FAILED");
-            userdata->readbackBuffer.Unmap();
+    std::vector<ContentsCheck> checks = std::move(pendingContentsChecks);
+    pendingContentsChecks.clear();
+    std::stable_sort(checks.begin(), checks.end(),
+        [](const ContentsCheck& a, const ContentsCheck& b) {
+            return a.readback.buffer.Get() < b.readback.buffer.Get();
+        });
+    for (size_t first = 0; first < checks.size();) {
+        size_t last = first;
+        uint64_t begin = checks[first].readback.offset;
+        uint64_t end = begin + 4;
+        while (last + 1 < checks.size() &&
+                checks[last + 1].readback.buffer.Get() == checks[first].readback.buffer.Get()) {
+            last++;
+            begin = std::min(begin, checks[last].readback.offset);
+            end = std::max(end, checks[last].readback.offset + 4);
+        }
+        // MapAsync needs an offset aligned to 8 and a size aligned to 4.
+        begin &= ~uint64_t(7);
+        end = (end + 3) & ~uint64_t(3);
+
+        UserData* userdata = new UserData;
+        userdata->buffer = checks[first].readback.buffer;
+        userdata->slot = slot;
+        readbackSlotMaps[slot]++;
+        userdata->checks.assign(checks.begin() + first, checks.begin() + last + 1);
+        userdata->buffer.MapAsync(
+            wgpu::MapMode::Read, begin, end - begin,
+            [](WGPUBufferMapAsyncStatus status, void* vp_userdata) {
+                assert(status == WGPUBufferMapAsyncStatus_Success);
+                std::unique_ptr<UserData> userdata(reinterpret_cast<UserData*>(vp_userdata));
+
+                for (const ContentsCheck& check : userdata->checks) {
+                    const void* ptr =
+                        userdata->buffer.GetConstMappedRange(check.readback.offset, 4);
+
+                    printf("%s: readback -> %p%s\n", check.functionName,
+                            ptr, ptr ? "" : " <------- FAILED");
+                    assert(ptr != nullptr);
+                    uint32_t readback = static_cast<const uint32_t*>(ptr)[0];
+                    printf("  got %08x, expected %08x%s\n",
+                        readback, check.expectData,
+                        readback == check.expectData ? "" : " <------- FAILED");
+                }
+                userdata->buffer.Unmap();
+                readbackSlotMaps[userdata->slot]--;
+
+                testsCompleted += static_cast<int>(userdata->checks.size());
+            }, userdata);
+        first = last + 1;
+    }
 
-            testsCompleted++;
-        }, userdata);
+    readbackAllocator->BeginSlot(nextSlot);
 }
 
 void doCopyTestMappedAtCreation(bool useRange) {
     static constexpr uint32_t kValue = 0x05060708;
     size_t size = useRange ? 12 : 4;
+    // A dedicated buffer: mappedAtCreation is what this tests.
     wgpu::Buffer src;
     {
         wgpu::BufferDescriptor descriptor{};
@@ -892,18 +1734,13 @@ void doCopyTestMappedAtCreation(bool useRange) {
     *ptr = kValue;
     src.Unmap();
 
-    wgpu::Buffer dst;
-    {
-        wgpu::BufferDescriptor descriptor{};
-        descriptor.size = 4;
-        descriptor.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
-        dst = device.CreateBuffer(&descriptor);
-    }
+    BufferSlice dst = readbackAllocator->Allocate(4, 8);
+    assert(dst.buffer);
 
     wgpu::CommandBuffer commands;
     {
         wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
-        encoder.CopyBufferToBuffer(src, offset, dst, 0, 4);
+        encoder.CopyBufferToBuffer(src, offset, dst.buffer, dst.offset, 4);
         commands = encoder.Finish();
     }
     queue.Submit(1, &commands);
@@ -911,17 +1748,13 @@ void doCopyTestMappedAtCreation(bool useRange) {
     issueContentsCheck(__FUNCTION__, dst, kValue);
 }
 
+// Run one at a time: the sources share an upload buffer, which maps as a whole.
 void doCopyTestMapAsync(bool useRange) {
     static constexpr uint32_t kValue = 0x01020304;
     size_t size = useRange ? 12 : 4;
-    wgpu::Buffer src;
-    {
-        wgpu::BufferDescriptor descriptor{};
-        descriptor.size = size;
-        descriptor.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
-        src = device.CreateBuffer(&descriptor);
-    }
-    size_t offset = useRange ? 8 : 0;
+    BufferSlice src = uploadAllocator->Allocate(size, 8);
+    assert(src.buffer);
+    size_t offset = src.offset + (useRange ? 8 : 0);
 
     struct UserData {
         const char* functionName;
@@ -934,34 +1767,29 @@ void doCopyTestMapAsync(bool useRange) {
     userdata->functionName = __FUNCTION__;
     userdata->useRange = useRange;
     userdata->offset = offset;
-    userdata->src = src;
+    userdata->src = src.buffer;
 
-    src.MapAsync(wgpu::MapMode::Write, offset, 4,
+    src.buffer.MapAsync(wgpu::MapMode::Write, offset, 4,
         [](WGPUBufferMapAsyncStatus status, void* vp_userdata) {
             assert(status == WGPUBufferMapAsyncStatus_Success);
             std::unique_ptr<UserData> userdata(reinterpret_cast<UserData*>(vp_userdata));
 
-            uint32_t* ptr = static_cast<uint32_t*>(userdata->useRange ?
-                    userdata->src.GetMappedRange(userdata->offset, 4) :
-                    userdata->src.GetMappedRange());
+            uint32_t* ptr = static_cast<uint32_t*>(
+                    userdata->src.GetMappedRange(userdata->offset, 4));
             printf("%s: getMappedRange -> %p%s\n", userdata->functionName,
                     ptr, ptr ? "" : " <------- FAILED");
             assert(ptr != nullptr);
             *ptr = kValue;
             userdata->src.Unmap();
 
-            wgpu::Buffer dst;
-            {
-                wgpu::BufferDescriptor descriptor{};
-                descriptor.size = 4;
-                descriptor.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
-                dst = device.CreateBuffer(&descriptor);
-            }
+            BufferSlice dst = readbackAllocator->Allocate(4, 8);
+            assert(dst.buffer);
 
             wgpu::CommandBuffer commands;
             {
                 wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
-                encoder.CopyBufferToBuffer(userdata->src, userdata->offset, dst, 0, 4);
+                encoder.CopyBufferToBuffer(userdata->src, userdata->offset, dst.buffer,
+                    dst.offset, 4);
                 commands = encoder.Finish();
             }
             queue.Submit(1, &commands);
@@ -970,17 +1798,319 @@ void doCopyTestMapAsync(bool useRange) {
         }, userdata);
 }
 
-
 wgpu::SwapChain swapChain;
 const uint32_t kWidth = 512;
 const uint32_t kHeight = 512;
+// With --headless, frames render into this texture instead of the swap chain.
+static wgpu::TextureView headlessTargetView;
+// Returned from main() on native; set by checks that run at the end of the frame loop.
+static int exitCode = 0;
 
 // // temp test
 // static int remainingFrames = 5;
 
+// --depth: the depth buffer shared by every pass of a frame.
+void setupDepthTarget() {
+    wgpu::TextureDescriptor descriptor{};
+    descriptor.usage = wgpu::TextureUsage::RenderAttachment;
+    descriptor.size = {kWidth, kHeight, 1};
+    descriptor.format = kDepthFormat;
+    depthTargetView = device.CreateTexture(&descriptor).CreateView();
+}
+
+// Whole-run totals of the overdraw measurements, for the summary at exit.
+static uint32_t overdrawMeasuredFrames = 0;
+static double overdrawRunFragmentsPerPixel = 0;
+
+void setupOverdrawCounter() {
+    overdrawQueryCount = numThreads + 1;
+    {
+        wgpu::QuerySetDescriptor descriptor{};
+        descriptor.type = wgpu::QueryType::Occlusion;
+        descriptor.count = overdrawQueryCount;
+        overdrawQuerySet = device.CreateQuerySet(&descriptor);
+    }
+    wgpu::BufferDescriptor descriptor{};
+    descriptor.size = sizeof(uint64_t) * overdrawQueryCount;
+    descriptor.usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc;
+    overdrawResolveBuffer = device.CreateBuffer(&descriptor);
+    descriptor.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    overdrawReadbackBuffer = device.CreateBuffer(&descriptor);
+}
+
+// Maps the results of the measured frame that was just submitted. They are printed from
+// the map callback, which a later frame's device.Tick() delivers.
+void readBackOverdraw() {
+    overdrawReadbackPending = true;
+    std::scoped_lock lock(deviceMutex);
+    overdrawReadbackBuffer.MapAsync(wgpu::MapMode::Read, 0,
+        sizeof(uint64_t) * overdrawQueryCount,
+        [](WGPUBufferMapAsyncStatus status, void* userdata) {
+            uint32_t measuredFrame = (uint32_t)(uintptr_t)userdata;
+            overdrawReadbackPending = false;
+            if (status != WGPUBufferMapAsyncStatus_Success) {
+                printf("[overdraw] frame %u: readback failed (%d)\n", measuredFrame, status);
+                return;
+            }
+            const uint64_t* samples = static_cast<const uint64_t*>(
+                overdrawReadbackBuffer.GetConstMappedRange());
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < overdrawQueryCount; i++) {
+                total += samples[i];
+            }
+            overdrawReadbackBuffer.Unmap();
+
+            double perPixel = (double)total / (kWidth * kHeight);
+            overdrawMeasuredFrames++;
+            overdrawRunFragmentsPerPixel += perPixel;
+            printf("[overdraw] frame %u: %llu fragments passed, %.2f per pixel (depth %s)\n",
+                measuredFrame, (unsigned long long)total, perPixel,
+                kDepthModeNames[(int)depthMode]);
+        }, (void*)(uintptr_t)frameTime);
+}
+
+// Time since startup of the first present and of the first frame that drew the scene,
+// or -1 until they happen. Printed when reached and kept for --stats-json.
+static double firstPresentMs = -1;
+static double firstFrameMs = -1;
+
+// Allocation counts of the frames after options.warmupFrames, for the budget check.
+static uint64_t steadyFrames = 0;
+static uint64_t steadyAllocations = 0;
+static uint64_t steadyMaxAllocations = 0;
+
+static constexpr size_t kMaxReportedThreads = 64;
+
+// Called at the end of every frame. Counts the frame's heap allocations on all threads
+// (Dawn included) and prints a report every options.allocReport frames: allocations per
+// frame, the part made by frame-loop code outside Dawn and, with the ALLOC_TRACKER build
+// option, a per-thread breakdown and the most sampled call sites.
+void endFrameAllocationReport() {
+    static uint64_t frameStartTotal = 0;
+    static uint64_t intervalAllocations = 0;
+    static uint64_t intervalMax = 0;
+    static AllocationThreadStats intervalStartThreads[kMaxReportedThreads];
+    static size_t intervalStartThreadCount = 0;
+
+    uint64_t frameAllocations = TotalAllocationCount() - frameStartTotal;
+    intervalAllocations += frameAllocations;
+    intervalMax = std::max(intervalMax, frameAllocations);
+    if (frameTime >= (uint32_t)options.warmupFrames) {
+        steadyFrames++;
+        steadyAllocations += frameAllocations;
+        steadyMaxAllocations = std::max(steadyMaxAllocations, frameAllocations);
+    }
+
+    const uint32_t interval = (uint32_t)options.allocReport;
+    if (interval > 0 && (frameTime + 1) % interval == 0) {
+        printf("[alloc] frames %u-%u: %.1f allocations/frame (max %llu), %llu in frame-loop "
+               "code outside Dawn; frame arenas %zu bytes\n",
+            frameTime + 1 - interval, frameTime,
+            (double)intervalAllocations / interval, (unsigned long long)intervalMax,
+            (unsigned long long)frameLoopAllocations.exchange(0), frameArenaBytes);
+        intervalAllocations = 0;
+        intervalMax = 0;
+
+        if (AllocationTrackerEnabled()) {
+            AllocationThreadStats threads[kMaxReportedThreads];
+            size_t threadCount = GetAllocationThreadStats(threads, kMaxReportedThreads);
+            for (size_t i = 0; i < threadCount; i++) {
+                uint64_t previous = i < intervalStartThreadCount
+                    ? intervalStartThreads[i].allocations : 0;
+                uint64_t allocations = threads[i].allocations - previous;
+                if (allocations > 0) {
+                    printf("  %-24s %.1f allocations/frame\n",
+                        threads[i].name[0] ? threads[i].name : "(unnamed thread)",
+                        (double)allocations / interval);
+                }
+                intervalStartThreads[i] = threads[i];
+            }
+            intervalStartThreadCount = threadCount;
+            printf("  most sampled call sites so far:\n");
+            PrintAllocationSites(5);
+        }
+    }
+
+    // Taken last so the report's own allocations aren't charged to the next frame.
+    frameStartTotal = TotalAllocationCount();
+}
+
+// Frame timings; see frame_stats.h. runFrameStats covers the frames after the
+// --warmup-frames, so the exit summary and --stats-json describe the steady state only.
+// reportFrameStats covers the frames since the last --stats-report and titleFrameStats the
+// last kTitleStatsFrames frames for --stats-title.
+static FrameStats runFrameStats;
+static FrameStats reportFrameStats;
+static FrameStats titleFrameStats;
+static constexpr uint32_t kTitleStatsFrames = 60;
+static double lastFrameStartMs = -1;
+
+// |frame| is the frame the sample belongs to.
+void recordFrameTiming(FrameStats::Metric metric, uint32_t frame, double ms) {
+    if (frame >= (uint32_t)options.warmupFrames) {
+        runFrameStats.Record(metric, ms);
+    }
+    reportFrameStats.Record(metric, ms);
+    titleFrameStats.Record(metric, ms);
+}
+
+// Fences this frame's work: once the queue reports it done, its frame slot is free again
+// and its submit-to-done time is recorded. The callback runs inside device.Tick() on
+// native and from the event loop on the web, both on the main thread, so the time is
+// until the completion is observed, not until the GPU finished.
+void trackSubmittedWork(double submitMs) {
+    framesInFlight->Submitted(frameTime, submitMs);
+    std::scoped_lock lock(deviceMutex);
+    queue.OnSubmittedWorkDone(0,
+        [](WGPUQueueWorkDoneStatus status, void* userdata) {
+            uint32_t frame = (uint32_t)(uintptr_t)userdata;
+            // Counted even if the device was lost, so that nothing waits forever.
+            double ms = framesInFlight->Completed(frame, MsSinceStartup());
+            if (status == WGPUQueueWorkDoneStatus_Success) {
+                recordFrameTiming(FrameStats::kDone, frame, ms);
+            }
+        }, (void*)(uintptr_t)frameTime);
+}
+
+// Begins a frame in the next frame slot once fewer than --frames-in-flight frames are on
+// the GPU. Waits for that with --throttle=block, or returns false to skip the frame with
+// --throttle=skip. The web always skips: completions arrive from the event loop, which
+// can't run while a frame waits.
+bool beginFrameSlot() {
+    if (!framesInFlight->CanBegin()) {
+#ifdef __EMSCRIPTEN__
+        framesInFlight->RecordSkipped();
+        return false;
+#else
+        if (framesInFlight->GetPolicy() == FramesInFlight::Policy::kSkip) {
+            framesInFlight->RecordSkipped();
+            return false;
+        }
+        double startMs = MsSinceStartup();
+        while (!framesInFlight->CanBegin()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            std::scoped_lock lock(deviceMutex);
+            device.Tick();
+        }
+        framesInFlight->RecordBlocked(MsSinceStartup() - startMs);
+#endif
+    }
+    frameSlot = framesInFlight->Begin(frameTime);
+    return true;
+}
+
+// Called at the end of every frame: prints the --stats-report summary and refreshes the
+// --stats-title window title.
+void endFrameStatsReport() {
+    const uint32_t interval = (uint32_t)options.statsReport;
+    if (interval > 0 && (frameTime + 1) % interval == 0) {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "[frame-stats] frames %u-%u",
+            frameTime + 1 - interval, frameTime);
+        reportFrameStats.Print(prefix);
+        reportFrameStats.Reset();
+    }
+
+#ifndef __EMSCRIPTEN__
+    if (options.statsTitle && !options.headless && (frameTime + 1) % kTitleStatsFrames == 0) {
+        char title[160];
+        titleFrameStats.FormatTitle(title, sizeof(title));
+        window_set_title(native_window, title);
+        titleFrameStats.Reset();
+    }
+#endif
+}
+
+// --stats-json: the whole-run summary with the configuration it was measured under, as a
+// single line starting with '{'.
+void printStatsJson() {
+#if defined(MULTITHREADED_RENDERING)
+    uint32_t threads = numThreads;
+#else
+    uint32_t threads = 1;
+#endif
+    printf("{\"grid\":%u,\"objects\":%u,\"threads\":%u,\"encoding\":\"%s\",\"cull\":\"%s\","
+           "\"bindChunk\":%u,\"frames\":%u,\"stats\":",
+        quadPerRow, numInstances, threads, kEncodingStrategyNames[(int)encodingStrategy],
+        frustumCulling ? "frustum" : "diamond", bindChunkObjects, frameTime);
+    runFrameStats.PrintJson();
+    // null for a milestone the run never reached.
+    auto printMs = [](const char* name, double ms) {
+        if (ms < 0) {
+            printf("\"%s\":null", name);
+        } else {
+            printf("\"%s\":%.3f", name, ms);
+        }
+    };
+    printf(",\"startup\":{");
+    printMs("firstPresentMs", firstPresentMs);
+    printf(",");
+    printMs("firstFrameMs", firstFrameMs);
+    printf("}");
+#if defined(MOCK_WEBGPU)
+    MockWebGPUStats mock = MockWebGPUGetStats();
+    printf(",\"mock\":{\"draws\":%llu,\"instances\":%llu,\"bindGroupChanges\":%llu,"
+           "\"commands\":%llu,\"streamHash\":\"%016llx\"}",
+        (unsigned long long)mock.draws, (unsigned long long)mock.instances,
+        (unsigned long long)mock.bindGroupChanges, (unsigned long long)mock.commands,
+        (unsigned long long)mock.streamHash);
+#endif
+    printf("}\n");
+}
+
+// Returns the process exit code for the --alloc-budget gate: non-zero if a budget is
+// set and a steady-state frame exceeded it.
+int checkAllocationBudget() {
+    if (options.allocBudget < 0) {
+        return 0;
+    }
+    if (steadyFrames == 0) {
+        printf("[alloc] FAILED: no frames after the %d warm-up frames to check the budget\n",
+            options.warmupFrames);
+        return 1;
+    }
+    bool passed = steadyMaxAllocations <= (uint64_t)options.allocBudget;
+    printf("[alloc] steady state over %llu frames: %.2f allocations/frame, max %llu "
+           "(budget %d): %s\n",
+        (unsigned long long)steadyFrames, (double)steadyAllocations / steadyFrames,
+        (unsigned long long)steadyMaxAllocations, options.allocBudget,
+        passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
+
 void frame() {
+#ifndef __EMSCRIPTEN__
+    framePacer->Wait();
+    {
+        // Delivers CreateRenderPipelineAsync and OnSubmittedWorkDone callbacks (on the web
+        // the event loop does this).
+        std::scoped_lock lock(deviceMutex);
+        device.Tick();
+    }
+#endif
+    if (!beginFrameSlot()) {
+        return;
+    }
+#ifndef __EMSCRIPTEN__
+    framePacer->FrameBegan();
+#endif
 
-    wgpu::TextureView backbuffer = swapChain.GetCurrentTextureView();
+    double frameStartMs = MsSinceStartup();
+    if (lastFrameStartMs >= 0) {
+        recordFrameTiming(FrameStats::kFrame, frameTime, frameStartMs - lastFrameStartMs);
+    }
+    lastFrameStartMs = frameStartMs;
+
+    advanceAnimation();
+#ifndef __EMSCRIPTEN__
+    // The render threads are idle until the frame graph runs.
+    CaptureWebGPUFrame(frameTime, focusPointX, focusPointY, cullRadius);
+#endif
+    double encodeStartMs = MsSinceStartup();
+    framePipelineKey = pickReadyPipelineKey();
+
+    wgpu::TextureView backbuffer = options.headless
+        ? headlessTargetView : swapChain.GetCurrentTextureView();
 
     wgpu::RenderPassColorAttachment attachment{};
     attachment.view = backbuffer;
@@ -992,11 +2122,38 @@ void frame() {
     renderpass.colorAttachmentCount = 1;
     renderpass.colorAttachments = &attachment;
 
+    wgpu::RenderPassDepthStencilAttachment depthAttachment{};
+    if (depthMode != DepthMode::Off) {
+        depthAttachment.view = depthTargetView;
+        depthAttachment.depthLoadOp = wgpu::LoadOp::Clear;
+        depthAttachment.depthStoreOp = wgpu::StoreOp::Store;
+        depthAttachment.depthClearValue = 1.0f;
+        renderpass.depthStencilAttachment = &depthAttachment;
+    }
+
+    const uint32_t overdrawInterval = (uint32_t)options.overdrawReport;
+    overdrawFrame = overdrawInterval > 0 && (frameTime + 1) % overdrawInterval == 0 &&
+        !overdrawReadbackPending && framePipelineKey;
+    if (overdrawFrame) {
+        renderpass.occlusionQuerySet = overdrawQuerySet;
+    }
+
 #if defined(MULTITHREADED_RENDERING)
     multiThreadedRender(backbuffer, renderpass);
 #else
     render(backbuffer, renderpass);
 #endif
+    if (overdrawFrame) {
+        readBackOverdraw();
+    }
+
+    double submitMs = MsSinceStartup();
+    recordFrameTiming(FrameStats::kEncode, frameTime, submitMs - encodeStartMs);
+    trackSubmittedWork(submitMs);
+#if defined(MOCK_WEBGPU)
+    // Everything recorded this frame has been submitted.
+    MockWebGPUEndFrame();
+#endif
 
 #ifdef __EMSCRIPTEN__
     // emscripten_cancel_main_loop();
@@ -1013,14 +2170,22 @@ void frame() {
     // }
 #else
     // submit_frame
-    swapChain.Present();
+    if (!options.headless) {
+        swapChain.Present();
+    }
 #endif
 
-    float t = (float)frameTime * 0.01;
-
-    focusPointX = (cosf(t) + 1.0) * 0.5 * (float)kQuadPerRow;
-    focusPointY = (sinf(2.7 * t) + 1.0) * 0.5 * (float)kQuadPerRow;
+    if (firstPresentMs < 0) {
+        firstPresentMs = MsSinceStartup();
+        printf("[startup] time-to-first-present: %.2f ms\n", firstPresentMs);
+    }
+    if (firstFrameMs < 0 && framePipelineKey) {
+        firstFrameMs = MsSinceStartup();
+        printf("[startup] time-to-first-frame: %.2f ms\n", firstFrameMs);
+    }
 
+    endFrameStatsReport();
+    endFrameAllocationReport();
     frameTime++;
 }
 
@@ -1086,7 +2251,7 @@ void doMultithreadingBufferTest() {
     printf("After Thread\n");
 
     for (auto& arg : threadArgs) {
-        issueContentsCheck(__FUNCTION__, arg.buffer, arg.value);
+        issueContentsCheck(__FUNCTION__, BufferSlice{arg.buffer, 0, 4}, arg.value);
     }
 }
 
@@ -1130,6 +2295,15 @@ static void setup_window()
 //   input_set_callbacks(context->window, context->callbacks);
 }
 
+static const char* PresentModeName(wgpu::PresentMode mode) {
+    for (const auto& entry : kPresentModes) {
+        if (entry.mode == mode) {
+            return entry.name;
+        }
+    }
+    return "unknown";
+}
+
 void wgpu_setup_swap_chain()
 {
 //   /* Create the swap chain */
@@ -1151,13 +2325,17 @@ void wgpu_setup_swap_chain()
 //   /* Find a suitable depth format */
 //   wgpu_context->swap_chain.format = swap_chain_descriptor.format;
 
+    // Dawn doesn't report the mode it ends up using: its backends fall back to a supported
+    // one (immediate to mailbox to fifo) without an error, so only the request is logged.
     wgpu::SwapChainDescriptor scDesc{};
-        scDesc.usage = wgpu::TextureUsage::RenderAttachment;
-        scDesc.format = wgpu::TextureFormat::BGRA8Unorm;
-        scDesc.width = kWidth;
-        scDesc.height = kHeight;
-        scDesc.presentMode = wgpu::PresentMode::Fifo;
-        swapChain = device.CreateSwapChain(surface, &scDesc);
+    scDesc.usage = wgpu::TextureUsage::RenderAttachment;
+    scDesc.format = swapChainFormat;
+    scDesc.width = kWidth;
+    scDesc.height = kHeight;
+    scDesc.presentMode = presentMode;
+    swapChain = device.CreateSwapChain(surface, &scDesc);
+    printf("[present] requested mode %s (the backend may use a supported fallback)\n",
+        PresentModeName(presentMode));
 
     // {
     //     wgpu::TextureDescriptor descriptor{};
@@ -1168,6 +2346,66 @@ void wgpu_setup_swap_chain()
     // }
 }
 
+// Renders one frame; returns false once the window has been closed.
+bool pollAndRenderFrame()
+{
+    if (!options.headless) {
+        if (window_should_close(native_window)) {
+            return false;
+        }
+        glfwPollEvents();
+    }
+    frame();
+    return true;
+}
+
+// --affinity-bench: renders --frames frames (after --warmup-frames unmeasured ones) under
+// each worker placement policy in turn and prints frame time percentiles per policy.
+void runAffinityBenchmark()
+{
+#if defined(MULTITHREADED_RENDERING)
+    std::vector<AffinityPolicy> policies(3);
+    AffinityPolicy::Parse("none", &policies[0]);
+    AffinityPolicy::Parse("compact", &policies[1]);
+    AffinityPolicy::Parse("scatter", &policies[2]);
+    if (workerAffinity.kind == AffinityPolicy::Kind::List) {
+        policies.push_back(workerAffinity);
+    }
+
+    for (const AffinityPolicy& policy : policies) {
+        applyWorkerAffinity(policy);
+        for (int i = 0; i < options.warmupFrames; i++) {
+            if (!pollAndRenderFrame()) {
+                return;
+            }
+        }
+
+        LatencyHistogram frameMs;
+        for (int i = 0; i < options.frames; i++) {
+            double start = MsSinceStartup();
+            if (!pollAndRenderFrame()) {
+                return;
+            }
+            frameMs.Record(MsSinceStartup() - start);
+        }
+        LatencyHistogram::Summary summary = frameMs.Summarize();
+        printf("[affinity-bench] %-10s p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+            policy.ToString().c_str(), summary.p50, summary.p90, summary.p99, summary.max);
+    }
+    applyWorkerAffinity(workerAffinity);
+#endif
+}
+
+// Stands in for the swap chain in headless runs: same size and format, never presented.
+void setupHeadlessTarget()
+{
+    wgpu::TextureDescriptor descriptor{};
+    descriptor.usage = wgpu::TextureUsage::RenderAttachment;
+    descriptor.size = {kWidth, kHeight, 1};
+    descriptor.format = swapChainFormat;
+    headlessTargetView = device.CreateTexture(&descriptor).CreateView();
+}
+
 #endif
 
 
@@ -1177,6 +2415,7 @@ static constexpr int kNumTests = 1;
 
 #ifdef __EMSCRIPTEN__
 void testFrame() {
+    flushContentsChecks();
     if (testsCompleted >= kNumTests) {
         printf("Tests done, emscripten cancel main loop");
         emscripten_cancel_main_loop();
@@ -1198,6 +2437,8 @@ void run() {
     // }
 #else
     while (testsCompleted < kNumTests) {
+        // Checks issued since the last tick (including from map callbacks) share maps.
+        flushContentsChecks();
         device.Tick();
     }
 #endif
@@ -1219,54 +2460,101 @@ void run() {
 
         wgpu::SwapChainDescriptor scDesc{};
         scDesc.usage = wgpu::TextureUsage::RenderAttachment;
-        scDesc.format = wgpu::TextureFormat::BGRA8Unorm;
+        scDesc.format = swapChainFormat;
         scDesc.width = kWidth;
         scDesc.height = kHeight;
         scDesc.presentMode = wgpu::PresentMode::Fifo;
         swapChain = device.CreateSwapChain(surface, &scDesc);
     }
+    if (depthMode != DepthMode::Off) {
+        setupDepthTarget();
+    }
+    if (options.overdrawReport > 0) {
+        setupOverdrawCounter();
+    }
 
 #if defined(MULTITHREADED_RENDERING)
     setupThreads();
 #endif
 
-    emscripten_set_main_loop(frame, 0, false);
+    startSimulation();
+    // The browser paces the main loop; a target rate switches it from requestAnimationFrame
+    // to timers.
+    emscripten_set_main_loop(frame, options.targetFps, false);
 
     // while(program_running) {
     //     emscripten_sleep(10000);
     // }
 #else
 
-    setup_window();
+    if (options.headless) {
+        setupHeadlessTarget();
+    } else {
+        setup_window();
 
-    // wgpu_context->surface.instance = window_get_surface(native_window);
-    window_get_surface(native_window);
-    // window_get_size(native_window, &wgpu_context->surface.width,
-    //                 &wgpu_context->surface.height);
-    wgpu_setup_swap_chain();
+        // wgpu_context->surface.instance = window_get_surface(native_window);
+        window_get_surface(native_window);
+        // window_get_size(native_window, &wgpu_context->surface.width,
+        //                 &wgpu_context->surface.height);
+        wgpu_setup_swap_chain();
+    }
+    if (depthMode != DepthMode::Off) {
+        setupDepthTarget();
+    }
+    if (options.overdrawReport > 0) {
+        setupOverdrawCounter();
+    }
 
 #if defined(MULTITHREADED_RENDERING)
     setupThreads();
 #endif
     // render_loop();
 
-    while (!window_should_close(native_window)) {
-
-        glfwPollEvents();
-
-        frame();
+    startSimulation();
+    if (options.affinityBench) {
+        runAffinityBenchmark();
+    } else {
+        while (options.frames == 0 || frameTime < (uint32_t)options.frames) {
+            if (!pollAndRenderFrame()) {
+                break;
+            }
+        }
     }
 
     program_running = false;
+    if (simulationThread) {
+        simulationThread->Stop();
+    }
 
 #if defined(MULTITHREADED_RENDERING)
-    for (ThreadRenderData& d : threadData) {
-        d.condition.notify_one();
-    }
-    for (std::thread& t : renderThreads) {
-        t.join();
+    // Waits for queued jobs, then joins the workers.
+    threadPool.setThreadCount(0);
+#endif
+
+    CaptureWebGPUEnd();
+    runFrameStats.Print("[frame-stats] run");
+    framesInFlight->Print("[frames-in-flight]");
+    framePacer->Print("[pacing]");
+    printSimulationStats();
+    if (overdrawMeasuredFrames > 0) {
+        printf("[overdraw] run: %.2f fragments per pixel over %u measured frames "
+               "(depth %s, overlap %u)\n",
+            overdrawRunFragmentsPerPixel / overdrawMeasuredFrames, overdrawMeasuredFrames,
+            kDepthModeNames[(int)depthMode], quadOverlap);
     }
+    storagePool->PrintStats("[buffers]", "storage");
+    // The scene's meshes are only ever added, so this shows the final utilisation of an
+    // unfragmented pool; fragmentation under churn is measured by bench_kernels'
+    // mesh_churn.
+    meshPool->PrintStats("[geometry]");
+#if defined(MOCK_WEBGPU)
+    MockWebGPUPrintStats("[mock]");
 #endif
+    if (options.statsJson) {
+        printStatsJson();
+    }
+
+    exitCode = checkAllocationBudget();
 
 #endif
 
@@ -1274,7 +2562,134 @@ void run() {
 
 #endif // RUN_TESTS
 
-int main() {
+int main(int argc, char** argv) {
+    if (!ParseOptions(argc, argv, &options)) {
+        return options.help ? 0 : 1;
+    }
+    if (options.cull == "frustum") {
+        frustumCulling = true;
+    } else if (!options.cull.empty() && options.cull != "diamond") {
+        printf("Unknown --cull mode: %s\n", options.cull.c_str());
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.threads < 1 || options.threads > (int)kMaxThreads) {
+        printf("--threads must be in [1, %u]\n", kMaxThreads);
+        return 1;
+    }
+    numThreads = (uint32_t)options.threads;
+    if (options.grid < 1 || options.grid > (int)kMaxQuadPerRow) {
+        printf("--grid must be in [1, %u]\n", kMaxQuadPerRow);
+        return 1;
+    }
+    quadPerRow = (uint32_t)options.grid;
+    numInstances = quadPerRow * quadPerRow;
+    if (!options.depth.empty()) {
+        size_t i = 0;
+        while (i < std::size(kDepthModeNames) && options.depth != kDepthModeNames[i]) {
+            i++;
+        }
+        if (i == std::size(kDepthModeNames)) {
+            printf("Unknown --depth: %s\n", options.depth.c_str());
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        depthMode = (DepthMode)i;
+    }
+    if (options.overlap < 1 || options.overlap > 16) {
+        printf("--overlap must be in [1, 16]\n");
+        return 1;
+    }
+    quadOverlap = (uint32_t)options.overlap;
+    if (options.bindChunk < 0) {
+        printf("--bind-chunk must be 0 or more\n");
+        return 1;
+    }
+    bindChunkObjects = (uint32_t)options.bindChunk;
+    if (options.framesInFlight < 1 || options.framesInFlight > (int)kMaxFramesInFlight) {
+        printf("--frames-in-flight must be in [1, %u]\n", kMaxFramesInFlight);
+        return 1;
+    }
+    FramesInFlight::Policy throttlePolicy = FramesInFlight::Policy::kBlock;
+    if (options.throttle == "skip") {
+        throttlePolicy = FramesInFlight::Policy::kSkip;
+    } else if (!options.throttle.empty() && options.throttle != "block") {
+        printf("Unknown --throttle: %s\n", options.throttle.c_str());
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    framesInFlight = std::make_unique<FramesInFlight>((uint32_t)options.framesInFlight,
+        throttlePolicy);
+    if (!options.presentMode.empty()) {
+        size_t i = 0;
+        while (i < std::size(kPresentModes) && options.presentMode != kPresentModes[i].name) {
+            i++;
+        }
+        if (i == std::size(kPresentModes)) {
+            printf("Unknown --present-mode: %s\n", options.presentMode.c_str());
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        presentMode = kPresentModes[i].mode;
+    }
+    if (options.targetFps < 0 || options.targetFps > 1000) {
+        printf("--target-fps must be in [0, 1000]\n");
+        return 1;
+    }
+    framePacer = std::make_unique<FramePacer>((double)options.targetFps);
+    if (options.simRate < 0 || options.simRate > 1000) {
+        printf("--sim-rate must be in [0, 1000]\n");
+        return 1;
+    }
+    if (!options.encoding.empty()) {
+        size_t i = 0;
+        while (i < std::size(kEncodingStrategyNames) && options.encoding != kEncodingStrategyNames[i]) {
+            i++;
+        }
+        if (i == std::size(kEncodingStrategyNames)) {
+            printf("Unknown --encoding: %s\n", options.encoding.c_str());
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        encodingStrategy = (EncodingStrategy)i;
+#if !defined(MULTITHREADED_RENDERING)
+        if (encodingStrategy != EncodingStrategy::Single) {
+            printf("--encoding=%s needs a MULTITHREADED_RENDERING build\n", options.encoding.c_str());
+            return 1;
+        }
+#endif
+    }
+#if defined(MOCK_WEBGPU)
+    if (!options.headless) {
+        printf("MOCK_WEBGPU builds only run with --headless\n");
+        return 1;
+    }
+    if (options.overdrawReport > 0) {
+        printf("MOCK_WEBGPU builds can't measure overdraw\n");
+        return 1;
+    }
+#endif
+    if (options.headless && options.frames <= 0) {
+        printf("--headless needs --frames\n");
+        return 1;
+    }
+    if (!AffinityPolicy::Parse(options.affinity, &workerAffinity)) {
+        printf("Invalid --affinity: %s\n", options.affinity.c_str());
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.affinityBench && options.frames <= 0) {
+        printf("--affinity-bench needs --frames\n");
+        return 1;
+    }
+
+    // This thread assembles and submits every frame.
+    SetCurrentThreadName("main/submit");
+    SetAllocationThreadName("main");
+    if (options.raiseMainPriority && !RaiseCurrentThreadPriority()) {
+        printf("[threads] could not raise the main thread's priority\n");
+    }
+
     // GetDevice([](wgpu::Device dev) {
     //     device = dev;
     //     run();
@@ -1298,6 +2713,6 @@ int main() {
 #else
     GetDevice();
     run();
-    return 0;
+    return exitCode;
 #endif
 }
@@ -16,6 +16,10 @@
 
 #include <cmath>
 
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
 // namespace dusk {
 
 // static
@@ -95,6 +99,24 @@ Mat4 Mat4::Rotation(float radians, const Vec3& angle) {
 }
 
 Mat4 Mat4::operator*(const Mat4& o) const {
+#if defined(__wasm_simd128__)
+  // Column c of the result is the columns of this matrix weighted by column c
+  // of |o|.
+  const v128_t c0 = wasm_v128_load(data_ + 0);
+  const v128_t c1 = wasm_v128_load(data_ + 4);
+  const v128_t c2 = wasm_v128_load(data_ + 8);
+  const v128_t c3 = wasm_v128_load(data_ + 12);
+
+  Mat4 r;
+  for (size_t c = 0; c < 4; c++) {
+    v128_t col = wasm_f32x4_mul(c0, wasm_f32x4_splat(o.At(c, 0)));
+    col = wasm_f32x4_add(col, wasm_f32x4_mul(c1, wasm_f32x4_splat(o.At(c, 1))));
+    col = wasm_f32x4_add(col, wasm_f32x4_mul(c2, wasm_f32x4_splat(o.At(c, 2))));
+    col = wasm_f32x4_add(col, wasm_f32x4_mul(c3, wasm_f32x4_splat(o.At(c, 3))));
+    wasm_v128_store(r.data_ + c * 4, col);
+  }
+  return r;
+#else
   float r00 = At(0, 0) * o.At(0, 0) + At(1, 0) * o.At(0, 1) +
               At(2, 0) * o.At(0, 2) + At(3, 0) * o.At(0, 3);
   float r01 = At(0, 1) * o.At(0, 0) + At(1, 1) * o.At(0, 1) +
@@ -138,6 +160,7 @@ Mat4 Mat4::operator*(const Mat4& o) const {
     r20, r21, r22, r23,
     r30, r31, r32, r33};
   // clang-format on
+#endif  // defined(__wasm_simd128__)
 }
 
 // }  // namespace dusk
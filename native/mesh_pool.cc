@@ -0,0 +1,148 @@
+#include "mesh_pool.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace {
+
+constexpr uint64_t kVertexSize = 2 * sizeof(float);
+
+// Queue writes must be a multiple of 4 bytes at 4-byte offsets, so index
+// ranges start and end on even uint16 indices.
+constexpr uint32_t kIndexAlignment = 2;
+
+uint32_t AllocatedIndexCount(uint32_t indexCount) {
+  return (indexCount + kIndexAlignment - 1) & ~(kIndexAlignment - 1);
+}
+
+void PrintRangeStats(const char* prefix,
+                     const char* name,
+                     const RangeAllocator::Stats& stats) {
+  printf("%s %s: %llu/%llu used (%.1f%%), %u free blocks, largest %llu, "
+         "fragmentation %.1f%%\n",
+         prefix, name, (unsigned long long)stats.used,
+         (unsigned long long)stats.capacity, 100.0 * stats.Utilization(),
+         stats.freeBlocks, (unsigned long long)stats.largestFreeBlock,
+         100.0 * stats.Fragmentation());
+}
+
+}  // namespace
+
+MeshPool::MeshPool(wgpu::Device device,
+                   wgpu::Queue queue,
+                   std::mutex& deviceMutex,
+                   uint32_t vertexCapacity,
+                   uint32_t indexCapacity)
+    : device_(std::move(device)),
+      queue_(std::move(queue)),
+      deviceMutex_(deviceMutex),
+      vertexRanges_(vertexCapacity),
+      indexRanges_(AllocatedIndexCount(indexCapacity)) {
+  std::scoped_lock lock(deviceMutex_);
+  {
+    wgpu::BufferDescriptor descriptor{};
+    descriptor.size = kVertexSize * vertexCapacity;
+    descriptor.usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst;
+    vertexBuffer_ = device_.CreateBuffer(&descriptor);
+  }
+  {
+    wgpu::BufferDescriptor descriptor{};
+    descriptor.size = sizeof(uint16_t) * AllocatedIndexCount(indexCapacity);
+    descriptor.usage = wgpu::BufferUsage::Index | wgpu::BufferUsage::CopyDst;
+    indexBuffer_ = device_.CreateBuffer(&descriptor);
+  }
+}
+
+// static
+wgpu::VertexBufferLayout MeshPool::VertexLayout() {
+  static const wgpu::VertexAttribute kPosition = {
+      wgpu::VertexFormat::Float32x2, 0, 0};
+  wgpu::VertexBufferLayout layout{};
+  layout.arrayStride = kVertexSize;
+  layout.stepMode = wgpu::VertexStepMode::Vertex;
+  layout.attributeCount = 1;
+  layout.attributes = &kPosition;
+  return layout;
+}
+
+MeshPool::MeshId MeshPool::AddMesh(const float* positions,
+                                   uint32_t vertexCount,
+                                   const uint16_t* indices,
+                                   uint32_t indexCount) {
+  assert(vertexCount > 0 && vertexCount <= 65536 && indexCount > 0);
+  uint64_t firstVertex = vertexRanges_.Allocate(vertexCount);
+  if (firstVertex == RangeAllocator::kInvalidOffset) {
+    return kInvalidMesh;
+  }
+  uint32_t allocatedIndices = AllocatedIndexCount(indexCount);
+  uint64_t firstIndex = indexRanges_.Allocate(allocatedIndices, kIndexAlignment);
+  if (firstIndex == RangeAllocator::kInvalidOffset) {
+    vertexRanges_.Free(firstVertex, vertexCount);
+    return kInvalidMesh;
+  }
+
+  {
+    std::vector<uint16_t> padded(indices, indices + indexCount);
+    padded.resize(allocatedIndices, 0);
+
+    std::scoped_lock lock(deviceMutex_);
+    queue_.WriteBuffer(vertexBuffer_, kVertexSize * firstVertex, positions,
+                       kVertexSize * vertexCount);
+    queue_.WriteBuffer(indexBuffer_, sizeof(uint16_t) * firstIndex,
+                       padded.data(), sizeof(uint16_t) * allocatedIndices);
+  }
+
+  MeshId id;
+  if (freeIds_.empty()) {
+    id = static_cast<MeshId>(meshes_.size());
+    meshes_.emplace_back();
+  } else {
+    id = freeIds_.back();
+    freeIds_.pop_back();
+  }
+  Mesh& mesh = meshes_[id];
+  mesh.firstIndex = static_cast<uint32_t>(firstIndex);
+  mesh.indexCount = indexCount;
+  mesh.baseVertex = static_cast<int32_t>(firstVertex);
+  mesh.vertexCount = vertexCount;
+  meshCount_++;
+  return id;
+}
+
+void MeshPool::RemoveMesh(MeshId id) {
+  Mesh& mesh = meshes_[id];
+  assert(mesh.indexCount > 0);
+  vertexRanges_.Free(static_cast<uint64_t>(mesh.baseVertex), mesh.vertexCount);
+  indexRanges_.Free(mesh.firstIndex, AllocatedIndexCount(mesh.indexCount));
+  mesh = Mesh();
+  freeIds_.push_back(id);
+  meshCount_--;
+}
+
+void MeshPool::PrintStats(const char* prefix) const {
+  printf("%s %u meshes\n", prefix, meshCount_);
+  PrintRangeStats(prefix, "vertices", vertexRanges_.GetStats());
+  PrintRangeStats(prefix, "indices", indexRanges_.GetStats());
+}
+
+void BuildPolygonMesh(uint32_t sides,
+                      float radius,
+                      std::vector<float>* positions,
+                      std::vector<uint16_t>* indices) {
+  assert(sides >= 3);
+  const float kPi = 3.14159265358979f;
+  positions->clear();
+  indices->clear();
+  for (uint32_t i = 0; i < sides; i++) {
+    float angle = kPi / sides + 2.0f * kPi * i / sides;
+    positions->push_back(radius * std::cos(angle));
+    positions->push_back(radius * std::sin(angle));
+  }
+  for (uint32_t i = 1; i + 1 < sides; i++) {
+    indices->push_back(0);
+    indices->push_back(static_cast<uint16_t>(i));
+    indices->push_back(static_cast<uint16_t>(i + 1));
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <webgpu/webgpu_cpp.h>
+#else
+#include <dawn/webgpu_cpp.h>
+#endif
+
+#include "range_allocator.h"
+
+// Geometry of many meshes packed into one vertex buffer and one index buffer,
+// so that draws of different meshes only differ in their DrawIndexed()
+// arguments and never rebind buffers.
+//
+// Vertices are 2D positions (float32x2, shader location 0). Indices are
+// uint16 and relative to the mesh's base vertex, so each mesh can have up to
+// 65536 vertices while the pool holds any number. Ranges of both buffers are
+// handed out by RangeAllocators, and RemoveMesh() returns them for reuse.
+class MeshPool {
+ public:
+  using MeshId = uint32_t;
+  static constexpr MeshId kInvalidMesh = UINT32_MAX;
+
+  // Arguments of the draw of one mesh, in elements of the pool's buffers.
+  struct Mesh {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+  };
+
+  // |deviceMutex| is held around device and queue calls, matching the rest
+  // of main.cpp.
+  MeshPool(wgpu::Device device,
+           wgpu::Queue queue,
+           std::mutex& deviceMutex,
+           uint32_t vertexCapacity,
+           uint32_t indexCapacity);
+
+  MeshPool(const MeshPool&) = delete;
+  MeshPool& operator=(const MeshPool&) = delete;
+
+  // The vertex buffer layout pipelines drawing from the pool need.
+  static wgpu::VertexBufferLayout VertexLayout();
+
+  // Uploads a mesh of |vertexCount| (x, y) pairs and |indexCount| indices.
+  // Returns kInvalidMesh if either buffer has no room left for it.
+  MeshId AddMesh(const float* positions,
+                 uint32_t vertexCount,
+                 const uint16_t* indices,
+                 uint32_t indexCount);
+  void RemoveMesh(MeshId id);
+
+  // Valid until the mesh is removed. Only AddMesh()/RemoveMesh() modify the
+  // table, so concurrent lookups between them are safe.
+  const Mesh& Get(MeshId id) const { return meshes_[id]; }
+  uint32_t MeshCount() const { return meshCount_; }
+
+  // Binds the pool's buffers; done once per pass or bundle, before any draw.
+  template <typename Encoder>
+  void Bind(const Encoder& encoder) const {
+    encoder.SetVertexBuffer(0, vertexBuffer_);
+    encoder.SetIndexBuffer(indexBuffer_, wgpu::IndexFormat::Uint16);
+  }
+
+  // Prints utilisation and fragmentation of both buffers.
+  void PrintStats(const char* prefix) const;
+
+ private:
+  wgpu::Device device_;
+  wgpu::Queue queue_;
+  std::mutex& deviceMutex_;
+
+  wgpu::Buffer vertexBuffer_;
+  wgpu::Buffer indexBuffer_;
+  RangeAllocator vertexRanges_;
+  RangeAllocator indexRanges_;
+
+  // Indexed by MeshId; removed meshes have indexCount 0 and their ids are
+  // reused.
+  std::vector<Mesh> meshes_;
+  std::vector<MeshId> freeIds_;
+  uint32_t meshCount_ = 0;
+};
+
+// Regular polygon with |sides| vertices on a circle of radius |radius|,
+// rotated so that the 4-sided one is an axis-aligned square, triangulated as a
+// fan. Replaces the contents of |positions| and |indices|.
+void BuildPolygonMesh(uint32_t sides,
+                      float radius,
+                      std::vector<float>* positions,
+                      std::vector<uint16_t>* indices);
@@ -0,0 +1,654 @@
+#include "mock_webgpu.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "frame_arena.h"
+
+namespace {
+
+enum class Kind : uint32_t {
+  Device,
+  Queue,
+  Buffer,
+  Texture,
+  TextureView,
+  ShaderModule,
+  BindGroupLayout,
+  PipelineLayout,
+  RenderPipeline,
+  BindGroup,
+  CommandEncoder,
+  RenderPassEncoder,
+  RenderBundleEncoder,
+  CommandBuffer,
+  RenderBundle,
+  Count,
+};
+
+enum class CommandType : uint32_t {
+  BeginRenderPass,
+  EndPass,
+  SetPipeline,
+  SetBindGroup,
+  SetVertexBuffer,
+  SetIndexBuffer,
+  Draw,
+  DrawIndexed,
+  ExecuteBundle,
+};
+
+struct MockObject;
+
+// Object arguments are stored as their serial; |object| is only set for
+// ExecuteBundle, whose bundle is walked at submit. SetBindGroup keeps up to
+// kMaxDynamicOffsets offsets after its index, group and offset count.
+constexpr uint32_t kMaxDynamicOffsets = 3;
+
+struct Command {
+  CommandType type;
+  uint32_t args[3 + kMaxDynamicOffsets];
+  MockObject* object;
+};
+
+struct CommandChunk {
+  static constexpr size_t kCapacity = 64;
+
+  CommandChunk* next;
+  size_t count;
+  Command commands[kCapacity];
+};
+
+struct CommandStream {
+  CommandChunk* head;
+  CommandChunk* tail;
+};
+
+// One layout for every object type. Encoders record into |stream|, which
+// Finish() hands to the command buffer or bundle; pass encoders record into
+// their parent command encoder's stream and hold a reference to it.
+struct MockObject {
+  std::atomic<uint32_t> refs;
+  Kind kind;
+  // Creation order among objects of the same kind.
+  uint32_t serial;
+  MockObject* parent;
+  CommandStream stream;
+  MockObject* nextFree;
+};
+
+template <typename Handle>
+MockObject* FromWGPU(Handle handle) {
+  return reinterpret_cast<MockObject*>(handle);
+}
+
+template <typename Handle>
+Handle ToWGPU(MockObject* object) {
+  return reinterpret_cast<Handle>(object);
+}
+
+// Command arenas, one per recording thread. A thread's arena goes back to an
+// idle list when it exits, for the next new thread; arenas are never freed, so
+// commands recorded by an exited thread stay valid until MockWebGPUEndFrame().
+constexpr size_t kMaxArenas = 128;
+constexpr size_t kInitialArenaBytes = 64 * 1024;
+std::mutex arenasMutex;
+FrameArena* arenas[kMaxArenas];
+size_t arenaCount = 0;
+FrameArena* idleArenas[kMaxArenas];
+size_t idleArenaCount = 0;
+
+struct ThreadArenaLease {
+  ~ThreadArenaLease() {
+    if (arena) {
+      std::scoped_lock lock(arenasMutex);
+      idleArenas[idleArenaCount++] = arena;
+    }
+  }
+
+  FrameArena* arena = nullptr;
+};
+
+FrameArena& ThreadArena() {
+  thread_local ThreadArenaLease lease;
+  if (!lease.arena) {
+    std::scoped_lock lock(arenasMutex);
+    if (idleArenaCount > 0) {
+      lease.arena = idleArenas[--idleArenaCount];
+    } else if (arenaCount < kMaxArenas) {
+      lease.arena = new FrameArena(kInitialArenaBytes);
+      arenas[arenaCount++] = lease.arena;
+    } else {
+      fprintf(stderr,
+              "mock_webgpu: more than %zu concurrent recording threads\n",
+              kMaxArenas);
+      abort();
+    }
+  }
+  return *lease.arena;
+}
+
+void Append(CommandStream* stream, const Command& command) {
+  if (!stream->tail || stream->tail->count == CommandChunk::kCapacity) {
+    auto* chunk = static_cast<CommandChunk*>(
+        ThreadArena().Allocate(sizeof(CommandChunk), alignof(CommandChunk)));
+    chunk->next = nullptr;
+    chunk->count = 0;
+    if (stream->tail) {
+      stream->tail->next = chunk;
+    } else {
+      stream->head = chunk;
+    }
+    stream->tail = chunk;
+  }
+  stream->tail->commands[stream->tail->count++] = command;
+}
+
+// Objects come from a free list, so steady-state frames don't allocate.
+constexpr size_t kObjectBlockSize = 64;
+std::mutex objectsMutex;
+MockObject* freeObjects = nullptr;
+std::atomic<uint32_t> serials[static_cast<size_t>(Kind::Count)];
+std::atomic<uint64_t> liveObjects{0};
+
+MockObject* NewObject(Kind kind, MockObject* parent = nullptr) {
+  MockObject* object;
+  {
+    std::scoped_lock lock(objectsMutex);
+    if (!freeObjects) {
+      MockObject* block = new MockObject[kObjectBlockSize];
+      for (size_t i = 0; i < kObjectBlockSize; i++) {
+        block[i].nextFree = i + 1 < kObjectBlockSize ? &block[i + 1] : nullptr;
+      }
+      freeObjects = block;
+    }
+    object = freeObjects;
+    freeObjects = object->nextFree;
+  }
+  object->refs.store(1, std::memory_order_relaxed);
+  object->kind = kind;
+  object->serial = serials[static_cast<size_t>(kind)].fetch_add(
+      1, std::memory_order_relaxed);
+  object->parent = parent;
+  object->stream = {};
+  object->nextFree = nullptr;
+  liveObjects.fetch_add(1, std::memory_order_relaxed);
+  return object;
+}
+
+void ReleaseObject(MockObject* object) {
+  if (object->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  MockObject* parent = object->parent;
+  liveObjects.fetch_sub(1, std::memory_order_relaxed);
+  {
+    std::scoped_lock lock(objectsMutex);
+    object->nextFree = freeObjects;
+    freeObjects = object;
+  }
+  if (parent) {
+    ReleaseObject(parent);
+  }
+}
+
+template <typename Handle>
+void Reference(Handle handle) {
+  FromWGPU(handle)->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Handle>
+void Release(Handle handle) {
+  ReleaseObject(FromWGPU(handle));
+}
+
+uint32_t SerialOf(void* handle) {
+  return handle ? FromWGPU(handle)->serial : UINT32_MAX;
+}
+
+// Device state. There is only ever one mock device.
+
+struct PendingCallback {
+  WGPUQueueWorkDoneCallback workDone;
+  WGPUCreateRenderPipelineAsyncCallback pipelineCreated;
+  WGPURenderPipeline pipeline;
+  void* userdata;
+};
+
+std::mutex callbacksMutex;
+std::vector<PendingCallback> pendingCallbacks;
+std::vector<PendingCallback> runningCallbacks;
+
+MockObject* queueObject = nullptr;
+
+std::mutex statsMutex;
+MockWebGPUStats stats;
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+void HashBytes(const void* data, size_t size, uint64_t* hash) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    *hash = (*hash ^ bytes[i]) * kFnvPrime;
+  }
+}
+
+// Called with statsMutex held.
+void WalkStream(const CommandStream& stream) {
+  for (const CommandChunk* chunk = stream.head; chunk; chunk = chunk->next) {
+    for (size_t i = 0; i < chunk->count; i++) {
+      const Command& command = chunk->commands[i];
+      stats.commands++;
+      HashBytes(&command.type, sizeof(command.type), &stats.streamHash);
+      HashBytes(command.args, sizeof(command.args), &stats.streamHash);
+      switch (command.type) {
+        case CommandType::BeginRenderPass:
+          stats.renderPasses++;
+          break;
+        case CommandType::SetPipeline:
+          stats.pipelineChanges++;
+          break;
+        case CommandType::SetBindGroup:
+          stats.bindGroupChanges++;
+          break;
+        case CommandType::Draw:
+        case CommandType::DrawIndexed:
+          stats.draws++;
+          stats.instances += command.args[1];
+          stats.vertices += uint64_t(command.args[0]) * command.args[1];
+          break;
+        case CommandType::ExecuteBundle:
+          stats.bundlesExecuted++;
+          WalkStream(command.object->stream);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+// Procs.
+
+void DeviceSetUncapturedErrorCallback(WGPUDevice, WGPUErrorCallback, void*) {
+  // The mock never reports errors.
+}
+
+WGPUQueue DeviceGetQueue(WGPUDevice) {
+  Reference(queueObject);
+  return ToWGPU<WGPUQueue>(queueObject);
+}
+
+WGPUShaderModule DeviceCreateShaderModule(WGPUDevice,
+                                          const WGPUShaderModuleDescriptor*) {
+  return ToWGPU<WGPUShaderModule>(NewObject(Kind::ShaderModule));
+}
+
+WGPUBindGroupLayout DeviceCreateBindGroupLayout(
+    WGPUDevice,
+    const WGPUBindGroupLayoutDescriptor*) {
+  return ToWGPU<WGPUBindGroupLayout>(NewObject(Kind::BindGroupLayout));
+}
+
+WGPUPipelineLayout DeviceCreatePipelineLayout(
+    WGPUDevice,
+    const WGPUPipelineLayoutDescriptor*) {
+  return ToWGPU<WGPUPipelineLayout>(NewObject(Kind::PipelineLayout));
+}
+
+WGPURenderPipeline DeviceCreateRenderPipeline(
+    WGPUDevice,
+    const WGPURenderPipelineDescriptor*) {
+  return ToWGPU<WGPURenderPipeline>(NewObject(Kind::RenderPipeline));
+}
+
+void DeviceCreateRenderPipelineAsync(
+    WGPUDevice device,
+    const WGPURenderPipelineDescriptor* descriptor,
+    WGPUCreateRenderPipelineAsyncCallback callback,
+    void* userdata) {
+  WGPURenderPipeline pipeline = DeviceCreateRenderPipeline(device, descriptor);
+  std::scoped_lock lock(callbacksMutex);
+  pendingCallbacks.push_back({nullptr, callback, pipeline, userdata});
+}
+
+WGPUBuffer DeviceCreateBuffer(WGPUDevice, const WGPUBufferDescriptor*) {
+  return ToWGPU<WGPUBuffer>(NewObject(Kind::Buffer));
+}
+
+WGPUTexture DeviceCreateTexture(WGPUDevice, const WGPUTextureDescriptor*) {
+  return ToWGPU<WGPUTexture>(NewObject(Kind::Texture));
+}
+
+WGPUTextureView TextureCreateView(WGPUTexture texture,
+                                  const WGPUTextureViewDescriptor*) {
+  Reference(texture);
+  return ToWGPU<WGPUTextureView>(
+      NewObject(Kind::TextureView, FromWGPU(texture)));
+}
+
+WGPUBindGroup DeviceCreateBindGroup(WGPUDevice,
+                                    const WGPUBindGroupDescriptor*) {
+  return ToWGPU<WGPUBindGroup>(NewObject(Kind::BindGroup));
+}
+
+WGPUCommandEncoder DeviceCreateCommandEncoder(
+    WGPUDevice,
+    const WGPUCommandEncoderDescriptor*) {
+  return ToWGPU<WGPUCommandEncoder>(NewObject(Kind::CommandEncoder));
+}
+
+WGPURenderBundleEncoder DeviceCreateRenderBundleEncoder(
+    WGPUDevice,
+    const WGPURenderBundleEncoderDescriptor*) {
+  return ToWGPU<WGPURenderBundleEncoder>(NewObject(Kind::RenderBundleEncoder));
+}
+
+void DeviceTick(WGPUDevice) {
+  {
+    std::scoped_lock lock(callbacksMutex);
+    runningCallbacks.swap(pendingCallbacks);
+  }
+  for (const PendingCallback& pending : runningCallbacks) {
+    if (pending.workDone) {
+      pending.workDone(WGPUQueueWorkDoneStatus_Success, pending.userdata);
+    } else {
+      pending.pipelineCreated(WGPUCreatePipelineAsyncStatus_Success,
+                              pending.pipeline, "", pending.userdata);
+    }
+  }
+  runningCallbacks.clear();
+}
+
+void QueueWriteBuffer(WGPUQueue, WGPUBuffer, uint64_t, const void*, size_t) {}
+
+void QueueSubmit(WGPUQueue, uint32_t commandCount,
+                 const WGPUCommandBuffer* commands) {
+  std::scoped_lock lock(statsMutex);
+  stats.submits++;
+  for (uint32_t i = 0; i < commandCount; i++) {
+    stats.commandBuffers++;
+    WalkStream(FromWGPU(commands[i])->stream);
+  }
+}
+
+void QueueOnSubmittedWorkDone(WGPUQueue, uint64_t,
+                              WGPUQueueWorkDoneCallback callback,
+                              void* userdata) {
+  std::scoped_lock lock(callbacksMutex);
+  pendingCallbacks.push_back({callback, nullptr, nullptr, userdata});
+}
+
+WGPURenderPassEncoder CommandEncoderBeginRenderPass(
+    WGPUCommandEncoder encoder,
+    const WGPURenderPassDescriptor* descriptor) {
+  MockObject* parent = FromWGPU(encoder);
+  parent->refs.fetch_add(1, std::memory_order_relaxed);
+  Append(&parent->stream,
+         {CommandType::BeginRenderPass,
+          {descriptor->colorAttachmentCount,
+           descriptor->depthStencilAttachment != nullptr},
+          nullptr});
+  return ToWGPU<WGPURenderPassEncoder>(
+      NewObject(Kind::RenderPassEncoder, parent));
+}
+
+WGPUCommandBuffer CommandEncoderFinish(WGPUCommandEncoder encoder,
+                                       const WGPUCommandBufferDescriptor*) {
+  MockObject* commandBuffer = NewObject(Kind::CommandBuffer);
+  commandBuffer->stream = FromWGPU(encoder)->stream;
+  FromWGPU(encoder)->stream = {};
+  return ToWGPU<WGPUCommandBuffer>(commandBuffer);
+}
+
+WGPURenderBundle RenderBundleEncoderFinish(
+    WGPURenderBundleEncoder encoder,
+    const WGPURenderBundleDescriptor*) {
+  MockObject* bundle = NewObject(Kind::RenderBundle);
+  bundle->stream = FromWGPU(encoder)->stream;
+  FromWGPU(encoder)->stream = {};
+  return ToWGPU<WGPURenderBundle>(bundle);
+}
+
+// Pass encoders record into their command encoder's stream, bundle encoders
+// into their own.
+template <typename Encoder>
+CommandStream* StreamOf(Encoder encoder) {
+  MockObject* object = FromWGPU(encoder);
+  return object->parent ? &object->parent->stream : &object->stream;
+}
+
+template <typename Encoder>
+void EncoderSetPipeline(Encoder encoder, WGPURenderPipeline pipeline) {
+  Append(StreamOf(encoder),
+         {CommandType::SetPipeline, {SerialOf(pipeline)}, nullptr});
+}
+
+template <typename Encoder>
+void EncoderSetBindGroup(Encoder encoder,
+                         uint32_t groupIndex,
+                         WGPUBindGroup group,
+                         uint32_t dynamicOffsetCount,
+                         const uint32_t* dynamicOffsets) {
+  Command command = {CommandType::SetBindGroup,
+                     {groupIndex, SerialOf(group), dynamicOffsetCount},
+                     nullptr};
+  // More offsets would need a variable-size command.
+  assert(dynamicOffsetCount <= kMaxDynamicOffsets);
+  for (uint32_t i = 0; i < dynamicOffsetCount; i++) {
+    command.args[3 + i] = dynamicOffsets[i];
+  }
+  Append(StreamOf(encoder), command);
+}
+
+template <typename Encoder>
+void EncoderSetVertexBuffer(Encoder encoder,
+                            uint32_t slot,
+                            WGPUBuffer buffer,
+                            uint64_t offset,
+                            uint64_t size) {
+  Append(StreamOf(encoder),
+         {CommandType::SetVertexBuffer,
+          {slot, SerialOf(buffer), static_cast<uint32_t>(offset),
+           static_cast<uint32_t>(size)},
+          nullptr});
+}
+
+template <typename Encoder>
+void EncoderSetIndexBuffer(Encoder encoder,
+                           WGPUBuffer buffer,
+                           WGPUIndexFormat format,
+                           uint64_t offset,
+                           uint64_t size) {
+  Append(StreamOf(encoder),
+         {CommandType::SetIndexBuffer,
+          {SerialOf(buffer), static_cast<uint32_t>(format),
+           static_cast<uint32_t>(offset), static_cast<uint32_t>(size)},
+          nullptr});
+}
+
+template <typename Encoder>
+void EncoderDraw(Encoder encoder,
+                 uint32_t vertexCount,
+                 uint32_t instanceCount,
+                 uint32_t firstVertex,
+                 uint32_t firstInstance) {
+  Append(StreamOf(encoder),
+         {CommandType::Draw,
+          {vertexCount, instanceCount, firstVertex, firstInstance},
+          nullptr});
+}
+
+template <typename Encoder>
+void EncoderDrawIndexed(Encoder encoder,
+                        uint32_t indexCount,
+                        uint32_t instanceCount,
+                        uint32_t firstIndex,
+                        int32_t baseVertex,
+                        uint32_t firstInstance) {
+  Append(StreamOf(encoder),
+         {CommandType::DrawIndexed,
+          {indexCount, instanceCount, firstIndex,
+           static_cast<uint32_t>(baseVertex), firstInstance},
+          nullptr});
+}
+
+void RenderPassEncoderExecuteBundles(WGPURenderPassEncoder encoder,
+                                     uint32_t bundleCount,
+                                     const WGPURenderBundle* bundles) {
+  for (uint32_t i = 0; i < bundleCount; i++) {
+    // Bundles are recorded concurrently, so their serials aren't stable across
+    // runs and are left out of the hash.
+    Append(StreamOf(encoder),
+           {CommandType::ExecuteBundle, {}, FromWGPU(bundles[i])});
+  }
+}
+
+void RenderPassEncoderEnd(WGPURenderPassEncoder encoder) {
+  Append(StreamOf(encoder), {CommandType::EndPass, {}, nullptr});
+}
+
+}  // namespace
+
+DawnProcTable MockWebGPUProcs() {
+  DawnProcTable procs = {};
+
+  procs.deviceReference = Reference<WGPUDevice>;
+  procs.deviceRelease = Release<WGPUDevice>;
+  procs.deviceSetUncapturedErrorCallback = DeviceSetUncapturedErrorCallback;
+  procs.deviceGetQueue = DeviceGetQueue;
+  procs.deviceCreateShaderModule = DeviceCreateShaderModule;
+  procs.deviceCreateBindGroupLayout = DeviceCreateBindGroupLayout;
+  procs.deviceCreatePipelineLayout = DeviceCreatePipelineLayout;
+  procs.deviceCreateRenderPipeline = DeviceCreateRenderPipeline;
+  procs.deviceCreateRenderPipelineAsync = DeviceCreateRenderPipelineAsync;
+  procs.deviceCreateBuffer = DeviceCreateBuffer;
+  procs.deviceCreateTexture = DeviceCreateTexture;
+  procs.deviceCreateBindGroup = DeviceCreateBindGroup;
+  procs.deviceCreateCommandEncoder = DeviceCreateCommandEncoder;
+  procs.deviceCreateRenderBundleEncoder = DeviceCreateRenderBundleEncoder;
+  procs.deviceTick = DeviceTick;
+
+  procs.queueReference = Reference<WGPUQueue>;
+  procs.queueRelease = Release<WGPUQueue>;
+  procs.queueWriteBuffer = QueueWriteBuffer;
+  procs.queueSubmit = QueueSubmit;
+  procs.queueOnSubmittedWorkDone = QueueOnSubmittedWorkDone;
+
+  procs.bufferReference = Reference<WGPUBuffer>;
+  procs.bufferRelease = Release<WGPUBuffer>;
+  procs.textureReference = Reference<WGPUTexture>;
+  procs.textureRelease = Release<WGPUTexture>;
+  procs.textureCreateView = TextureCreateView;
+  procs.textureViewReference = Reference<WGPUTextureView>;
+  procs.textureViewRelease = Release<WGPUTextureView>;
+  procs.shaderModuleReference = Reference<WGPUShaderModule>;
+  procs.shaderModuleRelease = Release<WGPUShaderModule>;
+  procs.bindGroupLayoutReference = Reference<WGPUBindGroupLayout>;
+  procs.bindGroupLayoutRelease = Release<WGPUBindGroupLayout>;
+  procs.pipelineLayoutReference = Reference<WGPUPipelineLayout>;
+  procs.pipelineLayoutRelease = Release<WGPUPipelineLayout>;
+  procs.renderPipelineReference = Reference<WGPURenderPipeline>;
+  procs.renderPipelineRelease = Release<WGPURenderPipeline>;
+  procs.bindGroupReference = Reference<WGPUBindGroup>;
+  procs.bindGroupRelease = Release<WGPUBindGroup>;
+  procs.commandBufferReference = Reference<WGPUCommandBuffer>;
+  procs.commandBufferRelease = Release<WGPUCommandBuffer>;
+  procs.renderBundleReference = Reference<WGPURenderBundle>;
+  procs.renderBundleRelease = Release<WGPURenderBundle>;
+
+  procs.commandEncoderReference = Reference<WGPUCommandEncoder>;
+  procs.commandEncoderRelease = Release<WGPUCommandEncoder>;
+  procs.commandEncoderBeginRenderPass = CommandEncoderBeginRenderPass;
+  procs.commandEncoderFinish = CommandEncoderFinish;
+
+  procs.renderPassEncoderReference = Reference<WGPURenderPassEncoder>;
+  procs.renderPassEncoderRelease = Release<WGPURenderPassEncoder>;
+  procs.renderPassEncoderSetPipeline =
+      EncoderSetPipeline<WGPURenderPassEncoder>;
+  procs.renderPassEncoderSetBindGroup =
+      EncoderSetBindGroup<WGPURenderPassEncoder>;
+  procs.renderPassEncoderSetVertexBuffer =
+      EncoderSetVertexBuffer<WGPURenderPassEncoder>;
+  procs.renderPassEncoderSetIndexBuffer =
+      EncoderSetIndexBuffer<WGPURenderPassEncoder>;
+  procs.renderPassEncoderDraw = EncoderDraw<WGPURenderPassEncoder>;
+  procs.renderPassEncoderDrawIndexed =
+      EncoderDrawIndexed<WGPURenderPassEncoder>;
+  procs.renderPassEncoderExecuteBundles = RenderPassEncoderExecuteBundles;
+  procs.renderPassEncoderEnd = RenderPassEncoderEnd;
+
+  procs.renderBundleEncoderReference = Reference<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderRelease = Release<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderSetPipeline =
+      EncoderSetPipeline<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderSetBindGroup =
+      EncoderSetBindGroup<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderSetVertexBuffer =
+      EncoderSetVertexBuffer<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderSetIndexBuffer =
+      EncoderSetIndexBuffer<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderDraw = EncoderDraw<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderDrawIndexed =
+      EncoderDrawIndexed<WGPURenderBundleEncoder>;
+  procs.renderBundleEncoderFinish = RenderBundleEncoderFinish;
+
+  return procs;
+}
+
+WGPUDevice MockWebGPUCreateDevice() {
+  if (!queueObject) {
+    queueObject = NewObject(Kind::Queue);
+    stats.streamHash = kFnvOffset;
+  }
+  return ToWGPU<WGPUDevice>(NewObject(Kind::Device));
+}
+
+void MockWebGPUEndFrame() {
+  std::scoped_lock lock(arenasMutex);
+  for (size_t i = 0; i < arenaCount; i++) {
+    arenas[i]->Reset();
+  }
+}
+
+MockWebGPUStats MockWebGPUGetStats() {
+  MockWebGPUStats result;
+  {
+    std::scoped_lock lock(statsMutex);
+    result = stats;
+  }
+  {
+    std::scoped_lock lock(arenasMutex);
+    for (size_t i = 0; i < arenaCount; i++) {
+      result.arenaBytes += arenas[i]->Capacity();
+    }
+  }
+  result.liveObjects = liveObjects.load(std::memory_order_relaxed);
+  return result;
+}
+
+void MockWebGPUPrintStats(const char* prefix) {
+  MockWebGPUStats s = MockWebGPUGetStats();
+  printf("%s %llu submits, %llu command buffers, %llu render passes, "
+         "%llu bundles executed\n",
+         prefix, static_cast<unsigned long long>(s.submits),
+         static_cast<unsigned long long>(s.commandBuffers),
+         static_cast<unsigned long long>(s.renderPasses),
+         static_cast<unsigned long long>(s.bundlesExecuted));
+  printf("%s %llu commands: %llu draws (%llu instances, %llu vertices), "
+         "%llu pipeline and %llu bind group changes\n",
+         prefix, static_cast<unsigned long long>(s.commands),
+         static_cast<unsigned long long>(s.draws),
+         static_cast<unsigned long long>(s.instances),
+         static_cast<unsigned long long>(s.vertices),
+         static_cast<unsigned long long>(s.pipelineChanges),
+         static_cast<unsigned long long>(s.bindGroupChanges));
+  printf("%s stream hash %016llx, %zu arena bytes, %llu live objects\n",
+         prefix, static_cast<unsigned long long>(s.streamHash), s.arenaBytes,
+         static_cast<unsigned long long>(s.liveObjects));
+}
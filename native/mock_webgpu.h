@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <dawn/dawn_proc_table.h>
+#include <dawn/webgpu.h>
+
+// Recording stand-in for a WebGPU implementation, installed in place of Dawn
+// with dawnProcSetProcs() (native builds with -DMOCK_WEBGPU=ON). It validates
+// nothing and has no backend: encoders only append fixed-size commands to a
+// stream carved out of the recording thread's arena, and Queue::Submit walks
+// the submitted streams (through executed bundles) to count and hash them. A
+// render loop running on it measures the application's own CPU cost, and the
+// stream digests let two runs or encoding strategies be compared.
+//
+// Only the procs the demo calls on its headless path are implemented; the rest
+// of the table is null. Limitations:
+// - Recorded commands live in per-thread arenas that MockWebGPUEndFrame()
+//   recycles, so command buffers must be submitted (and bundles they execute
+//   kept alive) within the frame they were recorded in.
+// - Buffers can't be mapped, and there are no surfaces or swap chains.
+// - Async callbacks (pipeline creation, OnSubmittedWorkDone) run from the
+//   next Device::Tick(), always successfully.
+
+// The proc table to pass to dawnProcSetProcs().
+DawnProcTable MockWebGPUProcs();
+
+// The one mock device; the caller owns the returned reference.
+WGPUDevice MockWebGPUCreateDevice();
+
+// Recycles every thread's command arena. Call once per frame when no thread is
+// recording and everything recorded has been submitted.
+void MockWebGPUEndFrame();
+
+// Totals over everything submitted so far.
+struct MockWebGPUStats {
+  uint64_t submits = 0;
+  uint64_t commandBuffers = 0;
+  uint64_t renderPasses = 0;
+  uint64_t bundlesExecuted = 0;
+  uint64_t commands = 0;
+  uint64_t pipelineChanges = 0;
+  uint64_t bindGroupChanges = 0;
+  uint64_t draws = 0;
+  uint64_t instances = 0;
+  uint64_t vertices = 0;
+  // FNV-1a over the commands' types and arguments. Objects are identified by
+  // creation order, so runs that create them in the same order compare equal.
+  uint64_t streamHash = 0;
+  // Arena capacity over all recording threads.
+  size_t arenaBytes = 0;
+  uint64_t liveObjects = 0;
+};
+
+MockWebGPUStats MockWebGPUGetStats();
+void MockWebGPUPrintStats(const char* prefix);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Z-order (Morton) curve helpers for laying out 2D grids so that contiguous
+// index ranges are spatially compact.
+
+// Spreads the low 16 bits of |v| so they occupy the even bits.
+inline uint32_t MortonSpreadBits(uint32_t v) {
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+inline uint32_t MortonEncode(uint32_t x, uint32_t y) {
+  return MortonSpreadBits(x) | (MortonSpreadBits(y) << 1);
+}
+
+// Returns the row-major ids (x + y * width) of a width x height grid in Morton
+// order. Grids that aren't power-of-two squares are handled by sorting on the
+// code, which keeps the curve's locality with gaps skipped.
+inline std::vector<uint32_t> BuildMortonOrder(uint32_t width, uint32_t height) {
+  std::vector<uint32_t> ids(width * height);
+  for (uint32_t i = 0; i < ids.size(); i++) {
+    ids[i] = i;
+  }
+  std::sort(ids.begin(), ids.end(), [width](uint32_t a, uint32_t b) {
+    return MortonEncode(a % width, a / width) <
+           MortonEncode(b % width, b / width);
+  });
+  return ids;
+}
@@ -0,0 +1,107 @@
+#include "object_store.h"
+
+#include <utility>
+
+ObjectStore::ObjectStore(uint32_t capacity)
+    : capacity_(capacity),
+      x_(capacity),
+      y_(capacity),
+      z_(capacity),
+      radius_(capacity),
+      transforms_(capacity),
+      visibleBits_((capacity + 63) / 64),
+      materialKeys_(capacity),
+      meshIds_(capacity),
+      handleBySlot_(capacity) {
+  handles_.reserve(capacity);
+  freeHandles_.reserve(capacity);
+}
+
+ObjectStore::Handle ObjectStore::Add(float x,
+                                     float y,
+                                     float z,
+                                     float radius,
+                                     Mat4 transform,
+                                     uint32_t materialKey,
+                                     uint32_t meshId) {
+  if (size_ == capacity_) {
+    return {};
+  }
+
+  uint32_t index;
+  if (freeHandles_.empty()) {
+    index = static_cast<uint32_t>(handles_.size());
+    handles_.push_back({0, 0, false});
+  } else {
+    index = freeHandles_.back();
+    freeHandles_.pop_back();
+  }
+
+  uint32_t slot = size_++;
+  handles_[index].slot = slot;
+  handles_[index].live = true;
+  handleBySlot_[slot] = index;
+
+  x_[slot] = x;
+  y_[slot] = y;
+  z_[slot] = z;
+  radius_[slot] = radius;
+  transforms_[slot] = std::move(transform);
+  materialKeys_[slot] = materialKey;
+  meshIds_[slot] = meshId;
+  SetVisible(slot, true);
+  return {index, handles_[index].generation};
+}
+
+bool ObjectStore::Remove(Handle handle) {
+  if (!IsAlive(handle)) {
+    return false;
+  }
+
+  uint32_t slot = handles_[handle.index].slot;
+  uint32_t last = --size_;
+  if (slot != last) {
+    x_[slot] = x_[last];
+    y_[slot] = y_[last];
+    z_[slot] = z_[last];
+    radius_[slot] = radius_[last];
+    transforms_[slot] = std::move(transforms_[last]);
+    materialKeys_[slot] = materialKeys_[last];
+    meshIds_[slot] = meshIds_[last];
+    SetVisible(slot, IsVisible(last));
+
+    uint32_t movedHandle = handleBySlot_[last];
+    handles_[movedHandle].slot = slot;
+    handleBySlot_[slot] = movedHandle;
+  }
+
+  // Bumping the generation invalidates every copy of |handle|, including
+  // after the entry is reused.
+  handles_[handle.index].generation++;
+  handles_[handle.index].live = false;
+  freeHandles_.push_back(handle.index);
+  return true;
+}
+
+bool ObjectStore::IsAlive(Handle handle) const {
+  return handle.index < handles_.size() && handles_[handle.index].live &&
+         handles_[handle.index].generation == handle.generation;
+}
+
+void ObjectStore::SetVisible(uint32_t slot, bool visible) {
+  uint64_t bit = uint64_t(1) << (slot % 64);
+  if (visible) {
+    visibleBits_[slot / 64] |= bit;
+  } else {
+    visibleBits_[slot / 64] &= ~bit;
+  }
+}
+
+size_t ObjectStore::FilterVisible(uint32_t* slots, size_t count) const {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    slots[kept] = slots[i];
+    kept += IsVisible(slots[i]);
+  }
+  return kept;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "culling.h"
+#include "mat4.h"
+
+// Scene objects as structure-of-arrays streams over dense slots [0, Size()):
+// bounding spheres (x, y, z, radius), transforms, visibility bits, material
+// keys and mesh ids. Each loop touches only the streams it needs, e.g. culling reads the
+// bounds and visibility bits but never the 64-byte transforms.
+//
+// Objects are referred to by handles that stay valid while the object lives.
+// Remove() moves the last object into the freed slot to keep the streams dense,
+// so slots are not stable; SlotOf() resolves a handle to its current slot.
+// Storage is allocated up front for |capacity| objects, so the stream pointers
+// never change.
+class ObjectStore {
+ public:
+  struct Handle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+  };
+
+  explicit ObjectStore(uint32_t capacity);
+
+  // Returns an invalid handle (index UINT32_MAX) if the store is full. New
+  // objects are visible.
+  Handle Add(float x,
+             float y,
+             float z,
+             float radius,
+             Mat4 transform,
+             uint32_t materialKey,
+             uint32_t meshId);
+  // Returns false if |handle| is stale or invalid.
+  bool Remove(Handle handle);
+
+  bool IsAlive(Handle handle) const;
+  // |handle| must be alive.
+  uint32_t SlotOf(Handle handle) const {
+    assert(IsAlive(handle));
+    return handles_[handle.index].slot;
+  }
+
+  uint32_t Size() const { return size_; }
+  uint32_t Capacity() const { return capacity_; }
+
+  SphereArrays Bounds() const {
+    return {x_.data(), y_.data(), z_.data(), radius_.data()};
+  }
+  const Mat4* Transforms() const { return transforms_.data(); }
+  Mat4& Transform(uint32_t slot) { return transforms_[slot]; }
+  const uint32_t* MaterialKeys() const { return materialKeys_.data(); }
+  // MeshPool ids.
+  const uint32_t* MeshIds() const { return meshIds_.data(); }
+
+  bool IsVisible(uint32_t slot) const {
+    return (visibleBits_[slot / 64] >> (slot % 64)) & 1;
+  }
+  void SetVisible(uint32_t slot, bool visible);
+
+  // Removes the slots of hidden objects from |slots| in place, keeping the
+  // order. Returns the new count.
+  size_t FilterVisible(uint32_t* slots, size_t count) const;
+
+ private:
+  struct HandleEntry {
+    uint32_t slot;
+    uint32_t generation;
+    // False while the entry is on the free list, so no handle matches it.
+    bool live;
+  };
+
+  uint32_t capacity_;
+  uint32_t size_ = 0;
+
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<float> radius_;
+  std::vector<Mat4> transforms_;
+  std::vector<uint64_t> visibleBits_;
+  std::vector<uint32_t> materialKeys_;
+  std::vector<uint32_t> meshIds_;
+
+  std::vector<HandleEntry> handles_;
+  std::vector<uint32_t> handleBySlot_;
+  std::vector<uint32_t> freeHandles_;
+};
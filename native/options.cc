@@ -0,0 +1,191 @@
+#include "options.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Exactly one of the field pointers is set.
+struct OptionSpec {
+  const char* name;
+  const char* env;
+  std::string Options::*text;
+  int Options::*number;
+  bool Options::*flag;
+  const char* help;
+  // Text from a fixed set of keywords, stored lowercased.
+  bool keyword;
+};
+
+OptionSpec Text(const char* name,
+                const char* env,
+                std::string Options::*field,
+                const char* help) {
+  return {name, env, field, nullptr, nullptr, help, false};
+}
+
+OptionSpec Keyword(const char* name,
+                   const char* env,
+                   std::string Options::*field,
+                   const char* help) {
+  return {name, env, field, nullptr, nullptr, help, true};
+}
+
+OptionSpec Number(const char* name,
+                  const char* env,
+                  int Options::*field,
+                  const char* help) {
+  return {name, env, nullptr, field, nullptr, help, false};
+}
+
+OptionSpec Flag(const char* name, const char* env, bool Options::*field) {
+  return {name, env, nullptr, nullptr, field, "0|1", false};
+}
+
+const OptionSpec kOptionSpecs[] = {
+    Keyword("backend", "WEBGPU_BACKEND", &Options::backend,
+            "vulkan|metal|d3d12|d3d11|opengl|opengles|null|swiftshader"),
+    Keyword("adapter-type", "WEBGPU_ADAPTER_TYPE", &Options::adapterType,
+            "discrete|integrated|cpu"),
+    Text("adapter-name", "WEBGPU_ADAPTER_NAME", &Options::adapterName,
+         "case-insensitive adapter name substring"),
+    Keyword("cull", "WEBGPU_CULL", &Options::cull, "diamond|frustum"),
+    Number("threads", "WEBGPU_THREADS", &Options::threads, "count"),
+    Number("grid", "WEBGPU_GRID", &Options::grid, "objects per row"),
+    Keyword("encoding", "WEBGPU_ENCODING", &Options::encoding,
+            "bundles|passes|single"),
+    Keyword("depth", "WEBGPU_DEPTH", &Options::depth, "off|on|sorted"),
+    Number("overlap", "WEBGPU_OVERLAP", &Options::overlap, "grid cells"),
+    Number("bind-chunk", "WEBGPU_BIND_CHUNK", &Options::bindChunk, "objects"),
+    Number("frames-in-flight", "WEBGPU_FRAMES_IN_FLIGHT",
+           &Options::framesInFlight, "count"),
+    Keyword("throttle", "WEBGPU_THROTTLE", &Options::throttle, "block|skip"),
+    Keyword("present-mode", "WEBGPU_PRESENT_MODE", &Options::presentMode,
+            "fifo|mailbox|immediate"),
+    Number("target-fps", "WEBGPU_TARGET_FPS", &Options::targetFps, "Hz"),
+    Number("sim-rate", "WEBGPU_SIM_RATE", &Options::simRate, "Hz"),
+    Keyword("affinity", "WEBGPU_AFFINITY", &Options::affinity,
+            "none|compact|scatter|cpu list"),
+    Flag("raise-main-priority", "WEBGPU_RAISE_MAIN_PRIORITY",
+         &Options::raiseMainPriority),
+    Flag("affinity-bench", "WEBGPU_AFFINITY_BENCH", &Options::affinityBench),
+    Flag("headless", "WEBGPU_HEADLESS", &Options::headless),
+    Number("frames", "WEBGPU_FRAMES", &Options::frames, "count"),
+    Number("alloc-report", "WEBGPU_ALLOC_REPORT", &Options::allocReport,
+           "frames between reports"),
+    Number("alloc-budget", "WEBGPU_ALLOC_BUDGET", &Options::allocBudget,
+           "allocations per frame"),
+    Number("warmup-frames", "WEBGPU_WARMUP_FRAMES", &Options::warmupFrames,
+           "count"),
+    Number("stats-report", "WEBGPU_STATS_REPORT", &Options::statsReport,
+           "frames between reports"),
+    Flag("stats-title", "WEBGPU_STATS_TITLE", &Options::statsTitle),
+    Flag("stats-json", "WEBGPU_STATS_JSON", &Options::statsJson),
+    Number("overdraw-report", "WEBGPU_OVERDRAW_REPORT",
+           &Options::overdrawReport, "frames between reports"),
+    Text("capture", "WEBGPU_CAPTURE", &Options::capture, "file"),
+};
+
+// Returns false if |value| isn't valid for |spec|.
+bool SetOption(const OptionSpec& spec, const char* value, Options* options) {
+  if (spec.text) {
+    options->*spec.text = spec.keyword ? ToLower(value) : value;
+    return true;
+  }
+  char* end = nullptr;
+  long number = strtol(value, &end, 10);
+  if (*value == '\0' || *end != '\0') {
+    printf("Invalid value for --%s: %s\n", spec.name, value);
+    return false;
+  }
+  if (spec.number) {
+    options->*spec.number = static_cast<int>(number);
+  } else {
+    options->*spec.flag = number != 0;
+  }
+  return true;
+}
+
+}  // namespace
+
+void PrintUsage(const char* program) {
+  printf("Usage: %s [options]\n", program);
+  for (const OptionSpec& spec : kOptionSpecs) {
+    printf("  --%s=<%s>  (env %s)\n", spec.name, spec.help, spec.env);
+  }
+}
+
+std::string ToLower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return static_cast<char>(tolower(c)); });
+  return s;
+}
+
+const char* BackendOptionName(wgpu::BackendType type) {
+  switch (type) {
+    case wgpu::BackendType::Null:
+      return "null";
+    case wgpu::BackendType::D3D11:
+      return "d3d11";
+    case wgpu::BackendType::D3D12:
+      return "d3d12";
+    case wgpu::BackendType::Metal:
+      return "metal";
+    case wgpu::BackendType::Vulkan:
+      return "vulkan";
+    case wgpu::BackendType::OpenGL:
+      return "opengl";
+    case wgpu::BackendType::OpenGLES:
+      return "opengles";
+    default:
+      return "?";
+  }
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (const OptionSpec& spec : kOptionSpecs) {
+    if (const char* value = getenv(spec.env)) {
+      if (!SetOption(spec, value, options)) {
+        return false;
+      }
+    }
+  }
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool matched = false;
+    if (strncmp(arg, "--", 2) == 0) {
+      for (const OptionSpec& spec : kOptionSpecs) {
+        size_t len = strlen(spec.name);
+        if (strncmp(arg + 2, spec.name, len) != 0) {
+          continue;
+        }
+        if (arg[2 + len] == '=') {
+          if (!SetOption(spec, arg + 2 + len + 1, options)) {
+            return false;
+          }
+          matched = true;
+        } else if (arg[2 + len] == '\0' && spec.flag) {
+          options->*spec.flag = true;
+          matched = true;
+        }
+        if (matched) {
+          break;
+        }
+      }
+    }
+    if (!matched) {
+      if (strcmp(arg, "--help") == 0) {
+        options->help = true;
+      } else {
+        printf("Unknown argument: %s\n", arg);
+      }
+      PrintUsage(argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
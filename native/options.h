@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+
+#ifdef __EMSCRIPTEN__
+#include <webgpu/webgpu_cpp.h>
+#else
+#include <dawn/webgpu_cpp.h>
+#endif
+
+// Runtime configuration. Each option can be given on the command line as
+// --name=value, or through the environment variable listed next to it; the
+// command line wins. Flags may also be given as a bare --name.
+struct Options {
+  // Adapter selection. Empty means "no preference".
+  //   --backend       WEBGPU_BACKEND       vulkan, metal, d3d12, d3d11, opengl,
+  //                                        opengles, null, swiftshader
+  //   --adapter-type  WEBGPU_ADAPTER_TYPE  discrete, integrated, cpu
+  //   --adapter-name  WEBGPU_ADAPTER_NAME  case-insensitive name substring
+  std::string backend;
+  std::string adapterType;
+  std::string adapterName;
+
+  // Rendering.
+  //   --cull          WEBGPU_CULL          diamond (default), frustum
+  //   --threads       WEBGPU_THREADS       render worker count (default 4)
+  //   --grid          WEBGPU_GRID          objects per grid row; the scene has
+  //                                        grid^2 objects (default 16)
+  //   --encoding      WEBGPU_ENCODING      bundles (default), passes, single
+  //   --depth         WEBGPU_DEPTH         off (default); on: depth attachment
+  //                                        and depth test; sorted: also draw
+  //                                        each worker's objects front to back
+  //   --overlap       WEBGPU_OVERLAP       object size in grid cells (default
+  //                                        1); larger objects overlap at
+  //                                        staggered heights
+  //   --bind-chunk    WEBGPU_BIND_CHUNK    objects per transform binding, set
+  //                                        with dynamic offsets (default 0:
+  //                                        bind all at once)
+  //   --frames-in-flight WEBGPU_FRAMES_IN_FLIGHT
+  //                                        max frames submitted and not done on
+  //                                        the GPU, 1-8 (default 2)
+  //   --throttle      WEBGPU_THROTTLE      block (default): wait for a frame
+  //                                        to complete; skip: drop the frame
+  //                                        (always on the web)
+  std::string cull;
+  int threads = 4;
+  int grid = 16;
+  std::string encoding;
+  std::string depth;
+  int overlap = 1;
+  int bindChunk = 0;
+  int framesInFlight = 2;
+  std::string throttle;
+
+  // Presentation, pacing and simulation.
+  //   --present-mode  WEBGPU_PRESENT_MODE  fifo (default), mailbox, immediate;
+  //                                        a request; the backend may fall
+  //                                        back towards fifo (native only)
+  //   --target-fps    WEBGPU_TARGET_FPS    pace frame starts to this rate and
+  //                                        print the jitter at exit (default
+  //                                        0: unpaced)
+  //   --sim-rate      WEBGPU_SIM_RATE      step the animation on its own thread
+  //                                        at this rate, decoupled from frames
+  //                                        (default 0: once per frame)
+  std::string presentMode;
+  int targetFps = 0;
+  int simRate = 0;
+
+  // Thread placement; see thread_affinity.h.
+  //   --affinity (WEBGPU_AFFINITY): none (default), compact, scatter, or a
+  //     CPU list like 0,2,4-7
+  //   --raise-main-priority (WEBGPU_RAISE_MAIN_PRIORITY): ask the scheduler
+  //     to favour the main/submit thread
+  //   --affinity-bench (WEBGPU_AFFINITY_BENCH): time --frames frames under
+  //     each policy and print p50/p99 frame times
+  std::string affinity;
+  bool raiseMainPriority = false;
+  bool affinityBench = false;
+
+  // Headless runs (native only): render to an offscreen texture instead of a
+  // window, for |frames| frames (0 means until the window closes, so it is
+  // required with --headless).
+  //   --headless      WEBGPU_HEADLESS
+  //   --frames        WEBGPU_FRAMES
+  bool headless = false;
+  int frames = 0;
+
+  // Heap allocation reporting; see alloc_counter.h.
+  //   --alloc-report  WEBGPU_ALLOC_REPORT  print a report every N frames
+  //                                        (0: never)
+  //   --alloc-budget  WEBGPU_ALLOC_BUDGET  max allocations per steady-state
+  //                                        frame; a run that exceeds it exits
+  //                                        with an error
+  //   --warmup-frames WEBGPU_WARMUP_FRAMES frames before the steady state
+  int allocReport = 600;
+  int allocBudget = -1;
+  int warmupFrames = 120;
+
+  // Frame timing; see frame_stats.h. A summary of the frames after
+  // --warmup-frames is always printed at the end of a native run.
+  //   --stats-report  WEBGPU_STATS_REPORT  print frame/encode/done percentiles
+  //                                        every N frames (0: never)
+  //   --stats-title   WEBGPU_STATS_TITLE   show a rolling summary in the
+  //                                        window title (native only)
+  //   --stats-json    WEBGPU_STATS_JSON    also print the run summary and its
+  //                                        configuration as one JSON line, for
+  //                                        perf_regress.js
+  int statsReport = 600;
+  bool statsTitle = false;
+  bool statsJson = false;
+
+  // Overdraw measurement with occlusion queries; exact sample counts need a
+  // backend that counts them, like SwiftShader.
+  //   --overdraw-report WEBGPU_OVERDRAW_REPORT  print fragments per pixel
+  //                                             every N frames (0: never)
+  int overdrawReport = 0;
+
+  // Call capture (native only); see capture_webgpu.h and replay.cpp.
+  //   --capture       WEBGPU_CAPTURE       record every WebGPU call to this
+  //                                        file
+  std::string capture;
+
+  // Set by --help, which prints usage; not an option itself.
+  bool help = false;
+};
+
+// Fills |options| from the environment and |argv|. Returns false (after
+// printing usage) if an argument is unknown or invalid, or --help was passed;
+// the caller exits, with success only for --help.
+bool ParseOptions(int argc, char** argv, Options* options);
+
+void PrintUsage(const char* program);
+
+// Keyword option values (--backend, --depth, --encoding, ...) are lowercased
+// by ParseOptions, so they match case-insensitively; free text such as
+// --adapter-name or --capture is kept as given.
+std::string ToLower(std::string s);
+
+// The --backend value that selects |type|, such as "vulkan" or "opengles".
+const char* BackendOptionName(wgpu::BackendType type);
@@ -0,0 +1,246 @@
+// Headless performance regression check for the native app.
+//
+// $ npm run build-native
+// $ node perf_regress.js [options]
+//
+//   --bin=PATH          app to run (default out/native/hello)
+//   --baseline=PATH     baseline to compare against (default perf_baseline.json)
+//   --out=PATH          where to write this run's results (default
+//                       out/perf_results.json)
+//   --update-baseline   store this run's results as the new baseline
+//   --frames=N, --backend=NAME
+//                       override the baseline's run settings
+//
+// Runs the app once per (grid, threads, encoding, bindChunk) combination of the
+// baseline's matrix with --headless --stats-json and collects the p50/p99 of
+// the frame and encode timings, plus the time to the first present and to the
+// first frame that drew the scene. bindChunk is optional and defaults to [0], a
+// single transform binding; chunked runs also report their encode time relative
+// to it. A configuration regresses when one of them is slower than its baseline
+// by more than the relative tolerance for that percentile and by more than
+// minDeltaMs, which keeps sub-millisecond noise from failing the run. Startup
+// times use the startup and startupMinDeltaMs tolerances instead. On a
+// MOCK_WEBGPU build, each run's command-stream hash and draw count are stored
+// too, and a configuration whose stream differs from its baseline fails: the
+// app now submits different work for the same inputs. Exits with 1 if any
+// configuration regressed, failed to run or has no baseline result. A baseline
+// with no results at all only warns, until one is recorded. --update-baseline
+// refuses to store a baseline if any configuration failed to run.
+
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+const kMetrics = ['frame', 'encode'];
+const kPercentiles = ['p50', 'p99'];
+const kStartupMetrics = ['firstPresentMs', 'firstFrameMs'];
+
+function parseArgs(argv) {
+  const args = {
+    bin: path.join(__dirname, 'out', 'native', 'hello'),
+    baseline: path.join(__dirname, 'perf_baseline.json'),
+    out: path.join(__dirname, 'out', 'perf_results.json'),
+    updateBaseline: false,
+  };
+  for (const arg of argv) {
+    const [name, value] = arg.replace(/^--/, '').split('=');
+    switch (name) {
+      case 'bin': args.bin = value; break;
+      case 'baseline': args.baseline = value; break;
+      case 'out': args.out = value; break;
+      case 'update-baseline': args.updateBaseline = true; break;
+      case 'frames': args.frames = parseInt(value); break;
+      case 'backend': args.backend = value; break;
+      default:
+        console.error(`Unknown argument: ${arg}`);
+        process.exit(2);
+    }
+  }
+  return args;
+}
+
+// Keys of single-binding runs predate --bind-chunk and are kept as they were.
+function configKey(config) {
+  const key = `grid=${config.grid} threads=${config.threads} encoding=${config.encoding}`;
+  return config.bindChunk ? `${key} bind-chunk=${config.bindChunk}` : key;
+}
+
+function* configurations(matrix) {
+  for (const grid of matrix.grid) {
+    for (const threads of matrix.threads) {
+      for (const encoding of matrix.encoding) {
+        for (const bindChunk of matrix.bindChunk || [0]) {
+          yield { grid, threads, encoding, bindChunk };
+        }
+      }
+    }
+  }
+}
+
+function runConfig(bin, settings, config) {
+  const args = [
+    '--headless', '--stats-json', '--stats-report=0', '--alloc-report=0',
+    `--frames=${settings.frames}`, `--warmup-frames=${settings.warmupFrames}`,
+    `--backend=${settings.backend}`, `--grid=${config.grid}`,
+    `--threads=${config.threads}`, `--encoding=${config.encoding}`,
+    `--bind-chunk=${config.bindChunk}`,
+  ];
+  const result = spawnSync(bin, args, { encoding: 'utf8' });
+  if (result.status !== 0) {
+    throw new Error(`${bin} ${args.join(' ')} exited with ${result.status}:\n` +
+                    `${result.stdout}\n${result.stderr}`);
+  }
+  const json = result.stdout.split('\n').find(line => line.startsWith('{'));
+  if (!json) {
+    throw new Error(`${bin} ${args.join(' ')} printed no --stats-json line`);
+  }
+  const run = JSON.parse(json);
+  const summary = {};
+  for (const metric of kMetrics) {
+    summary[metric] = {};
+    for (const p of kPercentiles) {
+      summary[metric][p] = run.stats[metric][p];
+    }
+  }
+  if (run.startup) {
+    summary.startup = {};
+    for (const metric of kStartupMetrics) {
+      summary.startup[metric] = run.startup[metric];
+    }
+  }
+  if (run.mock) {
+    summary.mock = { draws: run.mock.draws, streamHash: run.mock.streamHash };
+  }
+  return summary;
+}
+
+// Returns a list of "metric pN: baseline -> current" strings for the
+// regressions of |current| against |baseline|.
+function compare(baseline, current, tolerance) {
+  const regressions = [];
+  for (const metric of kMetrics) {
+    for (const p of kPercentiles) {
+      const before = baseline[metric][p];
+      const after = current[metric][p];
+      const delta = after - before;
+      if (delta > tolerance.minDeltaMs && delta > before * tolerance[p]) {
+        regressions.push(`${metric} ${p}: ${before.toFixed(3)} -> ${after.toFixed(3)} ms ` +
+                         `(+${(100 * delta / before).toFixed(0)}%)`);
+      }
+    }
+  }
+  // Startup times are one sample per run, so they get their own, looser tolerance.
+  // A run that never drew (null) regresses against a baseline that did.
+  if (baseline.startup && current.startup) {
+    for (const metric of kStartupMetrics) {
+      const before = baseline.startup[metric];
+      const after = current.startup[metric];
+      if (before === null || before === undefined) {
+        continue;
+      }
+      if (after === null || after === undefined) {
+        regressions.push(`${metric}: ${before.toFixed(1)} ms -> never reached`);
+        continue;
+      }
+      const delta = after - before;
+      if (delta > tolerance.startupMinDeltaMs && delta > before * tolerance.startup) {
+        regressions.push(`${metric}: ${before.toFixed(1)} -> ${after.toFixed(1)} ms ` +
+                         `(+${(100 * delta / before).toFixed(0)}%)`);
+      }
+    }
+  }
+  // Only mock runs have a command stream to compare, and only against a mock baseline.
+  if (baseline.mock && current.mock) {
+    if (current.mock.draws !== baseline.mock.draws) {
+      regressions.push(`draws: ${baseline.mock.draws} -> ${current.mock.draws}`);
+    }
+    if (current.mock.streamHash !== baseline.mock.streamHash) {
+      regressions.push(`stream hash: ${baseline.mock.streamHash} -> ` +
+                       `${current.mock.streamHash}`);
+    }
+  }
+  return regressions;
+}
+
+const args = parseArgs(process.argv.slice(2));
+const baseline = JSON.parse(fs.readFileSync(args.baseline, 'utf8'));
+const settings = {
+  ...baseline.settings,
+  ...(args.frames ? { frames: args.frames } : {}),
+  ...(args.backend ? { backend: args.backend } : {}),
+};
+
+// Until a baseline has been recorded at all, missing results only warn, so the
+// check can run before the reference machine has stored one.
+const baselineRecorded = Object.keys(baseline.results || {}).length > 0;
+const results = {};
+const rows = [['configuration', 'frame p50', 'frame p99', 'encode p50', 'encode p99',
+               'encode speedup', 'vs one binding', 'first frame', 'vs baseline']];
+let failed = false;
+for (const config of configurations(baseline.matrix)) {
+  const key = configKey(config);
+  let summary;
+  try {
+    summary = runConfig(args.bin, settings, config);
+  } catch (e) {
+    console.error(e.message);
+    rows.push([key, 'FAILED to run', '', '', '', '', '', '', '']);
+    failed = true;
+    continue;
+  }
+  results[key] = summary;
+
+  // Against the single-threaded run of the same grid and encoding, if swept.
+  const single = results[configKey({ ...config, threads: 1 })];
+  const speedup = single ? (single.encode.p50 / summary.encode.p50).toFixed(2) + 'x' : '';
+  // Encode cost of dynamic-offset chunks against one large binding of the same run.
+  const whole = config.bindChunk ? results[configKey({ ...config, bindChunk: 0 })] : null;
+  const bindCost = whole ? (summary.encode.p50 / whole.encode.p50).toFixed(2) + 'x' : '';
+
+  let verdict;
+  if (args.updateBaseline) {
+    verdict = 'stored';
+  } else if (!baselineRecorded) {
+    verdict = 'no baseline yet';
+  } else if (!baseline.results[key]) {
+    verdict = 'MISSING baseline';
+    failed = true;
+  } else {
+    const regressions = compare(baseline.results[key], summary, baseline.tolerance);
+    verdict = regressions.length ? 'REGRESSED: ' + regressions.join(', ') : 'ok';
+    failed = failed || regressions.length > 0;
+  }
+  const firstFrame = summary.startup && summary.startup.firstFrameMs !== null
+      ? summary.startup.firstFrameMs.toFixed(1) : '';
+  rows.push([key, summary.frame.p50.toFixed(3), summary.frame.p99.toFixed(3),
+             summary.encode.p50.toFixed(3), summary.encode.p99.toFixed(3), speedup, bindCost,
+             firstFrame, verdict]);
+}
+
+const widths = rows[0].map((_, i) => Math.max(...rows.map(row => row[i].length)));
+for (const row of rows) {
+  console.log(row.map((cell, i) => cell.padEnd(widths[i])).join('  ').trimEnd());
+}
+
+const report = { settings, results };
+fs.mkdirSync(path.dirname(args.out), { recursive: true });
+fs.writeFileSync(args.out, JSON.stringify(report, null, 2) + '\n');
+console.log(`\nresults written to ${args.out}`);
+
+if (args.updateBaseline) {
+  // A partial baseline would fail the next check on configurations nobody saw fail.
+  if (failed) {
+    console.log('baseline NOT updated: some configurations failed to run');
+    process.exit(1);
+  }
+  baseline.settings = settings;
+  baseline.results = results;
+  fs.writeFileSync(args.baseline, JSON.stringify(baseline, null, 2) + '\n');
+  console.log(`baseline updated: ${args.baseline}`);
+} else if (failed) {
+  console.log('performance regression check FAILED');
+  process.exit(1);
+} else if (!baselineRecorded) {
+  console.log(`WARNING: ${args.baseline} has no results yet; record them with ` +
+              '--update-baseline on the reference machine');
+}
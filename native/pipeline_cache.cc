@@ -0,0 +1,216 @@
+#include "pipeline_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+double NowMs() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void HashCombine(size_t* seed, size_t value) {
+  *seed ^= value + 0x9e3779b9 + (*seed << 6) + (*seed >> 2);
+}
+
+// "main_v/main_f kQuadPerSide=64 depth", enough to tell variants apart in logs.
+std::string Describe(const PipelineKey& key) {
+  std::string text = key.vertexEntryPoint + "/" + key.fragmentEntryPoint;
+  char buffer[64];
+  for (const auto& constant : key.constants) {
+    snprintf(buffer, sizeof(buffer), " %s=%g", constant.first.c_str(),
+             constant.second);
+    text += buffer;
+  }
+  if (key.depthFormat != wgpu::TextureFormat::Undefined) {
+    text += " depth";
+  }
+  return text;
+}
+
+}  // namespace
+
+PipelineKey::PipelineKey(wgpu::ShaderModule module,
+                         std::string vertexEntryPoint,
+                         std::string fragmentEntryPoint,
+                         std::vector<std::pair<std::string, double>> constants,
+                         std::vector<wgpu::TextureFormat> colorFormats,
+                         wgpu::TextureFormat depthFormat)
+    : module(std::move(module)),
+      vertexEntryPoint(std::move(vertexEntryPoint)),
+      fragmentEntryPoint(std::move(fragmentEntryPoint)),
+      constants(std::move(constants)),
+      colorFormats(std::move(colorFormats)),
+      depthFormat(depthFormat) {
+  std::sort(this->constants.begin(), this->constants.end());
+
+  HashCombine(&hash, std::hash<const void*>()(this->module.Get()));
+  HashCombine(&hash, std::hash<std::string>()(this->vertexEntryPoint));
+  HashCombine(&hash, std::hash<std::string>()(this->fragmentEntryPoint));
+  for (const auto& constant : this->constants) {
+    HashCombine(&hash, std::hash<std::string>()(constant.first));
+    HashCombine(&hash, std::hash<double>()(constant.second));
+  }
+  for (wgpu::TextureFormat format : this->colorFormats) {
+    HashCombine(&hash, static_cast<size_t>(format));
+  }
+  HashCombine(&hash, static_cast<size_t>(depthFormat));
+}
+
+bool PipelineKey::operator==(const PipelineKey& o) const {
+  return hash == o.hash && module.Get() == o.module.Get() &&
+         vertexEntryPoint == o.vertexEntryPoint &&
+         fragmentEntryPoint == o.fragmentEntryPoint &&
+         constants == o.constants && colorFormats == o.colorFormats &&
+         depthFormat == o.depthFormat;
+}
+
+PipelineCache::PipelineCache(wgpu::Device device,
+                             wgpu::PipelineLayout layout,
+                             const wgpu::VertexBufferLayout& vertexLayout,
+                             std::mutex& deviceMutex)
+    : device_(std::move(device)),
+      layout_(std::move(layout)),
+      vertexAttributes_(vertexLayout.attributes,
+                        vertexLayout.attributes + vertexLayout.attributeCount),
+      vertexLayout_(vertexLayout),
+      deviceMutex_(deviceMutex) {
+  vertexLayout_.attributes = vertexAttributes_.data();
+}
+
+PipelineCache::~PipelineCache() {
+  // Callers must have drained pending CreateRenderPipelineAsync callbacks
+  // (e.g. by ticking the device) before destroying the cache.
+  for (auto& slot : slots_) {
+    delete slot.load(std::memory_order_acquire);
+  }
+}
+
+PipelineCache::Entry* PipelineCache::Probe(const PipelineKey& key,
+                                           size_t* freeSlot) const {
+  size_t mask = kCapacity - 1;
+  for (size_t i = 0; i < kCapacity; i++) {
+    size_t index = (key.hash + i) & mask;
+    Entry* entry = slots_[index].load(std::memory_order_acquire);
+    if (entry == nullptr) {
+      if (freeSlot) {
+        *freeSlot = index;
+      }
+      return nullptr;
+    }
+    if (entry->key == key) {
+      return entry;
+    }
+  }
+  if (freeSlot) {
+    *freeSlot = kCapacity;
+  }
+  return nullptr;
+}
+
+const wgpu::RenderPipeline* PipelineCache::Find(const PipelineKey& key) const {
+  Entry* entry = Probe(key, nullptr);
+  if (entry && entry->state.load(std::memory_order_acquire) == State::Ready) {
+    return &entry->pipeline;
+  }
+  return nullptr;
+}
+
+const wgpu::RenderPipeline* PipelineCache::GetOrCreateAsync(
+    const PipelineKey& key) {
+  if (Probe(key, nullptr)) {
+    return Find(key);
+  }
+
+  Entry* entry = nullptr;
+  {
+    std::scoped_lock lock(insertMutex_);
+    // Another thread may have inserted the key since the lock-free probe.
+    size_t freeSlot = kCapacity;
+    if (Probe(key, &freeSlot)) {
+      return Find(key);
+    }
+    if (freeSlot == kCapacity) {
+      printf("PipelineCache: capacity (%zu) exhausted\n", kCapacity);
+      return nullptr;
+    }
+
+    entry = new Entry;
+    entry->cache = this;
+    entry->key = key;
+    entry->requestedMs = NowMs();
+    slots_[freeSlot].store(entry, std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  CreateAsync(entry);
+  return nullptr;
+}
+
+void PipelineCache::CreateAsync(Entry* entry) {
+  const PipelineKey& key = entry->key;
+
+  std::vector<wgpu::ColorTargetState> targets(key.colorFormats.size());
+  for (size_t i = 0; i < targets.size(); i++) {
+    targets[i].format = key.colorFormats[i];
+  }
+
+  std::vector<wgpu::ConstantEntry> constants(key.constants.size());
+  for (size_t i = 0; i < constants.size(); i++) {
+    constants[i].key = key.constants[i].first.c_str();
+    constants[i].value = key.constants[i].second;
+  }
+
+  wgpu::FragmentState fragmentState{};
+  fragmentState.module = key.module;
+  fragmentState.entryPoint = key.fragmentEntryPoint.c_str();
+  fragmentState.targetCount = targets.size();
+  fragmentState.targets = targets.data();
+  fragmentState.constantCount = constants.size();
+  fragmentState.constants = constants.data();
+
+  wgpu::RenderPipelineDescriptor descriptor{};
+  descriptor.layout = layout_;
+  descriptor.vertex.module = key.module;
+  descriptor.vertex.entryPoint = key.vertexEntryPoint.c_str();
+  descriptor.vertex.bufferCount = 1;
+  descriptor.vertex.buffers = &vertexLayout_;
+  descriptor.fragment = &fragmentState;
+  descriptor.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+
+  wgpu::DepthStencilState depthStencil{};
+  if (key.depthFormat != wgpu::TextureFormat::Undefined) {
+    depthStencil.format = key.depthFormat;
+    depthStencil.depthWriteEnabled = true;
+    depthStencil.depthCompare = wgpu::CompareFunction::Less;
+    descriptor.depthStencil = &depthStencil;
+  }
+
+  std::scoped_lock lock(deviceMutex_);
+  // The callback runs from device.Tick() (or the browser event loop), which
+  // may already hold deviceMutex_, so it only publishes the result.
+  device_.CreateRenderPipelineAsync(
+      &descriptor,
+      [](WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline result,
+         const char* message, void* userdata) {
+        Entry* entry = reinterpret_cast<Entry*>(userdata);
+        if (status != WGPUCreatePipelineAsyncStatus_Success) {
+          printf("PipelineCache: CreateRenderPipelineAsync failed for %s: %s\n",
+                 Describe(entry->key).c_str(), message ? message : "");
+          entry->state.store(State::Failed, std::memory_order_release);
+          return;
+        }
+        entry->pipeline = wgpu::RenderPipeline::Acquire(result);
+        entry->state.store(State::Ready, std::memory_order_release);
+        PipelineCache* cache = entry->cache;
+        size_t ready = cache->ready_.fetch_add(1, std::memory_order_relaxed) + 1;
+        printf("[pipeline-cache] %s compiled in %.2f ms (%zu of %zu ready)\n",
+               Describe(entry->key).c_str(), NowMs() - entry->requestedMs,
+               ready, cache->Size());
+      },
+      entry);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <webgpu/webgpu_cpp.h>
+#else
+#include <dawn/webgpu_cpp.h>
+#endif
+
+// Everything that distinguishes one render pipeline variant from another. The
+// pipeline layout, vertex buffer layout and primitive state are fixed per cache.
+struct PipelineKey {
+  PipelineKey() = default;
+  PipelineKey(wgpu::ShaderModule module,
+              std::string vertexEntryPoint,
+              std::string fragmentEntryPoint,
+              std::vector<std::pair<std::string, double>> constants,
+              std::vector<wgpu::TextureFormat> colorFormats,
+              wgpu::TextureFormat depthFormat = wgpu::TextureFormat::Undefined);
+
+  wgpu::ShaderModule module;
+  std::string vertexEntryPoint;
+  std::string fragmentEntryPoint;
+  // Override constants, kept sorted by name so equal sets compare equal.
+  std::vector<std::pair<std::string, double>> constants;
+  std::vector<wgpu::TextureFormat> colorFormats;
+  // Undefined for pipelines without a depth attachment. Otherwise depth is
+  // tested (less) and written.
+  wgpu::TextureFormat depthFormat = wgpu::TextureFormat::Undefined;
+
+  // Computed once at construction so lookups don't rehash strings.
+  size_t hash = 0;
+
+  bool operator==(const PipelineKey& o) const;
+};
+
+// Thread-safe cache of render pipelines keyed on PipelineKey.
+//
+// Entries are never evicted, so a hit is a lock-free probe of an open-addressed
+// table of atomically published entries. A miss takes a mutex, re-probes, and
+// starts exactly one CreateRenderPipelineAsync for the key; concurrent misses on
+// the same key find the pending entry instead of creating a duplicate.
+class PipelineCache {
+ public:
+  static constexpr size_t kCapacity = 256;
+
+  // |deviceMutex| is held around device calls, matching the rest of main.cpp.
+  // |vertexLayout| (and its attributes) is copied; pipelines read it from
+  // vertex buffer slot 0.
+  PipelineCache(wgpu::Device device,
+                wgpu::PipelineLayout layout,
+                const wgpu::VertexBufferLayout& vertexLayout,
+                std::mutex& deviceMutex);
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache&) = delete;
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  // Returns the compiled pipeline, or null if it is missing or still compiling.
+  // Never blocks.
+  const wgpu::RenderPipeline* Find(const PipelineKey& key) const;
+
+  // Like Find(), but starts compilation on a miss.
+  const wgpu::RenderPipeline* GetOrCreateAsync(const PipelineKey& key);
+
+  size_t Size() const { return size_.load(std::memory_order_relaxed); }
+  // Entries that have finished compiling.
+  size_t ReadyCount() const { return ready_.load(std::memory_order_relaxed); }
+
+ private:
+  enum class State { Pending, Ready, Failed };
+
+  struct Entry {
+    PipelineCache* cache = nullptr;
+    PipelineKey key;
+    wgpu::RenderPipeline pipeline;
+    std::atomic<State> state{State::Pending};
+    double requestedMs = 0;
+  };
+
+  Entry* Probe(const PipelineKey& key, size_t* freeSlot) const;
+  void CreateAsync(Entry* entry);
+
+  wgpu::Device device_;
+  wgpu::PipelineLayout layout_;
+  std::vector<wgpu::VertexAttribute> vertexAttributes_;
+  wgpu::VertexBufferLayout vertexLayout_;
+  std::mutex& deviceMutex_;
+
+  std::mutex insertMutex_;
+  std::array<std::atomic<Entry*>, kCapacity> slots_{};
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> ready_{0};
+};
@@ -0,0 +1,86 @@
+#include "range_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+double RangeAllocator::Stats::Fragmentation() const {
+  uint64_t freeSpace = capacity - used;
+  if (freeSpace == 0) {
+    return 0;
+  }
+  return 1.0 - static_cast<double>(largestFreeBlock) / freeSpace;
+}
+
+double RangeAllocator::Stats::Utilization() const {
+  return capacity ? static_cast<double>(used) / capacity : 0;
+}
+
+RangeAllocator::RangeAllocator(uint64_t capacity) : capacity_(capacity) {
+  if (capacity > 0) {
+    free_.emplace(0, capacity);
+  }
+}
+
+uint64_t RangeAllocator::Allocate(uint64_t size, uint64_t alignment) {
+  assert(size > 0 && alignment > 0 && (alignment & (alignment - 1)) == 0);
+  for (auto it = free_.begin(); it != free_.end(); ++it) {
+    uint64_t blockStart = it->first;
+    uint64_t blockEnd = blockStart + it->second;
+    uint64_t offset = (blockStart + alignment - 1) & ~(alignment - 1);
+    if (offset + size > blockEnd) {
+      continue;
+    }
+
+    // Split the block into the alignment padding before the range and the
+    // remainder after it; either may be empty.
+    free_.erase(it);
+    if (offset > blockStart) {
+      free_.emplace(blockStart, offset - blockStart);
+    }
+    if (offset + size < blockEnd) {
+      free_.emplace(offset + size, blockEnd - offset - size);
+    }
+    used_ += size;
+    allocations_++;
+    return offset;
+  }
+  return kInvalidOffset;
+}
+
+void RangeAllocator::Free(uint64_t offset, uint64_t size) {
+  assert(offset + size <= capacity_);
+  auto next = free_.lower_bound(offset);
+  assert(next == free_.end() || next->first >= offset + size);
+
+  uint64_t start = offset;
+  uint64_t end = offset + size;
+  if (next != free_.begin()) {
+    auto prev = std::prev(next);
+    assert(prev->first + prev->second <= offset);
+    if (prev->first + prev->second == offset) {
+      start = prev->first;
+      free_.erase(prev);
+    }
+  }
+  if (next != free_.end() && next->first == end) {
+    end += next->second;
+    free_.erase(next);
+  }
+  free_.emplace(start, end - start);
+
+  used_ -= size;
+  allocations_--;
+}
+
+RangeAllocator::Stats RangeAllocator::GetStats() const {
+  Stats stats;
+  stats.capacity = capacity_;
+  stats.used = used_;
+  stats.allocations = allocations_;
+  stats.freeBlocks = static_cast<uint32_t>(free_.size());
+  for (const auto& block : free_) {
+    stats.largestFreeBlock = std::max(stats.largestFreeBlock, block.second);
+  }
+  return stats;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+// Hands out aligned [offset, offset + size) ranges of a fixed-size space, such
+// as the elements of a GPU buffer. The allocator only does the bookkeeping; it
+// never touches the memory it manages.
+//
+// Free space is a list of blocks sorted by offset. Allocate() takes the first
+// block that fits (after alignment) and Free() merges the range back with its
+// free neighbours, so long-lived allocations of mixed sizes fragment slowly.
+// Both are O(free blocks).
+class RangeAllocator {
+ public:
+  static constexpr uint64_t kInvalidOffset = UINT64_MAX;
+
+  struct Stats {
+    uint64_t capacity = 0;
+    uint64_t used = 0;
+    uint32_t allocations = 0;
+    uint32_t freeBlocks = 0;
+    uint64_t largestFreeBlock = 0;
+
+    // Share of the free space outside the largest free block: 0 when the free
+    // space is one block, close to 1 when it is scattered in small pieces.
+    double Fragmentation() const;
+    double Utilization() const;
+  };
+
+  explicit RangeAllocator(uint64_t capacity);
+
+  // Returns the offset of a range of |size| units, a multiple of |alignment|
+  // (a power of two), or kInvalidOffset if no free block can hold it.
+  uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+  // Returns a range from Allocate(); |size| must be the size it was given.
+  void Free(uint64_t offset, uint64_t size);
+
+  Stats GetStats() const;
+
+ private:
+  // Free blocks: offset -> size. Adjacent blocks are always merged.
+  std::map<uint64_t, uint64_t> free_;
+  uint64_t capacity_;
+  uint64_t used_ = 0;
+  uint32_t allocations_ = 0;
+};
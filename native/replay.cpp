@@ -0,0 +1,1112 @@
+// Headless replay of a capture recorded with --capture (see capture_webgpu.h).
+//
+// $ out/native/replay CAPTURE [--threads=original|single] [--backend=NAME]
+//                     [--slowest=N]
+//
+// Creates a Dawn device on its own (--backend picks the first adapter with
+// that backend, as in the app) and issues the captured calls again as fast as
+// it can, with none of the app's own work in between: no animation, culling
+// or job scheduling. What is left is the cost of the WebGPU calls themselves,
+// per frame and split into stages:
+//   create    object creation on the device (encoders included)
+//   encode    render pass and bundle recording, and Finish()
+//   queue     WriteBuffer and Submit
+//   lifetime  Reference and Release
+//
+// --threads=original (the default) replays each captured thread's calls on a
+// thread of its own. A call that uses an object another thread creates waits
+// for it, queue calls (WriteBuffer and Submit) run in capture order across
+// threads, and releases are held to the end of the frame: without the app's
+// job graph nothing else orders them against other threads' last uses.
+// --threads=single makes every call from one thread, in capture order.
+//
+// Frames are timed individually, and the slowest ones are listed with the
+// app's inputs for them (frameTime, focus point and cull radius), to be
+// looked at in the app.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dawn/dawn_proc.h>
+#include <dawn/native/DawnNative.h>
+#include <dawn/webgpu.h>
+
+#include "capture_format.h"
+#include "frame_stats.h"
+#include "options.h"
+#include "threadpool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+struct ReplayRecord {
+  CaptureOp op;
+  uint8_t thread;
+  uint32_t size;
+  const uint8_t* payload;
+  // Position among the capture's queue records (WriteBuffer and Submit).
+  uint32_t queueOrder = 0;
+};
+
+struct ReplayFrame {
+  uint32_t frameTime;
+  float focusX;
+  float focusY;
+  float cullRadius;
+  // Records [begin, end) of Capture::records.
+  size_t begin;
+  size_t end;
+};
+
+struct Capture {
+  std::vector<uint8_t> data;
+  std::vector<ReplayRecord> records;
+  // Records before the first frame come from init().
+  size_t initEnd = 0;
+  std::vector<ReplayFrame> frames;
+  // Largest object id + 1.
+  uint32_t objectCount = 1;
+  uint32_t threadCount = 1;
+};
+
+bool CreatesObject(CaptureOp op) {
+  return op >= CaptureOp::Device && op <= CaptureOp::RenderBundleEncoderFinish;
+}
+
+bool IsQueueOp(CaptureOp op) {
+  return op == CaptureOp::WriteBuffer || op == CaptureOp::Submit;
+}
+
+bool LoadCapture(const char* path, Capture* capture) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "[replay] can't open %s\n", path);
+    return false;
+  }
+  uint8_t chunk[1 << 16];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    capture->data.insert(capture->data.end(), chunk, chunk + read);
+  }
+  fclose(file);
+
+  const std::vector<uint8_t>& data = capture->data;
+  if (data.size() < sizeof(kCaptureMagic) ||
+      memcmp(data.data(), kCaptureMagic, sizeof(kCaptureMagic)) != 0) {
+    fprintf(stderr, "[replay] %s is not a capture\n", path);
+    return false;
+  }
+
+  CaptureReader reader(data.data() + sizeof(kCaptureMagic),
+                       data.size() - sizeof(kCaptureMagic));
+  bool inInit = true;
+  uint32_t queueOps = 0;
+  while (!reader.AtEnd()) {
+    ReplayRecord record;
+    uint8_t op = reader.U8();
+    record.thread = reader.U8();
+    record.size = reader.U32();
+    record.payload = reader.Bytes(record.size);
+    if (reader.Failed() || op >= static_cast<uint8_t>(CaptureOp::Count)) {
+      fprintf(stderr, "[replay] %s is truncated or corrupt after %zu records\n",
+              path, capture->records.size());
+      return false;
+    }
+    record.op = static_cast<CaptureOp>(op);
+    capture->threadCount =
+        std::max<uint32_t>(capture->threadCount, record.thread + 1u);
+
+    CaptureReader payload(record.payload, record.size);
+    if (record.op == CaptureOp::Frame) {
+      if (inInit) {
+        capture->initEnd = capture->records.size();
+        inInit = false;
+      } else {
+        capture->frames.back().end = capture->records.size();
+      }
+      ReplayFrame frame;
+      frame.frameTime = payload.U32();
+      frame.focusX = payload.Float();
+      frame.focusY = payload.Float();
+      frame.cullRadius = payload.Float();
+      frame.begin = capture->records.size() + 1;
+      frame.end = frame.begin;
+      capture->frames.push_back(frame);
+    } else if (CreatesObject(record.op)) {
+      uint32_t id = payload.U32();
+      if (id != kCaptureUnknownId) {
+        capture->objectCount = std::max(capture->objectCount, id + 1);
+      }
+    } else if (IsQueueOp(record.op)) {
+      record.queueOrder = queueOps++;
+    }
+    capture->records.push_back(record);
+  }
+  if (inInit) {
+    capture->initEnd = capture->records.size();
+  } else {
+    capture->frames.back().end = capture->records.size();
+  }
+  return true;
+}
+
+enum Stage { kCreate, kEncode, kQueue, kLifetime, kStageCount };
+
+const char* StageName(int stage) {
+  switch (stage) {
+    case kCreate:
+      return "create";
+    case kEncode:
+      return "encode";
+    case kQueue:
+      return "queue";
+    case kLifetime:
+      return "lifetime";
+    default:
+      return "?";
+  }
+}
+
+Stage StageOf(CaptureOp op) {
+  switch (op) {
+    case CaptureOp::BeginRenderPass:
+    case CaptureOp::CommandEncoderFinish:
+    case CaptureOp::RenderBundleEncoderFinish:
+      return kEncode;
+    case CaptureOp::Reference:
+    case CaptureOp::Release:
+      return kLifetime;
+    case CaptureOp::WriteBuffer:
+    case CaptureOp::Submit:
+      return kQueue;
+    default:
+      return op < CaptureOp::Reference ? kCreate : kEncode;
+  }
+}
+
+struct StageTimes {
+  double ms[kStageCount] = {};
+};
+
+#define REPLAY_OBJECT_TYPES(X) \
+  X(Device)                    \
+  X(Queue)                     \
+  X(ShaderModule)              \
+  X(BindGroupLayout)           \
+  X(PipelineLayout)            \
+  X(RenderPipeline)            \
+  X(Buffer)                    \
+  X(Texture)                   \
+  X(TextureView)               \
+  X(BindGroup)                 \
+  X(QuerySet)                  \
+  X(CommandEncoder)            \
+  X(RenderPassEncoder)         \
+  X(RenderBundleEncoder)       \
+  X(CommandBuffer)             \
+  X(RenderBundle)
+
+enum class Kind : uint8_t {
+  None,
+#define REPLAY_KIND(Type) Type,
+  REPLAY_OBJECT_TYPES(REPLAY_KIND)
+#undef REPLAY_KIND
+  // Stands in for the swap chain: |handle| is an offscreen WGPUTexture.
+  SwapChain,
+};
+
+struct ReplayObject {
+  void* handle = nullptr;
+  Kind kind = Kind::None;
+  // Set once the object exists, for threads waiting to use it.
+  std::atomic<bool> ready{false};
+};
+
+class Replayer {
+ public:
+  Replayer(WGPUDevice device, uint32_t objectCount, bool waitForObjects)
+      : device_(device),
+        objects_(new ReplayObject[objectCount]),
+        objectCount_(objectCount),
+        waitForObjects_(waitForObjects) {}
+
+  // Replays |record| on the calling thread and adds the time it took to its
+  // stage in |times|. If |deferred| is set, releases are appended to it
+  // instead. Queue records wait for the ones before them in the capture.
+  void Execute(const ReplayRecord& record,
+               StageTimes* times,
+               std::vector<const ReplayRecord*>* deferred);
+
+  void Tick() {
+    std::scoped_lock lock(deviceMutex_);
+    wgpuDeviceTick(device_);
+  }
+
+ private:
+  void Run(const ReplayRecord& record);
+  void Create(uint32_t id, Kind kind, void* handle);
+  // Waits for the object if another thread creates it.
+  ReplayObject* Find(uint32_t id);
+  template <typename Handle>
+  Handle Get(uint32_t id) {
+    ReplayObject* object = Find(id);
+    return object ? static_cast<Handle>(object->handle) : nullptr;
+  }
+  void Reference(uint32_t id);
+  void Release(uint32_t id);
+
+  void CreateRenderPipeline(uint32_t id, CaptureReader& r);
+  void BeginRenderPass(uint32_t id, CaptureReader& r);
+  void Encode(CaptureOp op, CaptureReader& r);
+
+  WGPUDevice device_;
+  std::unique_ptr<ReplayObject[]> objects_;
+  uint32_t objectCount_;
+  bool waitForObjects_;
+  // queueOrder of the next queue record to run. Threads only wait on objects
+  // their calls use, which doesn't order one thread's WriteBuffer against
+  // another's Submit, so queue records also take turns in capture order.
+  std::atomic<uint32_t> nextQueueOrder_{0};
+  // Device and queue calls are serialized, as in the app.
+  std::mutex deviceMutex_;
+};
+
+void Replayer::Execute(const ReplayRecord& record,
+                       StageTimes* times,
+                       std::vector<const ReplayRecord*>* deferred) {
+  if (deferred && record.op == CaptureOp::Release) {
+    deferred->push_back(&record);
+    return;
+  }
+  bool queueOp = IsQueueOp(record.op);
+  if (queueOp && waitForObjects_) {
+    while (nextQueueOrder_.load(std::memory_order_acquire) !=
+           record.queueOrder) {
+      std::this_thread::yield();
+    }
+  }
+  Clock::time_point start = Clock::now();
+  Run(record);
+  times->ms[StageOf(record.op)] += MsSince(start);
+  if (queueOp) {
+    nextQueueOrder_.store(record.queueOrder + 1, std::memory_order_release);
+  }
+}
+
+void Replayer::Create(uint32_t id, Kind kind, void* handle) {
+  if (id == 0 || id >= objectCount_) {
+    return;
+  }
+  ReplayObject& object = objects_[id];
+  object.handle = handle;
+  object.kind = kind;
+  object.ready.store(true, std::memory_order_release);
+}
+
+ReplayObject* Replayer::Find(uint32_t id) {
+  if (id == 0 || id >= objectCount_) {
+    return nullptr;
+  }
+  ReplayObject& object = objects_[id];
+  if (waitForObjects_) {
+    while (!object.ready.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  return &object;
+}
+
+void Replayer::Reference(uint32_t id) {
+  ReplayObject* object = Find(id);
+  if (!object || !object->handle) {
+    return;
+  }
+  switch (object->kind) {
+#define REPLAY_REFERENCE(Type)                                    \
+  case Kind::Type:                                                \
+    wgpu##Type##Reference(static_cast<WGPU##Type>(object->handle)); \
+    break;
+    REPLAY_OBJECT_TYPES(REPLAY_REFERENCE)
+#undef REPLAY_REFERENCE
+    case Kind::SwapChain:
+      wgpuTextureReference(static_cast<WGPUTexture>(object->handle));
+      break;
+    case Kind::None:
+      break;
+  }
+}
+
+void Replayer::Release(uint32_t id) {
+  ReplayObject* object = Find(id);
+  if (!object || !object->handle) {
+    return;
+  }
+  switch (object->kind) {
+#define REPLAY_RELEASE(Type)                                    \
+  case Kind::Type:                                              \
+    wgpu##Type##Release(static_cast<WGPU##Type>(object->handle)); \
+    break;
+    REPLAY_OBJECT_TYPES(REPLAY_RELEASE)
+#undef REPLAY_RELEASE
+    case Kind::SwapChain:
+      wgpuTextureRelease(static_cast<WGPUTexture>(object->handle));
+      break;
+    case Kind::None:
+      break;
+  }
+}
+
+void Replayer::Run(const ReplayRecord& record) {
+  CaptureReader r(record.payload, record.size);
+  switch (record.op) {
+    case CaptureOp::Frame:
+      break;
+
+    case CaptureOp::Device: {
+      uint32_t id = r.U32();
+      wgpuDeviceReference(device_);
+      Create(id, Kind::Device, device_);
+      break;
+    }
+    case CaptureOp::GetQueue: {
+      uint32_t id = r.U32();
+      std::scoped_lock lock(deviceMutex_);
+      WGPUQueue queue = wgpuDeviceGetQueue(device_);
+      if (id < objectCount_ && !objects_[id].handle) {
+        Create(id, Kind::Queue, queue);
+      }
+      break;
+    }
+    case CaptureOp::CreateShaderModule: {
+      uint32_t id = r.U32();
+      std::string source = r.String();
+      WGPUShaderModuleWGSLDescriptor wgsl = {};
+      wgsl.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
+      wgsl.source = source.c_str();
+      WGPUShaderModuleDescriptor descriptor = {};
+      descriptor.nextInChain = &wgsl.chain;
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::ShaderModule,
+             wgpuDeviceCreateShaderModule(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreateBindGroupLayout: {
+      uint32_t id = r.U32();
+      std::vector<WGPUBindGroupLayoutEntry> entries(r.U32());
+      for (WGPUBindGroupLayoutEntry& entry : entries) {
+        entry = {};
+        entry.binding = r.U32();
+        entry.visibility = r.U32();
+        entry.buffer.type = static_cast<WGPUBufferBindingType>(r.U32());
+        entry.buffer.hasDynamicOffset = r.U8();
+        entry.buffer.minBindingSize = r.Varint();
+        entry.sampler.type = static_cast<WGPUSamplerBindingType>(r.U32());
+        entry.texture.sampleType = static_cast<WGPUTextureSampleType>(r.U32());
+        entry.texture.viewDimension =
+            static_cast<WGPUTextureViewDimension>(r.U32());
+        entry.texture.multisampled = r.U8();
+        entry.storageTexture.access =
+            static_cast<WGPUStorageTextureAccess>(r.U32());
+        entry.storageTexture.format = static_cast<WGPUTextureFormat>(r.U32());
+        entry.storageTexture.viewDimension =
+            static_cast<WGPUTextureViewDimension>(r.U32());
+      }
+      WGPUBindGroupLayoutDescriptor descriptor = {};
+      descriptor.entryCount = static_cast<uint32_t>(entries.size());
+      descriptor.entries = entries.data();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::BindGroupLayout,
+             wgpuDeviceCreateBindGroupLayout(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreatePipelineLayout: {
+      uint32_t id = r.U32();
+      std::vector<WGPUBindGroupLayout> layouts(r.U32());
+      for (WGPUBindGroupLayout& layout : layouts) {
+        layout = Get<WGPUBindGroupLayout>(r.U32());
+      }
+      WGPUPipelineLayoutDescriptor descriptor = {};
+      descriptor.bindGroupLayoutCount = static_cast<uint32_t>(layouts.size());
+      descriptor.bindGroupLayouts = layouts.data();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::PipelineLayout,
+             wgpuDeviceCreatePipelineLayout(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreateRenderPipeline:
+      CreateRenderPipeline(r.U32(), r);
+      break;
+    case CaptureOp::CreateBuffer: {
+      uint32_t id = r.U32();
+      WGPUBufferDescriptor descriptor = {};
+      descriptor.usage = r.U32();
+      descriptor.size = r.Varint();
+      descriptor.mappedAtCreation = r.U8();
+      std::scoped_lock lock(deviceMutex_);
+      WGPUBuffer buffer = wgpuDeviceCreateBuffer(device_, &descriptor);
+      if (descriptor.mappedAtCreation) {
+        // What the app wrote through the mapping wasn't captured.
+        wgpuBufferUnmap(buffer);
+      }
+      Create(id, Kind::Buffer, buffer);
+      break;
+    }
+    case CaptureOp::CreateTexture: {
+      uint32_t id = r.U32();
+      WGPUTextureDescriptor descriptor = {};
+      descriptor.usage = r.U32();
+      descriptor.dimension = static_cast<WGPUTextureDimension>(r.U32());
+      descriptor.size.width = r.U32();
+      descriptor.size.height = r.U32();
+      descriptor.size.depthOrArrayLayers = r.U32();
+      descriptor.format = static_cast<WGPUTextureFormat>(r.U32());
+      descriptor.mipLevelCount = r.U32();
+      descriptor.sampleCount = r.U32();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::Texture, wgpuDeviceCreateTexture(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreateTextureView: {
+      uint32_t id = r.U32();
+      WGPUTexture texture = Get<WGPUTexture>(r.U32());
+      WGPUTextureViewDescriptor descriptor = {};
+      bool hasDescriptor = r.U8();
+      if (hasDescriptor) {
+        descriptor.format = static_cast<WGPUTextureFormat>(r.U32());
+        descriptor.dimension = static_cast<WGPUTextureViewDimension>(r.U32());
+        descriptor.baseMipLevel = r.U32();
+        descriptor.mipLevelCount = r.U32();
+        descriptor.baseArrayLayer = r.U32();
+        descriptor.arrayLayerCount = r.U32();
+        descriptor.aspect = static_cast<WGPUTextureAspect>(r.U32());
+      }
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::TextureView,
+             wgpuTextureCreateView(texture,
+                                   hasDescriptor ? &descriptor : nullptr));
+      break;
+    }
+    case CaptureOp::CreateBindGroup: {
+      uint32_t id = r.U32();
+      WGPUBindGroupDescriptor descriptor = {};
+      descriptor.layout = Get<WGPUBindGroupLayout>(r.U32());
+      std::vector<WGPUBindGroupEntry> entries(r.U32());
+      for (WGPUBindGroupEntry& entry : entries) {
+        entry = {};
+        entry.binding = r.U32();
+        entry.buffer = Get<WGPUBuffer>(r.U32());
+        entry.offset = r.Varint();
+        entry.size = r.Varint();
+        // Samplers aren't captured.
+        r.U32();
+        entry.textureView = Get<WGPUTextureView>(r.U32());
+      }
+      descriptor.entryCount = static_cast<uint32_t>(entries.size());
+      descriptor.entries = entries.data();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::BindGroup,
+             wgpuDeviceCreateBindGroup(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreateQuerySet: {
+      uint32_t id = r.U32();
+      WGPUQuerySetDescriptor descriptor = {};
+      descriptor.type = static_cast<WGPUQueryType>(r.U32());
+      descriptor.count = r.U32();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::QuerySet,
+             wgpuDeviceCreateQuerySet(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::CreateSwapChain: {
+      uint32_t id = r.U32();
+      WGPUTextureDescriptor descriptor = {};
+      descriptor.usage = r.U32() | WGPUTextureUsage_RenderAttachment;
+      descriptor.format = static_cast<WGPUTextureFormat>(r.U32());
+      descriptor.dimension = WGPUTextureDimension_2D;
+      descriptor.size = {r.U32(), r.U32(), 1};
+      descriptor.mipLevelCount = 1;
+      descriptor.sampleCount = 1;
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::SwapChain,
+             wgpuDeviceCreateTexture(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::GetCurrentTextureView: {
+      uint32_t id = r.U32();
+      WGPUTexture backbuffer = Get<WGPUTexture>(r.U32());
+      if (id < objectCount_ && objects_[id].handle) {
+        // Another reference to this frame's view.
+        wgpuTextureViewReference(
+            static_cast<WGPUTextureView>(objects_[id].handle));
+        break;
+      }
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::TextureView, wgpuTextureCreateView(backbuffer, nullptr));
+      break;
+    }
+    case CaptureOp::CreateCommandEncoder: {
+      uint32_t id = r.U32();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::CommandEncoder,
+             wgpuDeviceCreateCommandEncoder(device_, nullptr));
+      break;
+    }
+    case CaptureOp::CreateRenderBundleEncoder: {
+      uint32_t id = r.U32();
+      std::vector<WGPUTextureFormat> colorFormats(r.U32());
+      for (WGPUTextureFormat& format : colorFormats) {
+        format = static_cast<WGPUTextureFormat>(r.U32());
+      }
+      WGPURenderBundleEncoderDescriptor descriptor = {};
+      descriptor.colorFormatsCount = static_cast<uint32_t>(colorFormats.size());
+      descriptor.colorFormats = colorFormats.data();
+      descriptor.depthStencilFormat = static_cast<WGPUTextureFormat>(r.U32());
+      descriptor.sampleCount = r.U32();
+      descriptor.depthReadOnly = r.U8();
+      descriptor.stencilReadOnly = r.U8();
+      std::scoped_lock lock(deviceMutex_);
+      Create(id, Kind::RenderBundleEncoder,
+             wgpuDeviceCreateRenderBundleEncoder(device_, &descriptor));
+      break;
+    }
+    case CaptureOp::BeginRenderPass:
+      BeginRenderPass(r.U32(), r);
+      break;
+    case CaptureOp::CommandEncoderFinish: {
+      uint32_t id = r.U32();
+      WGPUCommandEncoder encoder = Get<WGPUCommandEncoder>(r.U32());
+      Create(id, Kind::CommandBuffer,
+             wgpuCommandEncoderFinish(encoder, nullptr));
+      break;
+    }
+    case CaptureOp::RenderBundleEncoderFinish: {
+      uint32_t id = r.U32();
+      WGPURenderBundleEncoder encoder = Get<WGPURenderBundleEncoder>(r.U32());
+      Create(id, Kind::RenderBundle,
+             wgpuRenderBundleEncoderFinish(encoder, nullptr));
+      break;
+    }
+
+    case CaptureOp::Reference:
+      Reference(r.U32());
+      break;
+    case CaptureOp::Release:
+      Release(r.U32());
+      break;
+
+    case CaptureOp::WriteBuffer: {
+      WGPUQueue queue = Get<WGPUQueue>(r.U32());
+      WGPUBuffer buffer = Get<WGPUBuffer>(r.U32());
+      uint64_t offset = r.Varint();
+      size_t size = static_cast<size_t>(r.Varint());
+      const uint8_t* data = r.Bytes(size);
+      if (data) {
+        std::scoped_lock lock(deviceMutex_);
+        wgpuQueueWriteBuffer(queue, buffer, offset, data, size);
+      }
+      break;
+    }
+    case CaptureOp::Submit: {
+      WGPUQueue queue = Get<WGPUQueue>(r.U32());
+      std::vector<WGPUCommandBuffer> commands(r.U32());
+      for (WGPUCommandBuffer& command : commands) {
+        command = Get<WGPUCommandBuffer>(r.U32());
+      }
+      std::scoped_lock lock(deviceMutex_);
+      wgpuQueueSubmit(queue, static_cast<uint32_t>(commands.size()),
+                      commands.data());
+      break;
+    }
+
+    default:
+      Encode(record.op, r);
+      break;
+  }
+}
+
+void Replayer::CreateRenderPipeline(uint32_t id, CaptureReader& r) {
+  // Strings and arrays the descriptor points into.
+  std::deque<std::string> strings;
+  auto readConstants = [&](uint32_t* count,
+                           std::vector<WGPUConstantEntry>* constants) {
+    constants->resize(r.U32());
+    for (WGPUConstantEntry& constant : *constants) {
+      constant = {};
+      strings.push_back(r.String());
+      constant.key = strings.back().c_str();
+      constant.value = r.Double();
+    }
+    *count = static_cast<uint32_t>(constants->size());
+  };
+  auto readStencilFace = [&](WGPUStencilFaceState* face) {
+    face->compare = static_cast<WGPUCompareFunction>(r.U32());
+    face->failOp = static_cast<WGPUStencilOperation>(r.U32());
+    face->depthFailOp = static_cast<WGPUStencilOperation>(r.U32());
+    face->passOp = static_cast<WGPUStencilOperation>(r.U32());
+  };
+  auto readBlendComponent = [&](WGPUBlendComponent* component) {
+    component->operation = static_cast<WGPUBlendOperation>(r.U32());
+    component->srcFactor = static_cast<WGPUBlendFactor>(r.U32());
+    component->dstFactor = static_cast<WGPUBlendFactor>(r.U32());
+  };
+
+  WGPURenderPipelineDescriptor descriptor = {};
+  descriptor.layout = Get<WGPUPipelineLayout>(r.U32());
+
+  WGPUVertexState& vertex = descriptor.vertex;
+  std::vector<WGPUConstantEntry> vertexConstants;
+  std::vector<WGPUVertexBufferLayout> buffers;
+  std::vector<std::vector<WGPUVertexAttribute>> attributes;
+  vertex.module = Get<WGPUShaderModule>(r.U32());
+  strings.push_back(r.String());
+  vertex.entryPoint = strings.back().c_str();
+  readConstants(&vertex.constantCount, &vertexConstants);
+  vertex.constants = vertexConstants.data();
+  buffers.resize(r.U32());
+  attributes.resize(buffers.size());
+  for (size_t i = 0; i < buffers.size(); i++) {
+    buffers[i].arrayStride = r.Varint();
+    buffers[i].stepMode = static_cast<WGPUVertexStepMode>(r.U32());
+    attributes[i].resize(r.U32());
+    for (WGPUVertexAttribute& attribute : attributes[i]) {
+      attribute.format = static_cast<WGPUVertexFormat>(r.U32());
+      attribute.offset = r.Varint();
+      attribute.shaderLocation = r.U32();
+    }
+    buffers[i].attributeCount = static_cast<uint32_t>(attributes[i].size());
+    buffers[i].attributes = attributes[i].data();
+  }
+  vertex.bufferCount = static_cast<uint32_t>(buffers.size());
+  vertex.buffers = buffers.data();
+
+  WGPUPrimitiveState& primitive = descriptor.primitive;
+  primitive.topology = static_cast<WGPUPrimitiveTopology>(r.U32());
+  primitive.stripIndexFormat = static_cast<WGPUIndexFormat>(r.U32());
+  primitive.frontFace = static_cast<WGPUFrontFace>(r.U32());
+  primitive.cullMode = static_cast<WGPUCullMode>(r.U32());
+
+  WGPUDepthStencilState depthStencil = {};
+  if (r.U8()) {
+    depthStencil.format = static_cast<WGPUTextureFormat>(r.U32());
+    depthStencil.depthWriteEnabled = r.U8();
+    depthStencil.depthCompare = static_cast<WGPUCompareFunction>(r.U32());
+    readStencilFace(&depthStencil.stencilFront);
+    readStencilFace(&depthStencil.stencilBack);
+    depthStencil.stencilReadMask = r.U32();
+    depthStencil.stencilWriteMask = r.U32();
+    depthStencil.depthBias = static_cast<int32_t>(r.SignedVarint());
+    depthStencil.depthBiasSlopeScale = r.Float();
+    depthStencil.depthBiasClamp = r.Float();
+    descriptor.depthStencil = &depthStencil;
+  }
+
+  descriptor.multisample.count = r.U32();
+  descriptor.multisample.mask = r.U32();
+  descriptor.multisample.alphaToCoverageEnabled = r.U8();
+
+  WGPUFragmentState fragment = {};
+  std::vector<WGPUConstantEntry> fragmentConstants;
+  std::vector<WGPUColorTargetState> targets;
+  std::vector<WGPUBlendState> blends;
+  if (r.U8()) {
+    fragment.module = Get<WGPUShaderModule>(r.U32());
+    strings.push_back(r.String());
+    fragment.entryPoint = strings.back().c_str();
+    readConstants(&fragment.constantCount, &fragmentConstants);
+    fragment.constants = fragmentConstants.data();
+    targets.resize(r.U32());
+    blends.resize(targets.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+      targets[i] = {};
+      targets[i].format = static_cast<WGPUTextureFormat>(r.U32());
+      if (r.U8()) {
+        readBlendComponent(&blends[i].color);
+        readBlendComponent(&blends[i].alpha);
+        targets[i].blend = &blends[i];
+      }
+      targets[i].writeMask = r.U32();
+    }
+    fragment.targetCount = static_cast<uint32_t>(targets.size());
+    fragment.targets = targets.data();
+    descriptor.fragment = &fragment;
+  }
+
+  // Captured async creations replay synchronously.
+  std::scoped_lock lock(deviceMutex_);
+  Create(id, Kind::RenderPipeline,
+         wgpuDeviceCreateRenderPipeline(device_, &descriptor));
+}
+
+void Replayer::BeginRenderPass(uint32_t id, CaptureReader& r) {
+  WGPUCommandEncoder encoder = Get<WGPUCommandEncoder>(r.U32());
+  WGPURenderPassDescriptor descriptor = {};
+  std::vector<WGPURenderPassColorAttachment> colors(r.U32());
+  for (WGPURenderPassColorAttachment& color : colors) {
+    color = {};
+    color.view = Get<WGPUTextureView>(r.U32());
+    color.resolveTarget = Get<WGPUTextureView>(r.U32());
+    color.loadOp = static_cast<WGPULoadOp>(r.U32());
+    color.storeOp = static_cast<WGPUStoreOp>(r.U32());
+    color.clearValue.r = r.Double();
+    color.clearValue.g = r.Double();
+    color.clearValue.b = r.Double();
+    color.clearValue.a = r.Double();
+  }
+  descriptor.colorAttachmentCount = static_cast<uint32_t>(colors.size());
+  descriptor.colorAttachments = colors.data();
+
+  WGPURenderPassDepthStencilAttachment depth = {};
+  if (r.U8()) {
+    depth.view = Get<WGPUTextureView>(r.U32());
+    depth.depthLoadOp = static_cast<WGPULoadOp>(r.U32());
+    depth.depthStoreOp = static_cast<WGPUStoreOp>(r.U32());
+    depth.depthClearValue = r.Float();
+    depth.depthReadOnly = r.U8();
+    depth.stencilLoadOp = static_cast<WGPULoadOp>(r.U32());
+    depth.stencilStoreOp = static_cast<WGPUStoreOp>(r.U32());
+    depth.stencilClearValue = r.U32();
+    depth.stencilReadOnly = r.U8();
+    descriptor.depthStencilAttachment = &depth;
+  }
+  descriptor.occlusionQuerySet = Get<WGPUQuerySet>(r.U32());
+
+  Create(id, Kind::RenderPassEncoder,
+         wgpuCommandEncoderBeginRenderPass(encoder, &descriptor));
+}
+
+void Replayer::Encode(CaptureOp op, CaptureReader& r) {
+  ReplayObject* object = Find(r.U32());
+  if (!object || !object->handle) {
+    return;
+  }
+  bool isPass = object->kind == Kind::RenderPassEncoder;
+  WGPURenderPassEncoder pass =
+      static_cast<WGPURenderPassEncoder>(object->handle);
+  WGPURenderBundleEncoder bundle =
+      static_cast<WGPURenderBundleEncoder>(object->handle);
+
+  switch (op) {
+    case CaptureOp::SetPipeline: {
+      WGPURenderPipeline pipeline = Get<WGPURenderPipeline>(r.U32());
+      if (isPass) {
+        wgpuRenderPassEncoderSetPipeline(pass, pipeline);
+      } else {
+        wgpuRenderBundleEncoderSetPipeline(bundle, pipeline);
+      }
+      break;
+    }
+    case CaptureOp::SetBindGroup: {
+      uint32_t index = r.U32();
+      WGPUBindGroup group = Get<WGPUBindGroup>(r.U32());
+      uint32_t offsetCount = r.U32();
+      uint32_t offsets[8];
+      offsetCount = std::min<uint32_t>(offsetCount, 8);
+      for (uint32_t i = 0; i < offsetCount; i++) {
+        offsets[i] = r.U32();
+      }
+      if (isPass) {
+        wgpuRenderPassEncoderSetBindGroup(pass, index, group, offsetCount,
+                                          offsets);
+      } else {
+        wgpuRenderBundleEncoderSetBindGroup(bundle, index, group, offsetCount,
+                                            offsets);
+      }
+      break;
+    }
+    case CaptureOp::SetVertexBuffer: {
+      uint32_t slot = r.U32();
+      WGPUBuffer buffer = Get<WGPUBuffer>(r.U32());
+      uint64_t offset = r.Varint();
+      uint64_t size = r.Varint();
+      if (isPass) {
+        wgpuRenderPassEncoderSetVertexBuffer(pass, slot, buffer, offset, size);
+      } else {
+        wgpuRenderBundleEncoderSetVertexBuffer(bundle, slot, buffer, offset,
+                                               size);
+      }
+      break;
+    }
+    case CaptureOp::SetIndexBuffer: {
+      WGPUBuffer buffer = Get<WGPUBuffer>(r.U32());
+      WGPUIndexFormat format = static_cast<WGPUIndexFormat>(r.U32());
+      uint64_t offset = r.Varint();
+      uint64_t size = r.Varint();
+      if (isPass) {
+        wgpuRenderPassEncoderSetIndexBuffer(pass, buffer, format, offset, size);
+      } else {
+        wgpuRenderBundleEncoderSetIndexBuffer(bundle, buffer, format, offset,
+                                              size);
+      }
+      break;
+    }
+    case CaptureOp::Draw: {
+      uint32_t vertexCount = r.U32();
+      uint32_t instanceCount = r.U32();
+      uint32_t firstVertex = r.U32();
+      uint32_t firstInstance = r.U32();
+      if (isPass) {
+        wgpuRenderPassEncoderDraw(pass, vertexCount, instanceCount,
+                                  firstVertex, firstInstance);
+      } else {
+        wgpuRenderBundleEncoderDraw(bundle, vertexCount, instanceCount,
+                                    firstVertex, firstInstance);
+      }
+      break;
+    }
+    case CaptureOp::DrawIndexed: {
+      uint32_t indexCount = r.U32();
+      uint32_t instanceCount = r.U32();
+      uint32_t firstIndex = r.U32();
+      int32_t baseVertex = static_cast<int32_t>(r.SignedVarint());
+      uint32_t firstInstance = r.U32();
+      if (isPass) {
+        wgpuRenderPassEncoderDrawIndexed(pass, indexCount, instanceCount,
+                                         firstIndex, baseVertex,
+                                         firstInstance);
+      } else {
+        wgpuRenderBundleEncoderDrawIndexed(bundle, indexCount, instanceCount,
+                                           firstIndex, baseVertex,
+                                           firstInstance);
+      }
+      break;
+    }
+    case CaptureOp::ExecuteBundles: {
+      std::vector<WGPURenderBundle> bundles(r.U32());
+      for (WGPURenderBundle& executed : bundles) {
+        executed = Get<WGPURenderBundle>(r.U32());
+      }
+      wgpuRenderPassEncoderExecuteBundles(
+          pass, static_cast<uint32_t>(bundles.size()), bundles.data());
+      break;
+    }
+    case CaptureOp::BeginOcclusionQuery:
+      wgpuRenderPassEncoderBeginOcclusionQuery(pass, r.U32());
+      break;
+    case CaptureOp::EndOcclusionQuery:
+      wgpuRenderPassEncoderEndOcclusionQuery(pass);
+      break;
+    case CaptureOp::EndPass:
+      wgpuRenderPassEncoderEnd(pass);
+      break;
+    default:
+      break;
+  }
+}
+
+void PrintSummary(const char* name, const LatencyHistogram& histogram) {
+  LatencyHistogram::Summary s = histogram.Summarize();
+  printf("[replay] %-9s min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f ms\n",
+         name, s.min, s.p50, s.p90, s.p99, s.max);
+}
+
+std::atomic<uint64_t> gDeviceErrors{0};
+
+void PrintReplayUsage(const char* program) {
+  fprintf(stderr,
+          "usage: %s CAPTURE [--threads=original|single] [--backend=NAME] "
+          "[--slowest=N]\n",
+          program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  bool singleThread = false;
+  std::string backend;
+  int slowest = 5;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--threads=original") {
+      singleThread = false;
+    } else if (arg == "--threads=single") {
+      singleThread = true;
+    } else if (arg.rfind("--backend=", 0) == 0) {
+      backend = ToLower(arg.substr(strlen("--backend=")));
+    } else if (arg.rfind("--slowest=", 0) == 0) {
+      slowest = atoi(arg.c_str() + strlen("--slowest="));
+    } else if (arg[0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      PrintReplayUsage(argv[0]);
+      return 2;
+    }
+  }
+  if (!path) {
+    PrintReplayUsage(argv[0]);
+    return 2;
+  }
+
+  Capture capture;
+  if (!LoadCapture(path, &capture)) {
+    return 1;
+  }
+  printf("[replay] %s: %zu records, %zu frames, %u threads, %u objects\n",
+         path, capture.records.size(), capture.frames.size(),
+         capture.threadCount, capture.objectCount - 1);
+
+  dawn::native::Instance instance;
+  instance.DiscoverDefaultAdapters();
+  dawn::native::Adapter selected;
+  wgpu::AdapterProperties selectedProperties = {};
+  bool found = false;
+  for (const dawn::native::Adapter& adapter : instance.GetAdapters()) {
+    wgpu::AdapterProperties properties = {};
+    adapter.GetProperties(&properties);
+    bool matches = backend.empty()
+                       ? properties.adapterType != wgpu::AdapterType::CPU
+                       : backend == BackendOptionName(properties.backendType);
+    if (matches) {
+      selected = adapter;
+      selectedProperties = properties;
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "[replay] no adapter matches backend '%s'\n",
+            backend.c_str());
+    return 1;
+  }
+  WGPUDevice device = selected.CreateDevice();
+  DawnProcTable procs = dawn::native::GetProcs();
+  dawnProcSetProcs(&procs);
+  wgpuDeviceSetUncapturedErrorCallback(
+      device,
+      [](WGPUErrorType type, const char* message, void*) {
+        if (gDeviceErrors.fetch_add(1) < 10) {
+          fprintf(stderr, "[replay] device error %d: %s\n", type, message);
+        }
+      },
+      nullptr);
+  printf("[replay] adapter %s (%s), threads %s\n", selectedProperties.name,
+         BackendOptionName(selectedProperties.backendType),
+         singleThread ? "single" : "original");
+
+  Replayer replayer(device, capture.objectCount, !singleThread);
+  const std::vector<ReplayRecord>& records = capture.records;
+
+  Clock::time_point initStart = Clock::now();
+  StageTimes initTimes;
+  for (size_t i = 0; i < capture.initEnd; i++) {
+    replayer.Execute(records[i], &initTimes, nullptr);
+  }
+  replayer.Tick();
+  printf("[replay] init %.3f ms\n", MsSince(initStart));
+
+  uint32_t threadCount = singleThread ? 1 : capture.threadCount;
+  vks::ThreadPool pool;
+  pool.setThreadCount(threadCount - 1);
+  std::vector<std::vector<const ReplayRecord*>> threadRecords(threadCount);
+  std::vector<std::vector<const ReplayRecord*>> deferred(threadCount);
+  std::vector<StageTimes> threadTimes(threadCount);
+  std::vector<double> threadBusyMs(threadCount);
+
+  LatencyHistogram frameMs;
+  LatencyHistogram stageMs[kStageCount];
+  std::vector<LatencyHistogram> busyMs(threadCount);
+  std::vector<double> frameWallMs(capture.frames.size());
+
+  for (size_t f = 0; f < capture.frames.size(); f++) {
+    const ReplayFrame& frame = capture.frames[f];
+    for (size_t t = 0; t < threadCount; t++) {
+      threadRecords[t].clear();
+      deferred[t].clear();
+      threadTimes[t] = {};
+    }
+    for (size_t i = frame.begin; i < frame.end; i++) {
+      threadRecords[singleThread ? 0 : records[i].thread].push_back(
+          &records[i]);
+    }
+
+    Clock::time_point frameStart = Clock::now();
+    auto runThread = [&](size_t t) {
+      Clock::time_point start = Clock::now();
+      for (const ReplayRecord* record : threadRecords[t]) {
+        replayer.Execute(*record, &threadTimes[t],
+                         singleThread ? nullptr : &deferred[t]);
+      }
+      threadBusyMs[t] = MsSince(start);
+    };
+    for (size_t t = 1; t < threadCount; t++) {
+      pool.threads[t - 1]->addJob([&runThread, t] { runThread(t); });
+    }
+    runThread(0);
+    pool.wait();
+    for (size_t t = 0; t < threadCount; t++) {
+      for (const ReplayRecord* record : deferred[t]) {
+        replayer.Execute(*record, &threadTimes[0], nullptr);
+      }
+    }
+    replayer.Tick();
+    frameWallMs[f] = MsSince(frameStart);
+
+    frameMs.Record(frameWallMs[f]);
+    for (int s = 0; s < kStageCount; s++) {
+      double total = 0;
+      for (const StageTimes& times : threadTimes) {
+        total += times.ms[s];
+      }
+      stageMs[s].Record(total);
+    }
+    for (size_t t = 0; t < threadCount; t++) {
+      busyMs[t].Record(threadBusyMs[t]);
+    }
+  }
+
+  if (capture.frames.empty()) {
+    printf("[replay] no frames captured\n");
+  } else {
+    PrintSummary("frame", frameMs);
+    for (int s = 0; s < kStageCount; s++) {
+      PrintSummary(StageName(s), stageMs[s]);
+    }
+    for (size_t t = 0; t < threadCount && threadCount > 1; t++) {
+      char name[32];
+      snprintf(name, sizeof(name), "thread %zu", t);
+      PrintSummary(name, busyMs[t]);
+    }
+
+    std::vector<size_t> order(capture.frames.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    size_t listed = std::min(order.size(), static_cast<size_t>(slowest));
+    std::partial_sort(
+        order.begin(), order.begin() + listed, order.end(),
+        [&](size_t a, size_t b) { return frameWallMs[a] > frameWallMs[b]; });
+    for (size_t i = 0; i < listed; i++) {
+      const ReplayFrame& frame = capture.frames[order[i]];
+      printf("[replay] slow frame %zu: %.3f ms  frameTime %u  focus (%.2f, "
+             "%.2f)  cullRadius %.2f\n",
+             order[i], frameWallMs[order[i]], frame.frameTime, frame.focusX,
+             frame.focusY, frame.cullRadius);
+    }
+  }
+
+  uint64_t errors = gDeviceErrors.load();
+  if (errors) {
+    printf("[replay] %llu device errors\n",
+           static_cast<unsigned long long>(errors));
+  }
+  pool.setThreadCount(0);
+  wgpuDeviceRelease(device);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Minimal 4-wide float vector wrapper so kernels can be written once for wasm
+// SIMD (-msimd128) and SSE2. HAVE_SIMD4 is 0 on other targets, where callers
+// fall back to scalar loops.
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define HAVE_SIMD4 1
+
+using F4 = v128_t;
+inline F4 F4Load(const float* p) { return wasm_v128_load(p); }
+inline F4 F4Splat(float v) { return wasm_f32x4_splat(v); }
+inline F4 F4Add(F4 a, F4 b) { return wasm_f32x4_add(a, b); }
+inline F4 F4Sub(F4 a, F4 b) { return wasm_f32x4_sub(a, b); }
+inline F4 F4Mul(F4 a, F4 b) { return wasm_f32x4_mul(a, b); }
+inline F4 F4Abs(F4 a) { return wasm_f32x4_abs(a); }
+// Bit i is set if lane i of a < b.
+inline unsigned F4LessMask(F4 a, F4 b) {
+  return wasm_i32x4_bitmask(wasm_f32x4_lt(a, b));
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SIMD4 1
+
+using F4 = __m128;
+inline F4 F4Load(const float* p) { return _mm_loadu_ps(p); }
+inline F4 F4Splat(float v) { return _mm_set1_ps(v); }
+inline F4 F4Add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+inline F4 F4Sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+inline F4 F4Mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+inline F4 F4Abs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline unsigned F4LessMask(F4 a, F4 b) {
+  return static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(a, b)));
+}
+
+#else
+#define HAVE_SIMD4 0
+#endif
@@ -0,0 +1,63 @@
+#include "simulation.h"
+
+#include <cstdio>
+#include <utility>
+
+void SnapshotExchange::Publish() {
+  // Releases the snapshot to the consumer's exchange, and takes back
+  // whichever buffer was in the middle.
+  back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & ~kFresh;
+}
+
+const SimulationSnapshot& SnapshotExchange::Acquire() {
+  if (middle_.load(std::memory_order_relaxed) & kFresh) {
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & ~kFresh;
+  }
+  return buffers_[front_].value;
+}
+
+SimulationThread::SimulationThread(double rateHz, Step step)
+    : rateHz_(rateHz),
+      period_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / rateHz))),
+      step_(std::move(step)) {
+  exchange_.Back() = step_(0);
+  exchange_.Publish();
+  steps_ = 1;
+  thread_ = std::thread([this] { Run(); });
+}
+
+SimulationThread::~SimulationThread() {
+  Stop();
+}
+
+void SimulationThread::Stop() {
+  running_.store(false, std::memory_order_relaxed);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void SimulationThread::Run() {
+  Clock::time_point next = Clock::now();
+  uint32_t tick = 1;
+  while (running_.load(std::memory_order_relaxed)) {
+    next += period_;
+    Clock::time_point now = Clock::now();
+    if (now < next) {
+      std::this_thread::sleep_until(next);
+    } else if (now >= next + period_) {
+      caughtUpSteps_++;
+    }
+    exchange_.Back() = step_(tick++);
+    exchange_.Publish();
+    steps_++;
+  }
+}
+
+void SimulationThread::Print(const char* prefix) const {
+  printf("%s %.1f Hz: %llu steps, %llu caught up after falling a period "
+         "behind\n",
+         prefix, rateHz_, (unsigned long long)steps_,
+         (unsigned long long)caughtUpSteps_);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "cache_line.h"
+
+// The animation state one simulation step produces. Render code reads a copy
+// taken at the start of the frame, so it never changes under the workers.
+struct SimulationSnapshot {
+  // Steps since the start; simulated time is tick / rate.
+  uint32_t tick = 0;
+  float focusX = 0;
+  float focusY = 0;
+  float cullRadius = 0;
+};
+
+// Hands snapshots from one producer thread to one consumer thread without
+// locks or waiting. The producer writes into a back buffer it owns and swaps
+// it with the shared middle buffer; the consumer swaps the middle buffer with
+// the front buffer it owns when a newer one is there. Neither side ever
+// touches a buffer the other owns, so the producer keeps publishing at its own
+// rate while the consumer reads a snapshot that can't be torn, and the
+// consumer always gets the newest one. (Two buffers would make the producer
+// wait for the consumer to let go of one.)
+class SnapshotExchange {
+ public:
+  // Owned by the producer until the next Publish().
+  SimulationSnapshot& Back() { return buffers_[back_].value; }
+  void Publish();
+
+  // Takes the newest published snapshot, if there is one newer than the last
+  // Acquire(), and returns the consumer's copy. It stays unchanged until the
+  // next Acquire().
+  const SimulationSnapshot& Acquire();
+
+ private:
+  // The middle buffer's index, plus kFresh when it holds a snapshot the
+  // consumer hasn't taken yet.
+  static constexpr uint32_t kFresh = 4;
+
+  struct alignas(kCacheLineSize) Buffer {
+    SimulationSnapshot value;
+  };
+
+  Buffer buffers_[3];
+  alignas(kCacheLineSize) std::atomic<uint32_t> middle_{1};
+  alignas(kCacheLineSize) uint32_t back_ = 0;
+  alignas(kCacheLineSize) uint32_t front_ = 2;
+};
+
+// Runs |step| on its own thread at a fixed rate, publishing each snapshot
+// through a SnapshotExchange. Simulated time advances by exactly one period
+// per step, however fast frames render: a step that starts late is run
+// straight away, and steps that fall behind are caught up back to back
+// rather than stretching the period.
+class SimulationThread {
+ public:
+  using Step = std::function<SimulationSnapshot(uint32_t tick)>;
+
+  SimulationThread(double rateHz, Step step);
+  ~SimulationThread();
+
+  SimulationThread(const SimulationThread&) = delete;
+  SimulationThread& operator=(const SimulationThread&) = delete;
+
+  // The newest snapshot; see SnapshotExchange::Acquire(). Called from one
+  // thread only. Tick 0's snapshot is published before the thread starts, so
+  // there always is one.
+  const SimulationSnapshot& Latest() { return exchange_.Acquire(); }
+
+  void Stop();
+
+  // "<prefix> N Hz: N steps, N caught up".
+  void Print(const char* prefix) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void Run();
+
+  const double rateHz_;
+  const Clock::duration period_;
+  const Step step_;
+  SnapshotExchange exchange_;
+  std::atomic<bool> running_{true};
+
+  // Written by the simulation thread, read by Print() after Stop().
+  uint64_t steps_ = 0;
+  // Steps run without sleeping, the thread being a period or more behind.
+  uint64_t caughtUpSteps_ = 0;
+
+  std::thread thread_;
+};
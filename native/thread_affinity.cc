@@ -0,0 +1,234 @@
+#include "thread_affinity.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_LINUX_AFFINITY 1
+#else
+#define HAVE_LINUX_AFFINITY 0
+#endif
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#include <pthread/qos.h>
+#endif
+
+namespace {
+
+struct CpuTopology {
+  int cpu;
+  int package;
+  int core;
+  int sibling;  // Index among the hyperthreads of its core.
+};
+
+#if HAVE_LINUX_AFFINITY
+
+cpu_set_t StartupAffinity() {
+  static const cpu_set_t set = [] {
+    cpu_set_t s;
+    CPU_ZERO(&s);
+    sched_getaffinity(0, sizeof(s), &s);
+    return s;
+  }();
+  return set;
+}
+
+int ReadTopologyValue(int cpu, const char* name) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/" + name);
+  int value = 0;
+  file >> value;
+  return value;
+}
+
+// Allowed CPUs with their package and core ids.
+std::vector<CpuTopology> ReadTopology() {
+  cpu_set_t allowed = StartupAffinity();
+  std::vector<CpuTopology> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      cpus.push_back({cpu, ReadTopologyValue(cpu, "physical_package_id"),
+                      ReadTopologyValue(cpu, "core_id"), 0});
+    }
+  }
+  std::sort(cpus.begin(), cpus.end(), [](const CpuTopology& a,
+                                         const CpuTopology& b) {
+    return std::tie(a.package, a.core, a.cpu) <
+           std::tie(b.package, b.core, b.cpu);
+  });
+  for (size_t i = 1; i < cpus.size(); i++) {
+    if (cpus[i].package == cpus[i - 1].package &&
+        cpus[i].core == cpus[i - 1].core) {
+      cpus[i].sibling = cpus[i - 1].sibling + 1;
+    }
+  }
+  return cpus;
+}
+
+#else
+
+std::vector<CpuTopology> ReadTopology() {
+  return {};
+}
+
+#endif
+
+}  // namespace
+
+bool AffinityPolicy::Parse(const std::string& text, AffinityPolicy* policy) {
+  *policy = {};
+  if (text.empty() || text == "none") {
+    return true;
+  }
+  if (text == "compact") {
+    policy->kind = Kind::Compact;
+    return true;
+  }
+  if (text == "scatter") {
+    policy->kind = Kind::Scatter;
+    return true;
+  }
+
+  // Comma-separated CPUs and inclusive ranges.
+  policy->kind = Kind::List;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    char* end = nullptr;
+    long first = strtol(item.c_str(), &end, 10);
+    long last = first;
+    if (end == item.c_str()) {
+      return false;
+    }
+    if (*end == '-') {
+      const char* rest = end + 1;
+      last = strtol(rest, &end, 10);
+      if (end == rest) {
+        return false;
+      }
+    }
+    if (*end != '\0' || first < 0 || last < first) {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      policy->cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+  return !policy->cpus.empty();
+}
+
+std::string AffinityPolicy::ToString() const {
+  switch (kind) {
+    case Kind::None:
+      return "none";
+    case Kind::Compact:
+      return "compact";
+    case Kind::Scatter:
+      return "scatter";
+    case Kind::List:
+      break;
+  }
+  std::string text;
+  for (int cpu : cpus) {
+    text += (text.empty() ? "" : ",") + std::to_string(cpu);
+  }
+  return text;
+}
+
+std::vector<int> AffinityPolicy::CpuOrder() const {
+  if (kind == Kind::None) {
+    return {};
+  }
+  if (kind == Kind::List) {
+    return cpus;
+  }
+
+  std::vector<CpuTopology> topology = ReadTopology();
+  if (kind == Kind::Scatter) {
+    // Rank cores within their package, then take the first core of every
+    // package, the second of every package, ... with SMT siblings last.
+    std::vector<int> coreRank(topology.size());
+    for (size_t i = 0, rank = 0; i < topology.size(); i++) {
+      if (i > 0 && topology[i].package != topology[i - 1].package) {
+        rank = 0;
+      } else if (i > 0 && topology[i].core != topology[i - 1].core) {
+        rank++;
+      }
+      coreRank[i] = static_cast<int>(rank);
+    }
+    std::vector<size_t> order(topology.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return std::make_tuple(topology[a].sibling, coreRank[a],
+                             topology[a].package) <
+             std::make_tuple(topology[b].sibling, coreRank[b],
+                             topology[b].package);
+    });
+    std::vector<int> result;
+    for (size_t i : order) {
+      result.push_back(topology[i].cpu);
+    }
+    return result;
+  }
+
+  std::vector<int> result;
+  for (const CpuTopology& cpu : topology) {
+    result.push_back(cpu.cpu);
+  }
+  return result;
+}
+
+bool PinCurrentThread(int cpu) {
+#if HAVE_LINUX_AFFINITY
+  cpu_set_t set = StartupAffinity();
+  if (cpu >= 0) {
+    if (cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+bool SetCurrentThreadName(const char* name) {
+#if HAVE_LINUX_AFFINITY
+  char truncated[16];
+  snprintf(truncated, sizeof(truncated), "%s", name);
+  return pthread_setname_np(pthread_self(), truncated) == 0;
+#elif defined(__APPLE__)
+  return pthread_setname_np(name) == 0;
+#else
+  (void)name;
+  return false;
+#endif
+}
+
+bool RaiseCurrentThreadPriority() {
+#if HAVE_LINUX_AFFINITY
+  // On Linux nice values are per thread.
+  pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  return setpriority(PRIO_PROCESS, tid, -10) == 0;
+#elif defined(__APPLE__)
+  return pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) == 0;
+#else
+  return false;
+#endif
+}
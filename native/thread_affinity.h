@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// CPU placement, naming and priority of the calling thread. All of these are
+// best effort: they return false where the platform (or the process's
+// permissions) doesn't support them, and the caller carries on.
+
+// Which CPUs worker threads are pinned to.
+//   none     no pinning; the scheduler may migrate workers freely
+//   compact  fill one package/core at a time: worker i on the i-th logical
+//            CPU ordered by (package, core, hyperthread)
+//   scatter  spread over packages and physical cores before using SMT
+//            siblings
+//   list     an explicit list of logical CPUs, e.g. "0,2,4-7"
+struct AffinityPolicy {
+  enum class Kind { None, Compact, Scatter, List };
+
+  Kind kind = Kind::None;
+  std::vector<int> cpus;  // Kind::List only.
+
+  // Parses "none", "compact", "scatter" or a CPU list ("" is none). Returns
+  // false if |text| is none of these.
+  static bool Parse(const std::string& text, AffinityPolicy* policy);
+  std::string ToString() const;
+
+  // Logical CPUs in the order workers are assigned to them; empty for None.
+  // Worker i runs on CpuOrder()[i % size].
+  std::vector<int> CpuOrder() const;
+};
+
+// Restricts the calling thread to |cpu|, or with cpu < 0, to every CPU the
+// process was allowed to use at startup.
+bool PinCurrentThread(int cpu);
+
+// Name shown by debuggers and profilers (truncated to 15 characters on Linux).
+bool SetCurrentThreadName(const char* name);
+
+// Asks the scheduler to favour the calling thread, for the thread that
+// assembles and submits frames. Lowering the nice value usually needs
+// CAP_SYS_NICE on Linux.
+bool RaiseCurrentThreadPriority();
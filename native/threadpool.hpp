@@ -6,9 +6,11 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
+#include <memory>
 #include <vector>
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
@@ -28,7 +30,11 @@ namespace vks
 	private:
 		bool destroying = false;
 		std::thread worker;
-		std::queue<std::function<void()>> jobQueue;
+		// FIFO of pending jobs [jobQueueHead, size). A vector rather than a
+		// std::queue: it keeps its capacity when drained, so a steady stream of
+		// jobs doesn't allocate (a deque allocates and frees nodes as it goes).
+		std::vector<std::function<void()>> jobQueue;
+		size_t jobQueueHead = 0;
 		std::mutex queueMutex;
 		std::condition_variable condition;
 
@@ -40,19 +46,23 @@ namespace vks
 				std::function<void()> job;
 				{
 					std::unique_lock<std::mutex> lock(queueMutex);
-					condition.wait(lock, [this] { return !jobQueue.empty() || destroying; });
+					condition.wait(lock, [this] { return jobQueueHead < jobQueue.size() || destroying; });
 					if (destroying)
 					{
 						break;
 					}
-					job = jobQueue.front();
+					job = std::move(jobQueue[jobQueueHead]);
 				}
 
 				job();
 
 				{
 					std::lock_guard<std::mutex> lock(queueMutex);
-					jobQueue.pop();
+					if (++jobQueueHead == jobQueue.size())
+					{
+						jobQueue.clear();
+						jobQueueHead = 0;
+					}
 					condition.notify_one();
 				}
 			}
@@ -81,7 +91,14 @@ namespace vks
 		void addJob(std::function<void()> function)
 		{
 			std::lock_guard<std::mutex> lock(queueMutex);
-			jobQueue.push(std::move(function));
+			if (jobQueueHead > 0 && jobQueue.size() == jobQueue.capacity())
+			{
+				// Reuse the space of finished jobs instead of growing. The job at
+				// jobQueueHead may be running; it stays first.
+				jobQueue.erase(jobQueue.begin(), jobQueue.begin() + jobQueueHead);
+				jobQueueHead = 0;
+			}
+			jobQueue.push_back(std::move(function));
 			condition.notify_one();
 		}
 
@@ -89,7 +106,7 @@ namespace vks
 		void wait()
 		{
 			std::unique_lock<std::mutex> lock(queueMutex);
-			condition.wait(lock, [this]() { return jobQueue.empty(); });
+			condition.wait(lock, [this]() { return jobQueueHead == jobQueue.size(); });
 		}
 	};
 	
@@ -0,0 +1,218 @@
+#include "tlsf_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace {
+
+uint32_t Log2(uint32_t value) {
+  return 31 - __builtin_clz(value);
+}
+
+uint32_t LowestBit(uint32_t value) {
+  return __builtin_ctz(value);
+}
+
+}  // namespace
+
+TlsfAllocator::TlsfAllocator(uint64_t capacity, uint64_t granularity)
+    : granularity_(granularity),
+      granuleCount_(static_cast<uint32_t>(capacity / granularity)) {
+  assert(granularity > 0 && (granularity & (granularity - 1)) == 0);
+  assert(capacity / granularity <= UINT32_MAX);
+  for (auto& heads : freeHeads_) {
+    std::fill(std::begin(heads), std::end(heads), kInvalidNode);
+  }
+  if (granuleCount_ > 0) {
+    uint32_t node = NewNode();
+    nodes_[node] = {0, granuleCount_, kInvalidNode, kInvalidNode,
+                    kInvalidNode, kInvalidNode, true};
+    InsertFree(node);
+  }
+}
+
+// static
+void TlsfAllocator::Mapping(uint32_t size,
+                            uint32_t* firstLevel,
+                            uint32_t* secondLevel) {
+  if (size < kSecondLevelCount) {
+    *firstLevel = 0;
+    *secondLevel = size;
+    return;
+  }
+  uint32_t log2 = Log2(size);
+  *firstLevel = log2 - kSecondLevelLog2 + 1;
+  *secondLevel = (size >> (log2 - kSecondLevelLog2)) ^ kSecondLevelCount;
+}
+
+uint32_t TlsfAllocator::NewNode() {
+  if (!unusedNodes_.empty()) {
+    uint32_t node = unusedNodes_.back();
+    unusedNodes_.pop_back();
+    return node;
+  }
+  nodes_.emplace_back();
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void TlsfAllocator::InsertFree(uint32_t node) {
+  uint32_t firstLevel, secondLevel;
+  Mapping(nodes_[node].size, &firstLevel, &secondLevel);
+  uint32_t& head = freeHeads_[firstLevel][secondLevel];
+  nodes_[node].free = true;
+  nodes_[node].prevFree = kInvalidNode;
+  nodes_[node].nextFree = head;
+  if (head != kInvalidNode) {
+    nodes_[head].prevFree = node;
+  }
+  head = node;
+  firstLevelBitmap_ |= 1u << firstLevel;
+  secondLevelBitmaps_[firstLevel] |= 1u << secondLevel;
+  freeBlocks_++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t node) {
+  Node& n = nodes_[node];
+  if (n.prevFree != kInvalidNode) {
+    nodes_[n.prevFree].nextFree = n.nextFree;
+  } else {
+    uint32_t firstLevel, secondLevel;
+    Mapping(n.size, &firstLevel, &secondLevel);
+    freeHeads_[firstLevel][secondLevel] = n.nextFree;
+    if (n.nextFree == kInvalidNode) {
+      secondLevelBitmaps_[firstLevel] &= ~(1u << secondLevel);
+      if (secondLevelBitmaps_[firstLevel] == 0) {
+        firstLevelBitmap_ &= ~(1u << firstLevel);
+      }
+    }
+  }
+  if (n.nextFree != kInvalidNode) {
+    nodes_[n.nextFree].prevFree = n.prevFree;
+  }
+  n.free = false;
+  freeBlocks_--;
+}
+
+uint32_t TlsfAllocator::FindFree(uint32_t size) const {
+  // Round up to the next bin boundary, so every block of the bin found fits.
+  if (size >= kSecondLevelCount) {
+    uint64_t rounded =
+        size + (uint64_t(1) << (Log2(size) - kSecondLevelLog2)) - 1;
+    if (rounded > UINT32_MAX) {
+      return kInvalidNode;
+    }
+    size = static_cast<uint32_t>(rounded);
+  }
+  uint32_t firstLevel, secondLevel;
+  Mapping(size, &firstLevel, &secondLevel);
+  if (firstLevel >= kFirstLevelCount) {
+    return kInvalidNode;
+  }
+
+  uint32_t secondLevelMap =
+      secondLevelBitmaps_[firstLevel] & (~0u << secondLevel);
+  if (secondLevelMap == 0) {
+    uint32_t firstLevelMap =
+        firstLevel + 1 < kFirstLevelCount
+            ? firstLevelBitmap_ & (~0u << (firstLevel + 1))
+            : 0;
+    if (firstLevelMap == 0) {
+      return kInvalidNode;
+    }
+    firstLevel = LowestBit(firstLevelMap);
+    secondLevelMap = secondLevelBitmaps_[firstLevel];
+  }
+  return freeHeads_[firstLevel][LowestBit(secondLevelMap)];
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint64_t size,
+                                                  uint64_t alignment) {
+  assert(size > 0 && alignment > 0 && (alignment & (alignment - 1)) == 0);
+  uint64_t granules = (size + granularity_ - 1) / granularity_;
+  // Worst-case padding to reach an alignment coarser than a granule.
+  uint64_t padding =
+      alignment > granularity_ ? alignment / granularity_ - 1 : 0;
+  if (granules + padding > granuleCount_) {
+    return {};
+  }
+
+  uint32_t node = FindFree(static_cast<uint32_t>(granules + padding));
+  if (node == kInvalidNode) {
+    return {};
+  }
+  RemoveFree(node);
+
+  uint64_t start = uint64_t(nodes_[node].offset) * granularity_;
+  uint64_t aligned = (start + alignment - 1) & ~(alignment - 1);
+  uint32_t blockSize = static_cast<uint32_t>(
+      (aligned - start) / granularity_ + granules);
+
+  // Return the tail to the free lists.
+  if (nodes_[node].size > blockSize) {
+    uint32_t tail = NewNode();
+    Node& n = nodes_[node];
+    nodes_[tail] = {n.offset + blockSize, n.size - blockSize, node,
+                    n.nextPhysical, kInvalidNode, kInvalidNode, true};
+    if (n.nextPhysical != kInvalidNode) {
+      nodes_[n.nextPhysical].prevPhysical = tail;
+    }
+    n.nextPhysical = tail;
+    n.size = blockSize;
+    InsertFree(tail);
+  }
+
+  usedGranules_ += nodes_[node].size;
+  allocations_++;
+  return {aligned, node};
+}
+
+void TlsfAllocator::Free(uint32_t node) {
+  assert(node < nodes_.size() && !nodes_[node].free);
+  usedGranules_ -= nodes_[node].size;
+  allocations_--;
+
+  // Absorb free neighbours; the merged block keeps the lowest node.
+  uint32_t next = nodes_[node].nextPhysical;
+  if (next != kInvalidNode && nodes_[next].free) {
+    RemoveFree(next);
+    nodes_[node].size += nodes_[next].size;
+    nodes_[node].nextPhysical = nodes_[next].nextPhysical;
+    if (nodes_[next].nextPhysical != kInvalidNode) {
+      nodes_[nodes_[next].nextPhysical].prevPhysical = node;
+    }
+    unusedNodes_.push_back(next);
+  }
+  uint32_t prev = nodes_[node].prevPhysical;
+  if (prev != kInvalidNode && nodes_[prev].free) {
+    RemoveFree(prev);
+    nodes_[prev].size += nodes_[node].size;
+    nodes_[prev].nextPhysical = nodes_[node].nextPhysical;
+    if (nodes_[node].nextPhysical != kInvalidNode) {
+      nodes_[nodes_[node].nextPhysical].prevPhysical = prev;
+    }
+    unusedNodes_.push_back(node);
+    node = prev;
+  }
+  InsertFree(node);
+}
+
+TlsfAllocator::Stats TlsfAllocator::GetStats() const {
+  Stats stats;
+  stats.capacity = uint64_t(granuleCount_) * granularity_;
+  stats.used = uint64_t(usedGranules_) * granularity_;
+  stats.allocations = allocations_;
+  stats.freeBlocks = freeBlocks_;
+  // The largest block is in the highest non-empty bin; bins hold a range of
+  // sizes, so check all of that bin's blocks.
+  if (firstLevelBitmap_ != 0) {
+    uint32_t firstLevel = Log2(firstLevelBitmap_);
+    uint32_t secondLevel = Log2(secondLevelBitmaps_[firstLevel]);
+    for (uint32_t node = freeHeads_[firstLevel][secondLevel];
+         node != kInvalidNode; node = nodes_[node].nextFree) {
+      stats.largestFreeBlock = std::max<uint64_t>(
+          stats.largestFreeBlock, uint64_t(nodes_[node].size) * granularity_);
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit (TLSF) bookkeeping for long-lived allocations in a
+// fixed-size space, such as one large GPU buffer. Like RangeAllocator it
+// never touches the memory it manages, but Allocate() and Free() are O(1):
+// free blocks are kept in lists binned by size (a power-of-two first level
+// split into 16 linear second-level bins), and two levels of bitmaps find the
+// smallest non-empty bin that fits without scanning. Freed blocks merge with
+// free physical neighbours immediately.
+//
+// Space is managed in granules of |granularity| bytes, so every allocation
+// starts on a granule boundary; larger alignments are served by padding the
+// allocation.
+class TlsfAllocator {
+ public:
+  static constexpr uint32_t kInvalidNode = UINT32_MAX;
+
+  struct Allocation {
+    // Byte offset of the allocation, aligned as requested.
+    uint64_t offset = 0;
+    // Identifies the allocation for Free().
+    uint32_t node = kInvalidNode;
+  };
+
+  struct Stats {
+    uint64_t capacity = 0;
+    // Bytes in allocated blocks, including granule and alignment padding.
+    uint64_t used = 0;
+    uint32_t allocations = 0;
+    uint32_t freeBlocks = 0;
+    uint64_t largestFreeBlock = 0;
+  };
+
+  // |granularity| must be a power of two, and capacity / granularity must
+  // fit in 32 bits.
+  TlsfAllocator(uint64_t capacity, uint64_t granularity);
+
+  // Returns an allocation with node kInvalidNode if no free block fits.
+  Allocation Allocate(uint64_t size, uint64_t alignment);
+  void Free(uint32_t node);
+
+  Stats GetStats() const;
+
+ private:
+  static constexpr uint32_t kSecondLevelLog2 = 4;
+  static constexpr uint32_t kSecondLevelCount = 1 << kSecondLevelLog2;
+  static constexpr uint32_t kFirstLevelCount = 32;
+
+  // A block of granules [offset, offset + size), free or allocated. Blocks
+  // tile the space; prev/nextPhysical link address neighbours, and
+  // prev/nextFree the members of a free list.
+  struct Node {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t prevPhysical;
+    uint32_t nextPhysical;
+    uint32_t prevFree;
+    uint32_t nextFree;
+    bool free;
+  };
+
+  static void Mapping(uint32_t size, uint32_t* firstLevel,
+                      uint32_t* secondLevel);
+  uint32_t NewNode();
+  void InsertFree(uint32_t node);
+  void RemoveFree(uint32_t node);
+  // Smallest free block of at least |size| granules, or kInvalidNode.
+  uint32_t FindFree(uint32_t size) const;
+
+  uint64_t granularity_;
+  uint32_t granuleCount_;
+
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> unusedNodes_;
+
+  uint32_t firstLevelBitmap_ = 0;
+  uint32_t secondLevelBitmaps_[kFirstLevelCount] = {};
+  uint32_t freeHeads_[kFirstLevelCount][kSecondLevelCount];
+
+  uint32_t usedGranules_ = 0;
+  uint32_t allocations_ = 0;
+  uint32_t freeBlocks_ = 0;
+};
@@ -0,0 +1,92 @@
+// Compares the debug and optimized web builds without needing WebGPU.
+//
+// $ npm run build-web   # builds hello, hello_opt, bench_kernels, bench_kernels_opt
+// $ node web_build_report.js [out/web]
+//
+// Reports wasm/js size and WebAssembly.compile time of the app, and module
+// startup time plus math/culling kernel throughput of the kernel benchmarks.
+
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+const outDir = process.argv[2] || path.join(__dirname, 'out', 'web');
+const kCompileRuns = 3;
+
+function fileSize(file) {
+  try {
+    return fs.statSync(file).size;
+  } catch (e) {
+    return NaN;
+  }
+}
+
+async function compileMs(wasmFile) {
+  const bytes = fs.readFileSync(wasmFile);
+  let best = Infinity;
+  for (let i = 0; i < kCompileRuns; ++i) {
+    const start = performance.now();
+    await WebAssembly.compile(bytes);
+    best = Math.min(best, performance.now() - start);
+  }
+  return best;
+}
+
+function runKernels(jsFile) {
+  const start = performance.now();
+  const result = spawnSync(process.execPath, [jsFile], { encoding: 'utf8' });
+  const wallMs = performance.now() - start;
+  if (result.status !== 0) {
+    throw new Error(`${jsFile} exited with ${result.status}:\n${result.stderr}`);
+  }
+  const json = result.stdout.split('\n').find(line => line.startsWith('{'));
+  return { wallMs, ...JSON.parse(json) };
+}
+
+function kib(bytes) {
+  return (bytes / 1024).toFixed(1) + ' KiB';
+}
+
+function ratio(debug, opt) {
+  return (debug / opt).toFixed(2) + 'x';
+}
+
+(async () => {
+  const rows = [];
+  const report = {};
+
+  for (const [label, app, kernels] of [
+    ['debug', 'hello', 'bench_kernels'],
+    ['opt', 'hello_opt', 'bench_kernels_opt'],
+  ]) {
+    const wasm = path.join(outDir, app + '.wasm');
+    report[label] = {
+      wasmBytes: fileSize(wasm),
+      jsBytes: fileSize(path.join(outDir, app + '.js')),
+      compileMs: await compileMs(wasm),
+      kernels: runKernels(path.join(outDir, kernels + '.js')),
+    };
+  }
+
+  const d = report.debug;
+  const o = report.opt;
+  rows.push(['', 'debug', 'opt', 'improvement']);
+  rows.push(['app wasm size', kib(d.wasmBytes), kib(o.wasmBytes), ratio(d.wasmBytes, o.wasmBytes)]);
+  rows.push(['app js size', kib(d.jsBytes), kib(o.jsBytes), ratio(d.jsBytes, o.jsBytes)]);
+  rows.push(['app compile (ms)', d.compileMs.toFixed(2), o.compileMs.toFixed(2), ratio(d.compileMs, o.compileMs)]);
+  rows.push(['kernels startup (ms)', d.kernels.startup_ms.toFixed(2), o.kernels.startup_ms.toFixed(2),
+             ratio(d.kernels.startup_ms, o.kernels.startup_ms)]);
+  rows.push(['kernels simd', String(d.kernels.simd), String(o.kernels.simd), '']);
+  for (const name of Object.keys(d.kernels.kernels)) {
+    const dk = d.kernels.kernels[name];
+    const ok = o.kernels.kernels[name];
+    rows.push([name + ' (M items/s)', (dk.items_per_second / 1e6).toFixed(1),
+               (ok.items_per_second / 1e6).toFixed(1), ratio(ok.items_per_second, dk.items_per_second)]);
+  }
+
+  const widths = rows[0].map((_, col) => Math.max(...rows.map(r => r[col].length)));
+  for (const row of rows) {
+    console.log(row.map((cell, col) => cell.padEnd(widths[col])).join('  '));
+  }
+  console.log('\n' + JSON.stringify(report));
+})();